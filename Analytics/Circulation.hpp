@@ -0,0 +1,192 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../Users.hpp"
+#include "Sketch.hpp"
+
+struct GenreStats {
+  uint32_t books;
+  uint32_t activeLoans;
+  uint64_t totalLoans;
+};
+
+struct UserTypeStats {
+  uint32_t users;
+  // Сколько книг могут взять все активные пользователи этого типа
+  uint32_t capacity;
+  uint32_t activeLoans;
+  uint64_t totalLoans;
+
+  double utilization() const {
+    return capacity == 0 ? 0.0 : static_cast<double>(activeLoans) / capacity;
+  }
+};
+
+struct DayRollup {
+  int32_t day;
+  uint32_t loans;
+  uint32_t returns;
+};
+
+// Сводки по выдачам, которые Library обновляет на каждой операции.
+// Любой запрос отвечается за O(1) или O(K), без обхода истории.
+class CirculationStats {
+ public:
+  static const int kRollupDays = 400;
+
+ private:
+  static const size_t kTopCandidates = 256;
+
+  std::unordered_map<std::string, GenreStats> genres;
+  UserTypeStats userTypes[3];
+  SpaceSaving topBooks;
+  CountMinSketch bookLoans;
+
+  // Открытые выдачи по дню возврата. Выдачи со сроком раньше overdueDay
+  // уже учтены в overdueCount.
+  std::map<int32_t, uint32_t> dueBuckets;
+  int32_t overdueDay;
+  uint32_t overdueCount;
+
+  // Кольцо посуточных сводок, ячейка - day % kRollupDays
+  std::vector<DayRollup> rollups;
+
+  DayRollup& rollup(int32_t day) {
+    DayRollup& slot = rollups[((day % kRollupDays) + kRollupDays) %
+                              kRollupDays];
+    if (slot.day != day) slot = {day, 0, 0};
+    return slot;
+  }
+
+  // Сдвинуть границу просрочки: выдача просрочена, если срок < today
+  void moveOverdueDay(int32_t today) {
+    if (today > overdueDay) {
+      for (auto it = dueBuckets.lower_bound(overdueDay);
+           it != dueBuckets.end() && it->first < today; ++it) {
+        overdueCount += it->second;
+      }
+    } else {
+      for (auto it = dueBuckets.lower_bound(today);
+           it != dueBuckets.end() && it->first < overdueDay; ++it) {
+        overdueCount -= it->second;
+      }
+    }
+    overdueDay = today;
+  }
+
+ public:
+  CirculationStats()
+      : userTypes(),
+        topBooks(kTopCandidates),
+        bookLoans(8192),
+        overdueDay(INT32_MIN),
+        overdueCount(0),
+        rollups(kRollupDays, DayRollup{INT32_MIN, 0, 0}) {}
+
+  void bookAdded(const std::string& genre) { ++genres[genre].books; }
+
+  void bookRemoved(uint32_t book, const std::string& genre) {
+    auto it = genres.find(genre);
+    if (it != genres.end() && --it->second.books == 0 &&
+        it->second.totalLoans == 0) {
+      genres.erase(it);
+    }
+    topBooks.forget(book);
+  }
+
+  void userAdded(UserType type) {
+    UserTypeStats& stats = userTypes[static_cast<int>(type)];
+    ++stats.users;
+    stats.capacity += userPolicy(type).maxBooks;
+  }
+
+  void userRemoved(UserType type) {
+    UserTypeStats& stats = userTypes[static_cast<int>(type)];
+    --stats.users;
+    stats.capacity -= userPolicy(type).maxBooks;
+  }
+
+  void loanOpened(uint32_t book, const std::string& genre, UserType type,
+                  int32_t borrowDay, int32_t dueDay) {
+    GenreStats& genreStats = genres[genre];
+    ++genreStats.activeLoans;
+    ++genreStats.totalLoans;
+    UserTypeStats& typeStats = userTypes[static_cast<int>(type)];
+    ++typeStats.activeLoans;
+    ++typeStats.totalLoans;
+
+    topBooks.add(book);
+    bookLoans.add(book);
+    ++dueBuckets[dueDay];
+    if (dueDay < overdueDay) ++overdueCount;
+    ++rollup(borrowDay).loans;
+  }
+
+  void loanClosed(const std::string& genre, UserType type, int32_t dueDay,
+                  int32_t returnDay) {
+    auto genreIt = genres.find(genre);
+    if (genreIt != genres.end()) --genreIt->second.activeLoans;
+    --userTypes[static_cast<int>(type)].activeLoans;
+
+    auto bucket = dueBuckets.find(dueDay);
+    if (bucket != dueBuckets.end()) {
+      if (dueDay < overdueDay) --overdueCount;
+      if (--bucket->second == 0) dueBuckets.erase(bucket);
+    }
+    ++rollup(returnDay).returns;
+  }
+
+  // Открытые выдачи, просроченные на день today. Цена - число дней
+  // возврата между прошлым и этим вызовом; обычно today не меняется.
+  uint32_t overdueLoans(int32_t today) {
+    if (today != overdueDay) moveOverdueDay(today);
+    return overdueCount;
+  }
+
+  // Кандидатов даёт Space-Saving, их счёт уточняется по count-min:
+  // обе оценки завышены, поэтому берётся меньшая
+  std::vector<HeavyHitter> mostBorrowed(size_t k) const {
+    std::vector<HeavyHitter> candidates = topBooks.top(kTopCandidates);
+    for (HeavyHitter& hit : candidates) {
+      uint32_t estimate = bookLoans.estimate(hit.item);
+      if (estimate < hit.count) {
+        hit.error -= std::min(hit.error, hit.count - estimate);
+        hit.count = estimate;
+      }
+    }
+    k = std::min(k, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + k,
+                      candidates.end(),
+                      [](const HeavyHitter& a, const HeavyHitter& b) {
+                        if (a.count != b.count) return a.count > b.count;
+                        return a.item < b.item;
+                      });
+    candidates.resize(k);
+    return candidates;
+  }
+
+  // Оценка сверху числа выдач книги за всё время
+  uint32_t estimateLoans(uint32_t book) const {
+    return bookLoans.estimate(book);
+  }
+
+  const std::unordered_map<std::string, GenreStats>& genreStats() const {
+    return genres;
+  }
+
+  const UserTypeStats& userTypeStats(UserType type) const {
+    return userTypes[static_cast<int>(type)];
+  }
+
+  // Сводка за день; нули, если день старше kRollupDays
+  DayRollup dayRollup(int32_t day) const {
+    const DayRollup& slot =
+        rollups[((day % kRollupDays) + kRollupDays) % kRollupDays];
+    return slot.day == day ? slot : DayRollup{day, 0, 0};
+  }
+};
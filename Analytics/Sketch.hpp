@@ -0,0 +1,153 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Count-min: приблизительные частоты по фиксированной памяти.
+// Оценка никогда не меньше настоящей частоты и превышает её не более чем
+// на 2N / width с вероятностью 1 - 2^-depth (N - сумма всех добавлений).
+class CountMinSketch {
+ private:
+  static const int kDepth = 4;
+
+  uint32_t width;
+  std::vector<uint32_t> table;
+
+  uint32_t cell(int row, uint32_t item) const {
+    static const uint64_t seeds[kDepth] = {
+        0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull,
+        0xD6E8FEB86659FD93ull};
+    uint64_t h = (item + 1) * seeds[row];
+    h ^= h >> 29;
+    return static_cast<uint32_t>(row) * width +
+           static_cast<uint32_t>(h % width);
+  }
+
+ public:
+  explicit CountMinSketch(uint32_t width = 2048)
+      : width(width), table(static_cast<size_t>(kDepth) * width, 0) {}
+
+  void add(uint32_t item, uint32_t count = 1) {
+    for (int row = 0; row < kDepth; ++row) table[cell(row, item)] += count;
+  }
+
+  uint32_t estimate(uint32_t item) const {
+    uint32_t best = UINT32_MAX;
+    for (int row = 0; row < kDepth; ++row) {
+      best = std::min(best, table[cell(row, item)]);
+    }
+    return best;
+  }
+
+  size_t memoryUsage() const {
+    return sizeof(*this) + table.capacity() * sizeof(uint32_t);
+  }
+};
+
+struct HeavyHitter {
+  uint32_t item;
+  uint32_t count;
+  // Насколько count может быть завышен
+  uint32_t error;
+};
+
+// Space-Saving: capacity счётчиков, в которых гарантированно есть каждый
+// элемент с частотой больше N / capacity. Новый элемент при заполненной
+// таблице вытесняет самый редкий и наследует его счёт как погрешность.
+// Счётчики лежат min-кучей по count, так что самый редкий - в корне, и
+// add стоит O(log capacity).
+class SpaceSaving {
+ private:
+  size_t capacity;
+  std::vector<HeavyHitter> counters;
+  // Элемент -> его место в куче counters
+  std::unordered_map<uint32_t, size_t> slots;
+
+  void place(size_t i, const HeavyHitter& counter) {
+    counters[i] = counter;
+    slots[counter.item] = i;
+  }
+
+  void siftUp(size_t i) {
+    HeavyHitter counter = counters[i];
+    while (i > 0) {
+      size_t parent = (i - 1) / 2;
+      if (counters[parent].count <= counter.count) break;
+      place(i, counters[parent]);
+      i = parent;
+    }
+    place(i, counter);
+  }
+
+  void siftDown(size_t i) {
+    HeavyHitter counter = counters[i];
+    size_t size = counters.size();
+    while (2 * i + 1 < size) {
+      size_t child = 2 * i + 1;
+      if (child + 1 < size &&
+          counters[child + 1].count < counters[child].count) {
+        ++child;
+      }
+      if (counter.count <= counters[child].count) break;
+      place(i, counters[child]);
+      i = child;
+    }
+    place(i, counter);
+  }
+
+ public:
+  explicit SpaceSaving(size_t capacity = 64) : capacity(capacity) {}
+
+  void add(uint32_t item) {
+    auto it = slots.find(item);
+    if (it != slots.end()) {
+      size_t slot = it->second;
+      ++counters[slot].count;
+      siftDown(slot);
+      return;
+    }
+    if (counters.size() < capacity) {
+      counters.push_back({item, 1, 0});
+      siftUp(counters.size() - 1);
+      return;
+    }
+    if (counters.empty()) return;
+
+    HeavyHitter& weakest = counters[0];
+    slots.erase(weakest.item);
+    weakest.error = weakest.count;
+    weakest.item = item;
+    ++weakest.count;
+    siftDown(0);
+  }
+
+  // Элемент больше не нужен в выдаче (например, книгу удалили)
+  void forget(uint32_t item) {
+    auto it = slots.find(item);
+    if (it == slots.end()) return;
+
+    size_t slot = it->second;
+    slots.erase(it);
+    HeavyHitter last = counters.back();
+    counters.pop_back();
+    if (slot == counters.size()) return;
+
+    place(slot, last);
+    siftUp(slot);
+    siftDown(slots[last.item]);
+  }
+
+  // До k самых частых элементов по убыванию счёта
+  std::vector<HeavyHitter> top(size_t k) const {
+    std::vector<HeavyHitter> result = counters;
+    k = std::min(k, result.size());
+    std::partial_sort(result.begin(), result.begin() + k, result.end(),
+                      [](const HeavyHitter& a, const HeavyHitter& b) {
+                        if (a.count != b.count) return a.count > b.count;
+                        return a.item < b.item;
+                      });
+    result.resize(k);
+    return result;
+  }
+};
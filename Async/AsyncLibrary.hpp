@@ -0,0 +1,118 @@
+#pragma once
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "../Library.hpp"
+#include "Executor.hpp"
+#include "Task.hpp"
+
+// Асинхронный фасад над LibraryOperations (Library или ShardedLibrary):
+//
+//   bool ok = co_await lib.borrowBookAsync(userId, isbn);
+//
+// Операция выполняется на исполнителе executor, ждущая корутина
+// продолжается там же. Аргументы копируются в кадр корутины: ленивая
+// задача может стартовать позже, чем живут строки вызывающего.
+// Library не потокобезопасна: с исполнителем на пуле её вызовы
+// сериализуются (threadSafe = false), ShardedLibrary сериализует сама.
+// Сборка требует C++20 (-std=c++20).
+class AsyncLibrary {
+ private:
+  LibraryOperations& library;
+  Executor& executor;
+  std::mutex* serial;
+
+  template <typename Fn>
+  auto run(Fn operation) -> Task<decltype(operation())> {
+    co_await executor.schedule();
+    if (serial == nullptr) co_return operation();
+
+    std::lock_guard<std::mutex> lock(*serial);
+    co_return operation();
+  }
+
+ public:
+  AsyncLibrary(LibraryOperations& library, Executor& executor,
+               bool threadSafe = false)
+      : library(library),
+        executor(executor),
+        serial(threadSafe ? nullptr : new std::mutex()) {}
+
+  ~AsyncLibrary() { delete serial; }
+
+  AsyncLibrary(const AsyncLibrary&) = delete;
+  AsyncLibrary& operator=(const AsyncLibrary&) = delete;
+
+  Task<bool> addBookAsync(std::string title, std::string author,
+                          std::string isbn, std::string genre) {
+    return run([this, title = std::move(title), author = std::move(author),
+                isbn = std::move(isbn), genre = std::move(genre)]() {
+      return library.addBook(title, author, isbn, genre);
+    });
+  }
+
+  Task<bool> removeBookAsync(std::string isbn) {
+    return run([this, isbn = std::move(isbn)]() {
+      return library.removeBook(isbn);
+    });
+  }
+
+  Task<std::optional<Book>> getBookAsync(std::string isbn) {
+    return run([this, isbn = std::move(isbn)]() {
+      return library.getBook(isbn);
+    });
+  }
+
+  Task<SearchResults*> searchBooksAsync(std::string query) {
+    return run([this, query = std::move(query)]() {
+      return library.searchBooks(query);
+    });
+  }
+
+  Task<SearchResults*> searchBooksAsync(std::string query, int k) {
+    return run([this, query = std::move(query), k]() {
+      return library.searchBooks(query, k);
+    });
+  }
+
+  Task<bool> registerUserAsync(std::string name, std::string userId,
+                               std::string email, UserType type) {
+    return run([this, name = std::move(name), userId = std::move(userId),
+                email = std::move(email), type]() {
+      return library.registerUser(name, userId, email, type);
+    });
+  }
+
+  Task<bool> removeUserAsync(std::string userId) {
+    return run([this, userId = std::move(userId)]() {
+      return library.removeUser(userId);
+    });
+  }
+
+  Task<std::optional<LibraryUser>> getUserAsync(std::string userId) {
+    return run([this, userId = std::move(userId)]() {
+      return library.getUser(userId);
+    });
+  }
+
+  Task<bool> borrowBookAsync(std::string userId, std::string isbn) {
+    return run([this, userId = std::move(userId), isbn = std::move(isbn)]() {
+      return library.borrowBook(userId, isbn);
+    });
+  }
+
+  Task<bool> returnBookAsync(std::string userId, std::string isbn) {
+    return run([this, userId = std::move(userId), isbn = std::move(isbn)]() {
+      return library.returnBook(userId, isbn);
+    });
+  }
+
+  Task<Sequence<BorrowingRecord>*> getOverdueBooksAsync() {
+    return run([this]() { return library.getOverdueBooks(); });
+  }
+
+  // Синхронная библиотека под фасадом, для операций без async-версии
+  LibraryOperations& getLibrary() { return library; }
+};
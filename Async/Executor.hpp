@@ -0,0 +1,59 @@
+#pragma once
+#include <coroutine>
+
+#include "../Concurrency/ThreadPool.hpp"
+#include "Task.hpp"
+
+// Где продолжается корутина после co_await executor.schedule()
+class Executor {
+ public:
+  struct ScheduleAwaiter {
+    Executor* executor;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      executor->execute(handle);
+    }
+    void await_resume() const noexcept {}
+  };
+
+  virtual ~Executor() {}
+
+  virtual void execute(std::coroutine_handle<> handle) = 0;
+
+  ScheduleAwaiter schedule() { return ScheduleAwaiter{this}; }
+};
+
+// Продолжает корутину сразу, в том же потоке: асинхронный API поверх
+// синхронного кода без переключений
+class InlineExecutor : public Executor {
+ public:
+  void execute(std::coroutine_handle<> handle) override { handle.resume(); }
+};
+
+// Продолжает корутину в потоке пула. Вызывающий поток не блокируется:
+// тысячи операций ждут своей очереди как кадры корутин, а не как потоки.
+class ThreadPoolExecutor : public Executor {
+ private:
+  ThreadPool* pool;
+  bool ownsPool;
+
+ public:
+  // threads == 0 - по числу ядер
+  explicit ThreadPoolExecutor(size_t threads = 0)
+      : pool(new ThreadPool(threads)), ownsPool(true) {}
+
+  // Чужой пул; не удаляется
+  explicit ThreadPoolExecutor(ThreadPool* pool) : pool(pool), ownsPool(false) {}
+
+  ~ThreadPoolExecutor() {
+    if (ownsPool) delete pool;
+  }
+
+  ThreadPoolExecutor(const ThreadPoolExecutor&) = delete;
+  ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+
+  void execute(std::coroutine_handle<> handle) override {
+    pool->post([handle]() { handle.resume(); });
+  }
+};
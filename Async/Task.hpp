@@ -0,0 +1,283 @@
+#pragma once
+#if !defined(__cpp_impl_coroutine)
+#error "Async/Task.hpp requires C++20 coroutines (-std=c++20)"
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Ленивая задача-корутина: начинает работу, когда её ждут через
+// co_await, и по завершении сразу продолжает ждущего (симметричная
+// передача управления, без роста стека). Поток, в котором задача
+// продолжится, выбирает исполнитель (см. Executor.hpp).
+template <typename T>
+class Task;
+
+class TaskPromiseBase {
+ public:
+  std::coroutine_handle<> continuation = std::noop_coroutine();
+  std::exception_ptr error;
+
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> handle) noexcept {
+      return handle.promise().continuation;
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  FinalAwaiter final_suspend() noexcept { return {}; }
+  void unhandled_exception() { error = std::current_exception(); }
+};
+
+// Общая часть Task<T> и Task<void>: владение кадром и co_await
+template <typename Promise>
+class TaskBase {
+ protected:
+  std::coroutine_handle<Promise> handle;
+
+  explicit TaskBase(std::coroutine_handle<Promise> handle) : handle(handle) {}
+
+  void rethrow() const {
+    if (handle.promise().error) {
+      std::rethrow_exception(handle.promise().error);
+    }
+  }
+
+ public:
+  TaskBase(TaskBase&& other) noexcept
+      : handle(std::exchange(other.handle, nullptr)) {}
+
+  TaskBase& operator=(TaskBase&& other) noexcept {
+    if (this != &other) {
+      if (handle) handle.destroy();
+      handle = std::exchange(other.handle, nullptr);
+    }
+    return *this;
+  }
+
+  ~TaskBase() {
+    if (handle) handle.destroy();
+  }
+
+  TaskBase(const TaskBase&) = delete;
+  TaskBase& operator=(const TaskBase&) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<> awaiting) noexcept {
+    handle.promise().continuation = awaiting;
+    return handle;
+  }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+  std::optional<T> value;
+
+  Task<T> get_return_object();
+  void return_value(T result) { value.emplace(std::move(result)); }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+  Task<void> get_return_object();
+  void return_void() {}
+};
+
+template <typename T>
+class Task : public TaskBase<TaskPromise<T>> {
+ public:
+  using promise_type = TaskPromise<T>;
+
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : TaskBase<promise_type>(handle) {}
+
+  T await_resume() {
+    this->rethrow();
+    return std::move(*this->handle.promise().value);
+  }
+};
+
+template <>
+class Task<void> : public TaskBase<TaskPromise<void>> {
+ public:
+  using promise_type = TaskPromise<void>;
+
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : TaskBase<promise_type>(handle) {}
+
+  void await_resume() { rethrow(); }
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(
+      std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Корутина, которая стартует сразу и сама освобождает кадр по завершении.
+// Только для внутренних нужд whenAll и syncWait: ошибки ловятся внутри.
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// Счётчик незавершённых задач whenAll. Ждущая корутина тоже считается:
+// кто последним уменьшит счётчик до нуля, тот её и продолжает.
+class WhenAllLatch {
+ private:
+  std::atomic<size_t> remaining;
+  std::coroutine_handle<> awaiting;
+
+ public:
+  std::exception_ptr error;
+  std::atomic<bool> failed;
+
+  explicit WhenAllLatch(size_t tasks) : remaining(tasks + 1), failed(false) {}
+
+  void arrive() {
+    if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      awaiting.resume();
+    }
+  }
+
+  void fail(std::exception_ptr exception) {
+    if (!failed.exchange(true, std::memory_order_acq_rel)) error = exception;
+  }
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle) noexcept {
+    awaiting = handle;
+    return remaining.fetch_sub(1, std::memory_order_acq_rel) != 1;
+  }
+
+  void await_resume() const {
+    if (error) std::rethrow_exception(error);
+  }
+};
+
+template <typename T>
+DetachedTask runForWhenAll(Task<T>& task, std::optional<T>& slot,
+                           WhenAllLatch& latch) {
+  try {
+    slot.emplace(co_await task);
+  } catch (...) {
+    latch.fail(std::current_exception());
+  }
+  latch.arrive();
+}
+
+inline DetachedTask runForWhenAll(Task<void>& task, WhenAllLatch& latch) {
+  try {
+    co_await task;
+  } catch (...) {
+    latch.fail(std::current_exception());
+  }
+  latch.arrive();
+}
+
+// Запустить все задачи сразу и дождаться всех. Результаты - в порядке
+// задач; первая ошибка пробрасывается после завершения остальных.
+// Задачи идут параллельно настолько, насколько позволяют их исполнители.
+template <typename T>
+Task<std::vector<T>> whenAll(std::vector<Task<T>> tasks) {
+  std::vector<std::optional<T>> slots(tasks.size());
+  WhenAllLatch latch(tasks.size());
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    runForWhenAll(tasks[i], slots[i], latch);
+  }
+  co_await latch;
+
+  std::vector<T> results;
+  results.reserve(slots.size());
+  for (std::optional<T>& slot : slots) results.push_back(std::move(*slot));
+  co_return results;
+}
+
+inline Task<void> whenAll(std::vector<Task<void>> tasks) {
+  WhenAllLatch latch(tasks.size());
+  for (Task<void>& task : tasks) runForWhenAll(task, latch);
+  co_await latch;
+}
+
+// Итог задачи для syncWait. Сигнал подаётся под мьютексом, поэтому после
+// пробуждения ждущего корутина состояние уже не трогает.
+template <typename T>
+struct SyncWaitState {
+  std::mutex mutex;
+  std::condition_variable ready;
+  bool finished = false;
+  std::optional<T> value;
+  std::exception_ptr error;
+
+  void finish(std::optional<T> result, std::exception_ptr exception) {
+    std::lock_guard<std::mutex> lock(mutex);
+    value = std::move(result);
+    error = exception;
+    finished = true;
+    ready.notify_one();
+  }
+};
+
+struct SyncWaitVoid {};
+
+template <typename T>
+DetachedTask runForSyncWait(Task<T>& task, SyncWaitState<T>& state) {
+  std::optional<T> result;
+  std::exception_ptr error;
+  try {
+    result.emplace(co_await task);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  state.finish(std::move(result), error);
+}
+
+inline DetachedTask runForSyncWait(Task<void>& task,
+                                   SyncWaitState<SyncWaitVoid>& state) {
+  std::exception_ptr error;
+  try {
+    co_await task;
+  } catch (...) {
+    error = std::current_exception();
+  }
+  state.finish(SyncWaitVoid(), error);
+}
+
+// Выполнить задачу и заблокировать поток до её завершения. Для границы
+// между синхронным и асинхронным кодом (main, тесты), не для корутин.
+template <typename T>
+T syncWait(Task<T> task) {
+  using Stored = std::conditional_t<std::is_void_v<T>, SyncWaitVoid, T>;
+  SyncWaitState<Stored> state;
+  runForSyncWait(task, state);
+
+  std::unique_lock<std::mutex> lock(state.mutex);
+  state.ready.wait(lock, [&]() { return state.finished; });
+  if (state.error) std::rethrow_exception(state.error);
+  if constexpr (!std::is_void_v<T>) return std::move(*state.value);
+}
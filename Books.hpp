@@ -30,10 +30,10 @@ class Book {
         isbn(isbn),
         available(isAvailable) {}
 
-  std::string getTitle() const { return title; }
-  std::string getAuthor() const { return author; }
-  std::string getGenre() const { return genre; }
-  std::string getISBN() const { return isbn; }
+  const std::string& getTitle() const { return title; }
+  const std::string& getAuthor() const { return author; }
+  const std::string& getGenre() const { return genre; }
+  const std::string& getISBN() const { return isbn; }
 
   bool isAvailable() const { return available; }
 
@@ -0,0 +1,748 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Concurrency/Versioned.hpp"
+#include "Diagnostics/MemoryAccounting.hpp"
+
+// Запись о выдаче, 16 байт: читатель и книга - номера в библиотеке
+// (строки получаются через Library::getRecordUserId/getRecordBookId),
+// дата выдачи - номер дня (см. Dates.hpp), срок - в днях.
+class BorrowingRecord {
+ private:
+  static const uint16_t kReturned = 1;
+
+  uint32_t userHandle;
+  uint32_t bookKey;
+  int32_t borrowDay;
+  uint16_t loanDays;
+  uint16_t flags;
+
+ public:
+  BorrowingRecord()
+      : userHandle(0), bookKey(0), borrowDay(0), loanDays(0), flags(0) {}
+
+  BorrowingRecord(uint32_t userHandle, uint32_t bookKey, int32_t borrowDay,
+                  int borrowDays = 14)
+      : userHandle(userHandle),
+        bookKey(bookKey),
+        borrowDay(borrowDay),
+        loanDays(static_cast<uint16_t>(borrowDays)),
+        flags(0) {}
+
+  ~BorrowingRecord() = default;
+
+  uint32_t getUserHandle() const { return userHandle; }
+  uint32_t getBookKey() const { return bookKey; }
+
+  int32_t getBorrowDay() const { return borrowDay; }
+  int32_t getDueDay() const { return borrowDay + loanDays; }
+  int getLoanDays() const { return loanDays; }
+
+  bool isReturned() const { return flags & kReturned; }
+  void markReturned() { flags |= kReturned; }
+
+  bool isOverdue(int32_t today) const {
+    return !isReturned() && today > getDueDay();
+  }
+
+  int getDaysOverdue(int32_t today) const {
+    if (!isOverdue(today)) return 0;
+
+    return today - getDueDay();
+  }
+};
+
+static_assert(sizeof(BorrowingRecord) == 16,
+              "BorrowingRecord is expected to stay packed");
+static_assert(std::is_trivially_copyable<BorrowingRecord>::value,
+              "BorrowingRecord is exported as raw bytes");
+
+// Запись вторичного индекса: выдачи одного читателя или одной книги,
+// упорядоченные по дню выдачи
+struct HistoryEntry {
+  int32_t borrowDay;
+  uint32_t recordId;
+};
+
+enum class HistoryKey { USER, BOOK };
+
+// Запечатанный кусок истории: возвращённые выдачи одного периода,
+// разложенные по колонкам, упакованным по битам. Номера записей и дни
+// хранятся разностями с предыдущей записью, блоками по kBlock записей:
+// у блока свои наименьшая разность и ширина. Читатель, книга и срок -
+// номер в словаре сегмента (различные значения по возрастанию) или, если
+// так короче, значение за вычетом наименьшего; ширина у колонки одна.
+// Запись находится по номеру распаковкой разностей одного блока, без
+// чтения остальных записей.
+class HistorySegment {
+ public:
+  // Больше записей в сегменте не бывает (см. BorrowHistory::seal): запись
+  // занимает меньше 256 бит, так что смещения помещаются в uint32_t
+  static constexpr uint32_t kMaxRecords = 1u << 22;
+
+ private:
+  static constexpr uint32_t kBlock = 64;
+
+  // Колонка одинаковой ширины: value(i) = base + поле i, а со словарём
+  // поле i - номер в словаре, и value(i) = base + словарь[номер]
+  struct PackedColumn {
+    uint32_t base;
+    uint32_t start;
+    uint32_t dictionaryStart;
+    uint8_t width;
+    uint8_t dictionaryWidth;
+    bool dictionary;
+  };
+
+  enum Column { USER, BOOK, LOAN, kColumns };
+
+  // Блок kBlock записей: номер первой и где начинается его заголовок.
+  // Заголовок: первый день, наименьшая разность номеров и дней и их
+  // ширины; дальше разности номеров, потом разности дней.
+  struct Block {
+    uint32_t firstId;
+    uint32_t offset;
+  };
+
+  // Состояние разбора блока
+  struct BlockState {
+    int32_t firstDay;
+    uint32_t idMin;
+    uint32_t dayMin;
+    uint8_t idWidth;
+    uint8_t dayWidth;
+    // Начало разностей номеров и дней
+    uint32_t ids;
+    uint32_t days;
+  };
+
+  int32_t firstDay;
+  int32_t lastDay;
+  uint32_t minId;
+  uint32_t maxId;
+  uint32_t count;
+  PackedColumn columns[kColumns];
+  HistoryVector<Block> blocks;
+  HistoryVector<uint64_t> bits;
+
+  static uint8_t bitWidth(uint32_t value) {
+    uint8_t width = 0;
+    while (width < 32 && (value >> width) != 0) ++width;
+    return width;
+  }
+
+  static uint32_t zigzag(int32_t value) {
+    return (static_cast<uint32_t>(value) << 1) ^
+           static_cast<uint32_t>(value >> 31);
+  }
+
+  static int32_t unzigzag(uint32_t value) {
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+  }
+
+  // Дописывает width младших бит value; used - сколько бит уже занято
+  static void put(HistoryVector<uint64_t>& out, uint64_t& used,
+                  uint32_t value, uint8_t width) {
+    if (width == 0) return;
+    uint32_t shift = static_cast<uint32_t>(used % 64);
+    if (shift == 0) out.push_back(0);
+    out.back() |= static_cast<uint64_t>(value) << shift;
+    if (shift + width > 64) {
+      out.push_back(static_cast<uint64_t>(value) >> (64 - shift));
+    }
+    used += width;
+  }
+
+  // Значение произвольной величины: ширина (6 бит), потом само значение
+  static void putSized(HistoryVector<uint64_t>& out, uint64_t& used,
+                       uint32_t value) {
+    uint8_t width = bitWidth(value);
+    put(out, used, width, 6);
+    put(out, used, value, width);
+  }
+
+  uint32_t get(uint64_t offset, uint8_t width) const {
+    if (width == 0) return 0;
+    size_t word = static_cast<size_t>(offset / 64);
+    uint32_t shift = static_cast<uint32_t>(offset % 64);
+    uint64_t value = bits[word] >> shift;
+    if (shift + width > 64) value |= bits[word + 1] << (64 - shift);
+    return static_cast<uint32_t>(value & ((uint64_t(1) << width) - 1));
+  }
+
+  uint32_t getSized(uint32_t& offset) const {
+    uint8_t width = static_cast<uint8_t>(get(offset, 6));
+    uint32_t value = get(offset + 6, width);
+    offset += 6 + width;
+    return value;
+  }
+
+  uint32_t columnValue(Column c, uint32_t position) const {
+    const PackedColumn& column = columns[c];
+    uint32_t field =
+        get(column.start + static_cast<uint64_t>(position) * column.width,
+            column.width);
+    if (column.dictionary) {
+      field = get(column.dictionaryStart +
+                      static_cast<uint64_t>(field) * column.dictionaryWidth,
+                  column.dictionaryWidth);
+    }
+    return column.base + field;
+  }
+
+  // Колонка values: словарь, если он с номерами короче значений подряд
+  static PackedColumn pack(HistoryVector<uint64_t>& out, uint64_t& used,
+                           const HistoryVector<uint32_t>& values) {
+    HistoryVector<uint32_t> distinct(values);
+    std::sort(distinct.begin(), distinct.end());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()),
+                   distinct.end());
+
+    PackedColumn column;
+    column.base = distinct.front();
+    uint8_t valueWidth = bitWidth(distinct.back() - column.base);
+    uint8_t codeWidth = bitWidth(static_cast<uint32_t>(distinct.size() - 1));
+    column.dictionary = distinct.size() * valueWidth +
+                            values.size() * codeWidth <
+                        values.size() * valueWidth;
+    column.dictionaryWidth = column.dictionary ? valueWidth : 0;
+    column.width = column.dictionary ? codeWidth : valueWidth;
+
+    column.dictionaryStart = static_cast<uint32_t>(used);
+    if (column.dictionary) {
+      for (uint32_t value : distinct) {
+        put(out, used, value - column.base, valueWidth);
+      }
+    }
+    column.start = static_cast<uint32_t>(used);
+    for (uint32_t value : values) {
+      uint32_t field =
+          column.dictionary
+              ? static_cast<uint32_t>(std::lower_bound(distinct.begin(),
+                                                       distinct.end(), value) -
+                                      distinct.begin())
+              : value - column.base;
+      put(out, used, field, column.width);
+    }
+    return column;
+  }
+
+  BlockState openBlock(size_t block) const {
+    BlockState state;
+    uint32_t offset = blocks[block].offset;
+    state.firstDay = unzigzag(getSized(offset));
+    state.idMin = getSized(offset);
+    state.idWidth = static_cast<uint8_t>(get(offset, 6));
+    offset += 6;
+    state.dayMin = getSized(offset);
+    state.dayWidth = static_cast<uint8_t>(get(offset, 6));
+    offset += 6;
+    state.ids = offset;
+    state.days = offset + (blockSize(block) - 1) * state.idWidth;
+    return state;
+  }
+
+  uint32_t blockSize(size_t block) const {
+    return std::min(kBlock, count - static_cast<uint32_t>(block) * kBlock);
+  }
+
+  BorrowingRecord recordAt(uint32_t position, int32_t day) const {
+    BorrowingRecord record(columnValue(USER, position),
+                           columnValue(BOOK, position), day,
+                           static_cast<int>(columnValue(LOAN, position)));
+    record.markReturned();
+    return record;
+  }
+
+ public:
+  // Последовательное чтение записей сегмента
+  class Reader {
+   private:
+    const HistorySegment* segment;
+    uint32_t position;
+    BlockState block;
+
+   public:
+    uint32_t id;
+    int32_t day;
+
+    Reader() : segment(nullptr), position(0), block(), id(0), day(0) {}
+    explicit Reader(const HistorySegment* segment)
+        : segment(segment), position(0), block(), id(0), day(0) {}
+
+    void read(BorrowingRecord& record) {
+      uint32_t i = position % kBlock;
+      if (i == 0) {
+        block = segment->openBlock(position / kBlock);
+        id = segment->blocks[position / kBlock].firstId;
+        day = block.firstDay;
+      } else {
+        id += block.idMin + segment->get(block.ids + (i - 1) * block.idWidth,
+                                         block.idWidth);
+        day += unzigzag(block.dayMin +
+                        segment->get(block.days + (i - 1) * block.dayWidth,
+                                     block.dayWidth));
+      }
+      record = segment->recordAt(position++, day);
+    }
+  };
+
+  // records и ids - count записей в порядке возрастания номеров
+  HistorySegment(const BorrowingRecord* records, const uint32_t* ids,
+                 uint32_t count)
+      : firstDay(0), lastDay(0), minId(ids[0]), maxId(ids[count - 1]),
+        count(count) {
+    uint64_t used = 0;
+    for (uint32_t first = 0; first < count; first += kBlock) {
+      uint32_t size = std::min(kBlock, count - first);
+      uint32_t idMin = UINT32_MAX, idMax = 0, dayMin = UINT32_MAX, dayMax = 0;
+      for (uint32_t i = first + 1; i < first + size; ++i) {
+        uint32_t idDelta = ids[i] - ids[i - 1];
+        uint32_t dayDelta = zigzag(records[i].getBorrowDay() -
+                                   records[i - 1].getBorrowDay());
+        idMin = std::min(idMin, idDelta);
+        idMax = std::max(idMax, idDelta);
+        dayMin = std::min(dayMin, dayDelta);
+        dayMax = std::max(dayMax, dayDelta);
+      }
+      if (size == 1) idMin = idMax = dayMin = dayMax = 0;
+      uint8_t idWidth = bitWidth(idMax - idMin);
+      uint8_t dayWidth = bitWidth(dayMax - dayMin);
+
+      blocks.push_back({ids[first], static_cast<uint32_t>(used)});
+      putSized(bits, used, zigzag(records[first].getBorrowDay()));
+      putSized(bits, used, idMin);
+      put(bits, used, idWidth, 6);
+      putSized(bits, used, dayMin);
+      put(bits, used, dayWidth, 6);
+      for (uint32_t i = first + 1; i < first + size; ++i) {
+        put(bits, used, ids[i] - ids[i - 1] - idMin, idWidth);
+      }
+      for (uint32_t i = first + 1; i < first + size; ++i) {
+        put(bits, used,
+            zigzag(records[i].getBorrowDay() - records[i - 1].getBorrowDay()) -
+                dayMin,
+            dayWidth);
+      }
+    }
+
+    HistoryVector<uint32_t> values(count);
+    for (int c = 0; c < kColumns; ++c) {
+      for (uint32_t i = 0; i < count; ++i) {
+        const BorrowingRecord& record = records[i];
+        values[i] = c == USER   ? record.getUserHandle()
+                    : c == BOOK ? record.getBookKey()
+                                : static_cast<uint32_t>(record.getLoanDays());
+      }
+      columns[c] = pack(bits, used, values);
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+      int32_t day = records[i].getBorrowDay();
+      if (i == 0 || day < firstDay) firstDay = day;
+      if (i == 0 || day > lastDay) lastDay = day;
+    }
+    bits.shrink_to_fit();
+    blocks.shrink_to_fit();
+  }
+
+  uint32_t size() const { return count; }
+  int32_t getFirstDay() const { return firstDay; }
+  int32_t getLastDay() const { return lastDay; }
+  uint32_t getMinId() const { return minId; }
+  uint32_t getMaxId() const { return maxId; }
+
+  Reader reader() const { return Reader(this); }
+
+  bool find(uint32_t id, BorrowingRecord& record) const {
+    if (id < minId || id > maxId) return false;
+
+    auto it = std::upper_bound(
+        blocks.begin(), blocks.end(), id,
+        [](uint32_t value, const Block& b) { return value < b.firstId; });
+    size_t block = static_cast<size_t>(it - blocks.begin()) - 1;
+    BlockState state = openBlock(block);
+    uint32_t size = blockSize(block);
+    uint32_t current = blocks[block].firstId;
+    int32_t day = state.firstDay;
+    for (uint32_t i = 0;; ++i) {
+      if (current == id) {
+        record = recordAt(static_cast<uint32_t>(block) * kBlock + i, day);
+        return true;
+      }
+      if (current > id || i + 1 == size) return false;
+
+      current +=
+          state.idMin + get(state.ids + i * state.idWidth, state.idWidth);
+      day += unzigzag(state.dayMin +
+                      get(state.days + i * state.dayWidth, state.dayWidth));
+    }
+  }
+
+  size_t memoryUsage() const {
+    return sizeof(*this) + bits.capacity() * sizeof(uint64_t) +
+           blocks.capacity() * sizeof(Block);
+  }
+};
+
+// Ярусы истории. Копия дешёвая: запечатанные сегменты неизменяемы и
+// общие, страницы горячего яруса копируются только при изменении (см.
+// Concurrency/Versioned.hpp). Так снимки библиотеки держат историю.
+struct HistoryTiers {
+  HistoryVector<std::shared_ptr<const HistorySegment>> segments;
+  VersionedVector<BorrowingRecord, MemoryTag::HISTORY> hotRecords;
+  // По возрастанию: печать сохраняет порядок, новые номера больше старых
+  VersionedVector<uint32_t, MemoryTag::HISTORY> hotIds;
+};
+
+// Потоковый обход истории: сначала запечатанные сегменты (по одной
+// записи распаковываются на лету), затем горячие записи. Становится
+// недействительным после любого изменения истории (обход копии ярусов -
+// после изменения копии). Курсор по shared_ptr сам держит свои ярусы.
+class HistoryCursor {
+ private:
+  std::shared_ptr<const HistoryTiers> owned;
+  const HistoryTiers* tiers;
+  size_t segment;
+  uint32_t inSegment;
+  HistorySegment::Reader reader;
+  size_t hot;
+
+  void openSegment();
+
+ public:
+  explicit HistoryCursor(const HistoryTiers* tiers);
+  explicit HistoryCursor(std::shared_ptr<const HistoryTiers> tiers);
+
+  // false, когда записи кончились
+  bool next(BorrowingRecord& record, uint32_t* id = nullptr);
+};
+
+// История выдач в два яруса. Горячий - массив страницами: все открытые
+// выдачи и недавно закрытые. Возвращённые выдачи старше coldAfterDays
+// время от времени запечатываются в сжатые сегменты, по сегменту на
+// kPartitionDays дней. Номер записи (id) - порядковый номер выдачи.
+// Для каждого читателя и каждой книги ведётся список их выдач по дате.
+// Память считается за MemoryTag::HISTORY.
+class BorrowHistory {
+ public:
+  static const int kPartitionDays = 30;
+
+ private:
+  static constexpr size_t kMinSealCheck = 4096;
+
+  HistoryTiers tiers;
+  uint32_t nextId;
+  size_t coldCount;
+  int coldAfterDays;
+  // Размер горячего яруса, при котором в следующий раз пробуем запечатать
+  size_t sealCheck;
+
+  // Сегменты по возрастанию minId для поиска записи по номеру.
+  // Диапазоны номеров сегментов могут пересекаться (выдачу, взятую
+  // давно и возвращённую поздно, запечатывают позже), поэтому хранится
+  // ещё наибольший maxId среди этого и всех предыдущих.
+  struct SegmentSpan {
+    uint32_t minId;
+    uint32_t maxIdSoFar;
+    uint32_t segment;
+  };
+  HistoryVector<SegmentSpan> spans;
+
+  // Индексы по номеру читателя и номеру книги
+  HistoryVector<HistoryVector<HistoryEntry>> byUser;
+  HistoryVector<HistoryVector<HistoryEntry>> byBook;
+  // (читатель, книга) -> номер открытой выдачи
+  TaggedMap<uint64_t, uint32_t, MemoryTag::HISTORY> openLoans;
+
+  static uint64_t loanKey(uint32_t userHandle, uint32_t bookKey) {
+    return static_cast<uint64_t>(userHandle) << 32 | bookKey;
+  }
+
+  static void addEntry(HistoryVector<HistoryVector<HistoryEntry>>& index,
+                       uint32_t key, const HistoryEntry& entry) {
+    if (key >= index.size()) index.resize(key + 1);
+    HistoryVector<HistoryEntry>& entries = index[key];
+    // Обычно день не убывает и запись просто дописывается в конец
+    auto it = entries.end();
+    while (it != entries.begin() && (it - 1)->borrowDay > entry.borrowDay) {
+      --it;
+    }
+    entries.insert(it, entry);
+  }
+
+  const HistoryVector<HistoryEntry>* entries(HistoryKey by,
+                                             uint32_t key) const {
+    const auto& index = by == HistoryKey::USER ? byUser : byBook;
+    return key < index.size() ? &index[key] : nullptr;
+  }
+
+  // Записи индекса с днём выдачи в [fromDay, toDay]
+  std::pair<const HistoryEntry*, const HistoryEntry*> range(
+      HistoryKey by, uint32_t key, int32_t fromDay, int32_t toDay) const {
+    const HistoryVector<HistoryEntry>* list = entries(by, key);
+    if (list == nullptr || fromDay > toDay) return {nullptr, nullptr};
+
+    const HistoryEntry* begin = list->data();
+    const HistoryEntry* end = begin + list->size();
+    begin = std::lower_bound(begin, end, fromDay,
+                             [](const HistoryEntry& e, int32_t day) {
+                               return e.borrowDay < day;
+                             });
+    end = std::upper_bound(begin, end, toDay,
+                           [](int32_t day, const HistoryEntry& e) {
+                             return day < e.borrowDay;
+                           });
+    return {begin, end};
+  }
+
+  BorrowingRecord* findHot(uint32_t id) {
+    auto it = std::lower_bound(tiers.hotIds.begin(), tiers.hotIds.end(), id);
+    if (it == tiers.hotIds.end() || *it != id) return nullptr;
+    return &tiers.hotRecords.mutate(it.position());
+  }
+
+ public:
+  explicit BorrowHistory(int coldAfterDays = 90)
+      : nextId(0),
+        coldCount(0),
+        coldAfterDays(coldAfterDays),
+        sealCheck(kMinSealCheck) {}
+
+  uint32_t append(const BorrowingRecord& record, int32_t today) {
+    if (tiers.hotRecords.size() >= sealCheck) {
+      seal(today - coldAfterDays);
+      sealCheck = std::max(kMinSealCheck, tiers.hotRecords.size() * 2);
+    }
+    uint32_t id = nextId++;
+    tiers.hotRecords.push_back(record);
+    tiers.hotIds.push_back(id);
+
+    HistoryEntry entry = {record.getBorrowDay(), id};
+    addEntry(byUser, record.getUserHandle(), entry);
+    addEntry(byBook, record.getBookKey(), entry);
+    if (!record.isReturned()) {
+      openLoans[loanKey(record.getUserHandle(), record.getBookKey())] = id;
+    }
+    return id;
+  }
+
+  // Отметить открытую выдачу книги читателю как возвращённую;
+  // closed - куда скопировать закрытую запись
+  bool close(uint32_t userHandle, uint32_t bookKey,
+             BorrowingRecord* closed = nullptr) {
+    auto it = openLoans.find(loanKey(userHandle, bookKey));
+    if (it == openLoans.end()) return false;
+
+    // Открытая выдача всегда в горячем ярусе
+    BorrowingRecord* record = findHot(it->second);
+    record->markReturned();
+    if (closed != nullptr) *closed = *record;
+    openLoans.erase(it);
+    return true;
+  }
+
+  // Запечатать возвращённые выдачи, взятые раньше дня before
+  void seal(int32_t before) {
+    VersionedVector<BorrowingRecord, MemoryTag::HISTORY> keptRecords;
+    VersionedVector<uint32_t, MemoryTag::HISTORY> keptIds;
+    // Разбивка по периодам; периодов в одном проходе немного
+    HistoryVector<int32_t> partitions;
+    HistoryVector<HistoryVector<BorrowingRecord>> records;
+    HistoryVector<HistoryVector<uint32_t>> ids;
+
+    for (size_t i = 0; i < tiers.hotRecords.size(); ++i) {
+      const BorrowingRecord& record = tiers.hotRecords[i];
+      if (!record.isReturned() || record.getBorrowDay() >= before) {
+        keptRecords.push_back(record);
+        keptIds.push_back(tiers.hotIds[i]);
+        continue;
+      }
+
+      int32_t day = record.getBorrowDay();
+      int32_t partition =
+          (day >= 0 ? day : day - kPartitionDays + 1) / kPartitionDays;
+      size_t p = std::find(partitions.begin(), partitions.end(), partition) -
+                 partitions.begin();
+      if (p == partitions.size()) {
+        partitions.push_back(partition);
+        records.emplace_back();
+        ids.emplace_back();
+      }
+      records[p].push_back(record);
+      ids[p].push_back(tiers.hotIds[i]);
+    }
+    if (partitions.empty()) return;
+
+    HistoryVector<size_t> order(partitions.size());
+    for (size_t p = 0; p < order.size(); ++p) order[p] = p;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return partitions[a] < partitions[b];
+    });
+    for (size_t p : order) {
+      // Очень большой период - несколькими сегментами
+      for (size_t first = 0; first < records[p].size();
+           first += HistorySegment::kMaxRecords) {
+        uint32_t size = static_cast<uint32_t>(std::min<size_t>(
+            HistorySegment::kMaxRecords, records[p].size() - first));
+        tiers.segments.push_back(std::allocate_shared<HistorySegment>(
+            TaggedAllocator<HistorySegment, MemoryTag::HISTORY>(),
+            records[p].data() + first, ids[p].data() + first, size));
+        spans.push_back({tiers.segments.back()->getMinId(), 0,
+                         static_cast<uint32_t>(tiers.segments.size() - 1)});
+      }
+      coldCount += records[p].size();
+    }
+    std::sort(spans.begin(), spans.end(),
+              [](const SegmentSpan& a, const SegmentSpan& b) {
+                return a.minId < b.minId;
+              });
+    uint32_t reach = 0;
+    for (SegmentSpan& span : spans) {
+      reach = std::max(reach, tiers.segments[span.segment]->getMaxId());
+      span.maxIdSoFar = reach;
+    }
+
+    // Страницы прежнего горячего яруса остаются у снимков, что их держат
+    tiers.hotRecords = keptRecords;
+    tiers.hotIds = keptIds;
+  }
+
+  // Запись по номеру, в каком бы ярусе она ни лежала
+  bool find(uint32_t id, BorrowingRecord& record) const {
+    auto it = std::lower_bound(tiers.hotIds.begin(), tiers.hotIds.end(), id);
+    if (it != tiers.hotIds.end() && *it == id) {
+      record = tiers.hotRecords[it.position()];
+      return true;
+    }
+    // Назад от последнего сегмента с minId <= id, пока какой-то из
+    // оставшихся ещё может дотянуться до id
+    auto span = std::upper_bound(
+        spans.begin(), spans.end(), id,
+        [](uint32_t value, const SegmentSpan& s) { return value < s.minId; });
+    while (span != spans.begin()) {
+      --span;
+      if (span->maxIdSoFar < id) break;
+      if (tiers.segments[span->segment]->find(id, record)) return true;
+    }
+    return false;
+  }
+
+  // Сколько выдач у читателя (книги) с днём выдачи в [fromDay, toDay]
+  size_t count(HistoryKey by, uint32_t key, int32_t fromDay,
+               int32_t toDay) const {
+    auto [begin, end] = range(by, key, fromDay, toDay);
+    return static_cast<size_t>(end - begin);
+  }
+
+  // Выдачи читателя (книги) с днём выдачи в [fromDay, toDay] по дате:
+  // пропустить offset, вернуть не больше limit
+  std::vector<BorrowingRecord> query(HistoryKey by, uint32_t key,
+                                     int32_t fromDay, int32_t toDay,
+                                     size_t offset, size_t limit) const {
+    std::vector<BorrowingRecord> records;
+    auto [begin, end] = range(by, key, fromDay, toDay);
+    if (static_cast<size_t>(end - begin) <= offset) return records;
+
+    begin += offset;
+    if (static_cast<size_t>(end - begin) > limit) end = begin + limit;
+    records.reserve(end - begin);
+    BorrowingRecord record;
+    for (const HistoryEntry* entry = begin; entry != end; ++entry) {
+      if (find(entry->recordId, record)) records.push_back(record);
+    }
+    return records;
+  }
+
+  bool isOpen(uint32_t userHandle, uint32_t bookKey) const {
+    return openLoans.count(loanKey(userHandle, bookKey)) > 0;
+  }
+
+  HistoryCursor cursor() const { return HistoryCursor(&tiers); }
+
+  // Копия ярусов на этот момент; дальнейшие изменения её не затронут
+  HistoryTiers version() const { return tiers; }
+
+  // Горячий ярус; открытые выдачи всегда здесь
+  const VersionedVector<BorrowingRecord, MemoryTag::HISTORY>& hot() const {
+    return tiers.hotRecords;
+  }
+  uint32_t hotId(size_t index) const { return tiers.hotIds[index]; }
+
+  size_t size() const { return coldCount + tiers.hotRecords.size(); }
+  size_t hotSize() const { return tiers.hotRecords.size(); }
+  size_t coldSize() const { return coldCount; }
+
+  size_t hotMemoryUsage() const {
+    return tiers.hotRecords.memoryUsage() + tiers.hotIds.memoryUsage();
+  }
+
+  size_t coldMemoryUsage() const {
+    size_t bytes = tiers.segments.capacity() *
+                       sizeof(std::shared_ptr<const HistorySegment>) +
+                   spans.capacity() * sizeof(SegmentSpan);
+    for (const auto& segment : tiers.segments) {
+      bytes += segment->memoryUsage();
+    }
+    return bytes;
+  }
+
+  size_t indexMemoryUsage() const {
+    size_t bytes = (byUser.capacity() + byBook.capacity()) *
+                   sizeof(HistoryVector<HistoryEntry>);
+    for (const auto* index : {&byUser, &byBook}) {
+      for (const auto& list : *index) {
+        bytes += list.capacity() * sizeof(HistoryEntry);
+      }
+    }
+    return bytes + openLoans.size() * (sizeof(uint64_t) + 2 * sizeof(void*));
+  }
+};
+
+inline HistoryCursor::HistoryCursor(const HistoryTiers* tiers)
+    : tiers(tiers), segment(0), inSegment(0), hot(0) {
+  openSegment();
+}
+
+inline HistoryCursor::HistoryCursor(std::shared_ptr<const HistoryTiers> tiers)
+    : owned(std::move(tiers)),
+      tiers(owned.get()),
+      segment(0),
+      inSegment(0),
+      hot(0) {
+  openSegment();
+}
+
+inline void HistoryCursor::openSegment() {
+  inSegment = 0;
+  if (segment < tiers->segments.size()) {
+    reader = tiers->segments[segment]->reader();
+  }
+}
+
+inline bool HistoryCursor::next(BorrowingRecord& record, uint32_t* id) {
+  while (segment < tiers->segments.size()) {
+    if (inSegment == tiers->segments[segment]->size()) {
+      ++segment;
+      openSegment();
+      continue;
+    }
+
+    reader.read(record);
+    ++inSegment;
+    if (id != nullptr) *id = reader.id;
+    return true;
+  }
+
+  if (hot == tiers->hotRecords.size()) return false;
+  record = tiers->hotRecords[hot];
+  if (id != nullptr) *id = tiers->hotIds[hot];
+  ++hot;
+  return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+
+#include "Dates.hpp"
+
+// Источник текущего дня (номер дня от 1970-01-01, см. Dates.hpp).
+// Библиотека и выдачи спрашивают время только через Clock, поэтому его
+// можно подменить: закэшировать на время обхода или крутить вручную.
+class Clock {
+ public:
+  virtual ~Clock() {};
+
+  virtual int32_t today() const = 0;
+};
+
+// Настоящие часы: каждый вызов - обращение к system_clock
+class SystemClock : public Clock {
+ public:
+  virtual int32_t today() const override { return currentEpochDay(); }
+};
+
+// Грубые часы: время читается из source только в tick(), между тиками
+// today() возвращает одно и то же значение. source не удаляется.
+class CachedClock : public Clock {
+ private:
+  const Clock* source;
+  int32_t day;
+
+ public:
+  CachedClock(const Clock* source) : source(source), day(source->today()) {}
+
+  void tick() { day = source->today(); }
+
+  virtual int32_t today() const override { return day; }
+};
+
+// Виртуальное время: стоит на месте, пока его не сдвинут вручную.
+// Нужно, чтобы прогнать месяцы выдач за секунды.
+class VirtualClock : public Clock {
+ private:
+  int32_t day;
+
+ public:
+  VirtualClock() : day(currentEpochDay()) {}
+  VirtualClock(int32_t day) : day(day) {}
+
+  void advance(int days) { day += days; }
+  void set(int32_t day) { this->day = day; }
+
+  virtual int32_t today() const override { return day; }
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с общей очередью задач. Задачи берутся в порядке
+// постановки; деструктор доделывает очередь и ждёт потоки.
+class ThreadPool {
+ private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable ready;
+  bool stopping;
+
+  void work() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this]() { return stopping || !tasks.empty(); });
+        if (tasks.empty()) return;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+  // Выполнить одну задачу из очереди в текущем потоке, если она есть
+  bool runQueued() {
+    std::function<void()> task;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (tasks.empty()) return false;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+    return true;
+  }
+
+ public:
+  // threads == 0 - по числу ядер
+  explicit ThreadPool(size_t threads = 0) : stopping(false) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+      workers.emplace_back([this]() { work(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    ready.notify_all();
+    for (std::thread& worker : workers) worker.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Поставить задачу без ожидания результата
+  void post(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back(std::move(task));
+    }
+    ready.notify_one();
+  }
+
+  template <typename Fn>
+  auto submit(Fn fn) -> std::future<decltype(fn())> {
+    using Result = decltype(fn());
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+    std::future<Result> result = task->get_future();
+    post([task]() { (*task)(); });
+    return result;
+  }
+
+  // fn(i) для каждого i из [0, n) и ожидание всех. Нулевой индекс
+  // выполняется в вызывающем потоке; пока остальные не готовы, он берёт
+  // задачи из очереди сам. Поэтому вызов из задачи пула не блокирует
+  // пул, даже если все его потоки сами ждут в parallelFor.
+  template <typename Fn>
+  void parallelFor(size_t n, Fn fn) {
+    std::vector<std::future<void>> pending;
+    pending.reserve(n);
+    for (size_t i = 1; i < n; ++i) {
+      pending.push_back(submit([&fn, i]() { fn(i); }));
+    }
+    if (n > 0) fn(0);
+    for (std::future<void>& done : pending) {
+      while (done.wait_for(std::chrono::seconds(0)) !=
+             std::future_status::ready) {
+        if (!runQueued()) done.wait();
+      }
+      done.get();
+    }
+  }
+
+  size_t size() const { return workers.size(); }
+};
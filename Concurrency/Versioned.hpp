@@ -0,0 +1,224 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <utility>
+
+#include "../Diagnostics/MemoryAccounting.hpp"
+
+// Вектор страницами по kPageSize элементов с копированием при записи.
+// Копия вектора делит с оригиналом все страницы и стоит копирования
+// указателей на них. Страница копируется, только когда её меняют, а на
+// неё ещё ссылается другая копия; старая версия освобождается вместе с
+// последней копией, которая её держит.
+//
+// Копию можно читать из других потоков, пока оригинал меняется: общие
+// страницы на месте не меняются. Сам оригинал (изменения и снятие копий)
+// - в одном потоке за раз. Память считается за Tag.
+template <typename T, MemoryTag Tag>
+class VersionedVector {
+ public:
+  static constexpr size_t kPageShift = 8;
+  static constexpr size_t kPageSize = size_t(1) << kPageShift;
+
+  class const_iterator;
+
+ private:
+  struct Page {
+    // Сколько копий вектора ссылаются на страницу
+    std::atomic<size_t> refs;
+    TaggedVector<T, Tag> items;
+
+    Page() : refs(1) { items.reserve(kPageSize); }
+  };
+
+  // Ссылка на страницу со счётчиком. Счётчик уменьшается с release, а
+  // проверяется с acquire: запись в страницу, которую отпустили в другом
+  // потоке, начинается после того, как там её дочитали.
+  class PageRef {
+   private:
+    Page* page;
+
+    void release() {
+      if (page != nullptr &&
+          page->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        TaggedAllocator<Page, Tag> allocator;
+        page->~Page();
+        allocator.deallocate(page, 1);
+      }
+    }
+
+   public:
+    PageRef() : page(new (TaggedAllocator<Page, Tag>().allocate(1)) Page()) {}
+
+    PageRef(const PageRef& other) : page(other.page) {
+      page->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    PageRef(PageRef&& other) noexcept : page(other.page) {
+      other.page = nullptr;
+    }
+
+    PageRef& operator=(PageRef other) noexcept {
+      std::swap(page, other.page);
+      return *this;
+    }
+
+    ~PageRef() { release(); }
+
+    bool isShared() const {
+      return page->refs.load(std::memory_order_acquire) != 1;
+    }
+
+    TaggedVector<T, Tag>& items() const { return page->items; }
+  };
+
+  TaggedVector<PageRef, Tag> pages;
+  size_t count;
+
+  // Страница p, которую можно менять на месте
+  TaggedVector<T, Tag>& own(size_t p) {
+    if (pages[p].isShared()) {
+      PageRef copy;
+      copy.items().assign(pages[p].items().begin(), pages[p].items().end());
+      pages[p] = std::move(copy);
+    }
+    return pages[p].items();
+  }
+
+ public:
+  VersionedVector() : count(0) {}
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  const T& operator[](size_t index) const {
+    return pages[index >> kPageShift].items()[index & (kPageSize - 1)];
+  }
+
+  // Элемент для записи; общая страница сначала копируется
+  T& mutate(size_t index) {
+    return own(index >> kPageShift)[index & (kPageSize - 1)];
+  }
+
+  void push_back(const T& value) {
+    if ((count & (kPageSize - 1)) == 0) pages.emplace_back();
+    own(pages.size() - 1).push_back(value);
+    ++count;
+  }
+
+  void clear() {
+    pages.clear();
+    count = 0;
+  }
+
+  // Страниц, которые сейчас делятся с другими копиями
+  size_t sharedPages() const {
+    size_t shared = 0;
+    for (const PageRef& page : pages) shared += page.isShared();
+    return shared;
+  }
+
+  size_t memoryUsage() const {
+    return pages.capacity() * sizeof(PageRef) +
+           pages.size() * (sizeof(Page) + kPageSize * sizeof(T));
+  }
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, count); }
+};
+
+// Обход подряд идёт по указателю внутри страницы; страница ищется только
+// на её границе и при произвольных переходах
+template <typename T, MemoryTag Tag>
+class VersionedVector<T, Tag>::const_iterator {
+ private:
+  const VersionedVector* vector;
+  size_t index;
+  const T* item;
+
+  static const T* locate(const VersionedVector* vector, size_t index) {
+    return index < vector->size() ? &(*vector)[index] : nullptr;
+  }
+
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const T*;
+  using reference = const T&;
+
+  const_iterator() : vector(nullptr), index(0), item(nullptr) {}
+  const_iterator(const VersionedVector* vector, size_t index)
+      : vector(vector), index(index), item(locate(vector, index)) {}
+
+  reference operator*() const { return *item; }
+  pointer operator->() const { return item; }
+  reference operator[](difference_type n) const {
+    return (*vector)[index + n];
+  }
+
+  size_t position() const { return index; }
+
+  const_iterator& operator++() {
+    ++index;
+    if ((index & (kPageSize - 1)) == 0) {
+      item = locate(vector, index);
+    } else {
+      ++item;
+    }
+    return *this;
+  }
+  const_iterator operator++(int) {
+    const_iterator old = *this;
+    ++*this;
+    return old;
+  }
+  const_iterator& operator--() {
+    *this = const_iterator(vector, index - 1);
+    return *this;
+  }
+  const_iterator operator--(int) {
+    const_iterator old = *this;
+    --*this;
+    return old;
+  }
+  const_iterator& operator+=(difference_type n) {
+    *this = const_iterator(vector, index + n);
+    return *this;
+  }
+  const_iterator& operator-=(difference_type n) {
+    *this = const_iterator(vector, index - n);
+    return *this;
+  }
+  const_iterator operator+(difference_type n) const {
+    return const_iterator(vector, index + n);
+  }
+  const_iterator operator-(difference_type n) const {
+    return const_iterator(vector, index - n);
+  }
+  difference_type operator-(const const_iterator& other) const {
+    return static_cast<difference_type>(index) -
+           static_cast<difference_type>(other.index);
+  }
+
+  bool operator==(const const_iterator& other) const {
+    return index == other.index;
+  }
+  bool operator!=(const const_iterator& other) const {
+    return index != other.index;
+  }
+  bool operator<(const const_iterator& other) const {
+    return index < other.index;
+  }
+  bool operator>(const const_iterator& other) const {
+    return index > other.index;
+  }
+  bool operator<=(const const_iterator& other) const {
+    return index <= other.index;
+  }
+  bool operator>=(const const_iterator& other) const {
+    return index >= other.index;
+  }
+};
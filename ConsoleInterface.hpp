@@ -1,11 +1,23 @@
 #pragma once
+#include <cstdio>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <stdexcept>
 
 #include "Library.hpp"
+#include "Sequence/MappedArraySequence.hpp"
 
 class ConsoleInterface {
  private:
+  static constexpr int kSearchResultLimit = 20;
+  static constexpr int kFuzzyMaxDistance = 2;
+  static constexpr int kHistoryPageSize = 10;
+  static constexpr int kListPageSize = 20;
+  static constexpr int kDashboardTopBooks = 10;
+  static constexpr int kDashboardDays = 7;
+
   Library library;
 
   void printMenu() {
@@ -21,6 +33,15 @@ class ConsoleInterface {
     std::cout << "9. View All Books\n";
     std::cout << "10. View All Users\n";
     std::cout << "11. View Borrowed Books History\n";
+    std::cout << "12. Advanced Search\n";
+    std::cout << "13. View User History\n";
+    std::cout << "14. View Book History\n";
+    std::cout << "15. Circulation Dashboard\n";
+    std::cout << "16. Performance Metrics\n";
+    std::cout << "17. Tracing\n";
+    std::cout << "18. Memory Usage\n";
+    std::cout << "19. Fines\n";
+    std::cout << "20. Holds\n";
     std::cout << "0. Exit\n";
     std::cout << "Choose option: ";
   }
@@ -72,6 +93,19 @@ class ConsoleInterface {
     }
   }
 
+  const char* userTypeName(UserType type) {
+    switch (type) {
+      case UserType::STUDENT:
+        return "Student";
+      case UserType::FACULTY:
+        return "Faculty";
+      case UserType::GUEST:
+        return "Guest";
+      default:
+        return "Unknown";
+    }
+  }
+
   void addBook() {
     std::cout << "\n--- Add Book ---\n";
     std::string title = getStringInput("Title: ");
@@ -93,7 +127,7 @@ class ConsoleInterface {
     if (library.removeBook(isbn)) {
       std::cout << "Book removed successfully!\n";
     } else {
-      std::cout << "Book not found.\n";
+      std::cout << "Book not found or currently borrowed.\n";
     }
   }
 
@@ -118,7 +152,7 @@ class ConsoleInterface {
     if (library.removeUser(userId)) {
       std::cout << "User removed successfully!\n";
     } else {
-      std::cout << "User not found.\n";
+      std::cout << "Failed to remove user (not found or has books on loan).\n";
     }
   }
 
@@ -129,11 +163,21 @@ class ConsoleInterface {
 
     if (library.borrowBook(userId, isbn)) {
       std::cout << "Book borrowed successfully!\n";
-    } else {
-      std::cout << "Failed to borrow book. Check if:\n";
-      std::cout << "- User exists and can borrow more books\n";
-      std::cout << "- Book exists and is available\n";
+      return;
+    }
+
+    const Book* book = library.findBook(isbn);
+    if (book != nullptr && !book->isAvailable() &&
+        library.findUser(userId) != nullptr &&
+        getStringInput("Book is on loan. Place a hold? (y/n): ") == "y") {
+      std::cout << (library.placeHold(userId, isbn)
+                        ? "Hold placed. The book will be set aside for you.\n"
+                        : "Failed to place hold.\n");
+      return;
     }
+    std::cout << "Failed to borrow book. Check if:\n";
+    std::cout << "- User exists and can borrow more books\n";
+    std::cout << "- Book exists and is available\n";
   }
 
   void returnBook() {
@@ -157,57 +201,119 @@ class ConsoleInterface {
     std::cout << "------------------------\n";
   }
 
+  void printUser(const LibraryUser& user) {
+    std::cout << "ID: " << user.getUserId() << "\n";
+    std::cout << "Name: " << user.getName() << "\n";
+    std::cout << "Email: " << user.getEmail() << "\n";
+
+    std::cout << "Type: " << userTypeName(user.getType()) << "\n";
+
+    Sequence<std::string>* borrowed =
+        library.getBorrowedBooks(user.getUserId());
+    if (borrowed->GetLength() > 0) {
+      std::cout << "Borrowed books (" << borrowed->GetLength() << "):\n";
+      for (const auto& bookId : *borrowed) {
+        std::cout << "- " << bookId << "\n";
+      }
+    }
+    delete borrowed;
+
+    std::cout << "------------------------\n";
+  }
+
+  std::string describeFields(unsigned fields) {
+    std::string result;
+    const unsigned masks[] = {MATCH_ISBN, MATCH_TITLE, MATCH_AUTHOR,
+                              MATCH_GENRE};
+    const char* names[] = {"ISBN", "Title", "Author", "Genre"};
+    for (int i = 0; i < 4; ++i) {
+      if (fields & masks[i]) {
+        if (!result.empty()) result += ", ";
+        result += names[i];
+      }
+    }
+    return result;
+  }
+
   void searchBooks() {
     std::cout << "\n--- Search Books ---\n";
     std::string query = getStringInput("Enter search query: ");
+    TRACE_SCOPE("Console::searchBooks");
 
-    SearchResults* results = library.searchBooks(query);
+    SearchResults* results = library.searchBooks(query, kSearchResultLimit);
+    if (results->isEmpty()) {
+      delete results;
+      results = library.fuzzySearchBooks(query, kFuzzyMaxDistance);
+      if (!results->isEmpty()) {
+        std::cout << "\nNo exact matches. Did you mean:\n";
+      }
+    }
 
     if (results->isEmpty()) {
       std::cout << "No books found.\n";
     } else {
-      std::cout << "\n=== Search Results ===\n";
-
-      if (results->byISBN->GetLength() > 0) {
-        std::cout << "\nBy ISBN:\n";
-        std::cout << "------------------------\n";
-        for (const auto& book : *results->byISBN) {
-          printBook(book);
-        }
-      }
+      TRACE_SCOPE("Console::printResults");
+      std::cout << "\n=== Top "
+                << std::min<size_t>(results->totalCount(), kSearchResultLimit)
+                << " Search Results ===\n";
+      std::cout << "------------------------\n";
 
-      if (results->byAuthor->GetLength() > 0) {
-        std::cout << "\nBy Author:\n";
-        std::cout << "------------------------\n";
-        for (const auto& book : *results->byAuthor) {
-          printBook(book);
-        }
+      int rank = 1;
+      for (const auto& match : *results->matches) {
+        if (rank > kSearchResultLimit) break;
+        std::cout << "#" << rank++ << " (matched: "
+                  << describeFields(match.fields) << ")\n";
+        printBook(*match.book);
       }
+    }
 
-      if (results->byTitle->GetLength() > 0) {
-        std::cout << "\nBy Title:\n";
-        std::cout << "------------------------\n";
-        for (const auto& book : *results->byTitle) {
-          printBook(book);
-        }
-      }
+    delete results;
+  }
 
-      if (results->byGenre->GetLength() > 0) {
-        std::cout << "\nBy Genre:\n";
-        std::cout << "------------------------\n";
-        for (const auto& book : *results->byGenre) {
-          printBook(book);
-        }
+  void advancedSearch() {
+    std::cout << "\n--- Advanced Search ---\n";
+    std::cout << "Example: author:\"Tolkien\" genre:fantasy available:true "
+                 "title~ring\n";
+    std::cout << "Ranges: title>=a title<n author<=m isbn>978\n";
+    std::string text = getStringInput("Enter query: ");
+    TRACE_SCOPE("Console::advancedSearch");
+
+    std::string plan;
+    SearchResults* results = library.query(text, &plan);
+    std::cout << "\nPlan:\n" << plan;
+    if (results == nullptr) return;
+
+    int shown = 0;
+    for (const auto& match : *results->matches) {
+      if (shown++ == kSearchResultLimit) {
+        std::cout << "... and " << results->totalCount() - kSearchResultLimit
+                  << " more\n";
+        break;
       }
-
-      std::cout << "\n"
-                << "Total found: " << results->totalCount() << " books\n";
+      printBook(*match.book);
     }
 
     delete results;
   }
 
+  static std::string formatCents(int64_t cents) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%lld.%02lld",
+                  static_cast<long long>(cents / 100),
+                  static_cast<long long>(cents % 100));
+    return buffer;
+  }
+
+  void printRecord(const BorrowingRecord& record) {
+    std::cout << "User: " << library.getRecordUserId(record) << "\n";
+    std::cout << "Book: " << library.getRecordBookId(record) << "\n";
+    std::cout << "Borrowed: " << library.formatDate(record.getBorrowDay())
+              << "\n";
+    std::cout << "Due: " << library.formatDate(record.getDueDay()) << "\n";
+  }
+
   void viewOverdueBooks() {
+    TRACE_SCOPE("Console::viewOverdueBooks");
     std::cout << "\n--- Overdue Books ---\n";
     Sequence<BorrowingRecord>* overdue = library.getOverdueBooks();
 
@@ -216,10 +322,9 @@ class ConsoleInterface {
     } else {
       std::cout << "Overdue books (" << overdue->GetLength() << "):\n";
       for (const auto& record : *overdue) {
-        std::cout << "User: " << record.getUserId() << "\n";
-        std::cout << "Book: " << record.getBookId() << "\n";
-        std::cout << "Borrowed: " << record.getBorrowDateStr() << "\n";
-        std::cout << "Due: " << record.getDueDateStr() << "\n";
+        printRecord(record);
+        std::cout << "Fine: " << formatCents(library.getRecordFine(record))
+                  << "\n";
         std::cout << "------------------------\n";
       }
     }
@@ -227,54 +332,422 @@ class ConsoleInterface {
     delete overdue;
   }
 
+  // Следующая страница листинга или конец
+  bool nextListPage(const std::string& token) {
+    return !token.empty() &&
+           getStringInput("Enter for next page, q to stop: ") != "q";
+  }
+
   void viewAllBooks() {
-    Sequence<Book>* allBooks = library.getAllBooks();
+    TRACE_SCOPE("Console::viewAllBooks");
+    std::cout << "Sort by:\n";
+    std::cout << "1. Catalog order\n";
+    std::cout << "2. Title\n";
+    std::cout << "3. Author\n";
+    std::cout << "4. ISBN\n";
+    int choice = getIntInput("Enter choice (1-4): ");
+    BookOrder order = choice == 2   ? BookOrder::TITLE
+                      : choice == 3 ? BookOrder::AUTHOR
+                      : choice == 4 ? BookOrder::ISBN
+                                    : BookOrder::CATALOG;
+
+    std::cout << "--- All books (" << library.countBooks(BookFilter())
+              << "): ---\n";
+    std::string token;
+    do {
+      ListingPage<const Book*>* page =
+          library.getBooksPage(token, kListPageSize, order);
+      for (const Book* book : *page->items) {
+        printBook(*book);
+      }
+      token = page->nextToken;
+      delete page;
+    } while (nextListPage(token));
+  }
+
+  void viewAllUsers() {
+    TRACE_SCOPE("Console::viewAllUsers");
+    std::cout << "All users:\n";
+    std::string token;
+    do {
+      ListingPage<LibraryUser*>* page =
+          library.getUsersPage(token, kListPageSize);
+      for (LibraryUser* user : *page->items) {
+        printUser(*user);
+      }
+      token = page->nextToken;
+      delete page;
+    } while (nextListPage(token));
+  }
 
-    std::cout << "--- All books (" << allBooks->GetLength() << "): ---\n";
-    for (const auto& book : *allBooks) {
-      printBook(book);
+  void viewBorrowedBooksHistory() {
+    TRACE_SCOPE("Console::viewBorrowedBooksHistory");
+    const BorrowHistory& storage = library.getHistoryStorage();
+    std::cout << "Borrowed books history (" << storage.size() << " records, "
+              << storage.coldSize() << " archived, "
+              << (storage.hotMemoryUsage() + storage.coldMemoryUsage()) / 1024
+              << " KB):\n";
+    std::cout << "------------------------\n";
+    int32_t today = library.today();
+    HistoryCursor cursor = library.getBorrowHistory();
+    BorrowingRecord record;
+    while (cursor.next(record)) {
+      printRecord(record);
+      printStatus(record, today);
+      std::cout << "------------------------\n";
     }
 
-    delete allBooks;
+    std::string path =
+        getStringInput("\nExport history to file (empty to skip): ");
+    if (!path.empty()) exportHistory(path);
   }
 
-  void viewAllUsers() {
-    Sequence<LibraryUser*>* allUsers = library.getAllUsers();
-
-    std::cout << "All users (" << allUsers->GetLength() << "):\n";
-    for (const auto& user : *allUsers) {
-      std::cout << "ID: " << user->getUserId() << "\n";
-      std::cout << "Name: " << user->getName() << "\n";
-      std::cout << "Email: " << user->getEmail() << "\n";
-
-      std::unordered_set<std::string>* borrowed = user->getBorrowedBooks();
-      if (borrowed->size() > 0) {
-        std::cout << "Borrowed books (" << borrowed->size() << "):\n";
-        for (const auto& bookId : *borrowed) {
-          std::cout << "- " << bookId << "\n";
+  // Выгрузка для офлайн-анализа: записи как есть в отображённый файл (см.
+  // MappedArraySequence.hpp), открывается без разбора. В записях только
+  // внутренние номера читателей и книг, поэтому рядом, в path + ".ids",
+  // пишется их расшифровка: строки "user\t<номер>\t<userId>" и
+  // "book\t<номер>\t<ISBN>" для всех номеров из выгрузки.
+  void exportHistory(const std::string& path) {
+    TRACE_SCOPE("Console::exportHistory");
+    try {
+      MappedArraySequence<BorrowingRecord> file(path, true);
+      file.Reserve(static_cast<int>(library.getHistoryStorage().size()));
+      std::map<uint32_t, std::string> userIds;
+      std::map<uint32_t, std::string> bookIds;
+      HistoryCursor cursor = library.getBorrowHistory();
+      BorrowingRecord record;
+      while (cursor.next(record)) {
+        file.Append(record);
+        if (userIds.count(record.getUserHandle()) == 0) {
+          userIds[record.getUserHandle()] = library.getRecordUserId(record);
+        }
+        if (bookIds.count(record.getBookKey()) == 0) {
+          bookIds[record.getBookKey()] = library.getRecordBookId(record);
         }
       }
+      file.Flush();
 
-      std::cout << "------------------------\n";
+      std::ofstream ids(path + ".ids");
+      for (const auto& [handle, userId] : userIds) {
+        ids << "user\t" << handle << '\t' << userId << '\n';
+      }
+      for (const auto& [key, isbn] : bookIds) {
+        ids << "book\t" << key << '\t' << isbn << '\n';
+      }
+      if (!ids) throw std::runtime_error("cannot write " + path + ".ids");
+      std::cout << "Exported " << file.GetLength() << " records to " << path
+                << " (ids in " << path << ".ids).\n";
+    } catch (const std::exception& error) {
+      std::cout << "Failed to export history: " << error.what() << "\n";
     }
-
-    delete allUsers;
   }
 
-  void viewBorrowedBooksHistory() {
-    std::cout << "Borrowed books history:\n";
-    std::cout << "------------------------\n";
-    for (const auto& record : *library.getBorrowHistory()) {
-      std::cout << "User: " << record.getUserId() << "\n";
-      std::cout << "Book: " << record.getBookId() << "\n";
-      std::cout << "Borrowed: " << record.getBorrowDateStr() << "\n";
-      std::cout << "Due: " << record.getDueDateStr() << "\n";
-      std::cout << "Status: "
-                << (record.isOverdue()    ? "OVERDUE"
-                    : record.isReturned() ? "RETURNED"
+  void printStatus(const BorrowingRecord& record, int32_t today) {
+    std::cout << "Status: "
+              << (record.isOverdue(today) ? "OVERDUE"
+                  : record.isReturned()   ? "RETURNED"
                                           : "BORROWED")
+              << "\n";
+  }
+
+  // Пустая строка - без ограничения
+  bool getDateInput(const std::string& prompt, int32_t emptyValue,
+                    int32_t& day) {
+    std::string text = getStringInput(prompt);
+    if (text.empty()) {
+      day = emptyValue;
+      return true;
+    }
+    if (parseDate(text, day)) return true;
+    std::cout << "Invalid date, expected YYYY-MM-DD.\n";
+    return false;
+  }
+
+  void viewKeyedHistory(bool byUser) {
+    std::string id = byUser ? getStringInput("Enter user ID: ")
+                            : getStringInput("Enter ISBN: ");
+    int32_t fromDay, toDay;
+    if (!getDateInput("From date (YYYY-MM-DD, empty for any): ", INT32_MIN,
+                      fromDay) ||
+        !getDateInput("To date (YYYY-MM-DD, empty for any): ", INT32_MAX,
+                      toDay)) {
+      return;
+    }
+
+    size_t total = byUser ? library.countUserHistory(id, fromDay, toDay)
+                          : library.countBookHistory(id, fromDay, toDay);
+    std::cout << "\n--- History of " << id << " (" << total
+              << " records) ---\n";
+    int32_t today = library.today();
+    for (size_t offset = 0; offset < total; offset += kHistoryPageSize) {
+      Sequence<BorrowingRecord>* page =
+          byUser ? library.getUserHistory(id, fromDay, toDay, offset,
+                                          kHistoryPageSize)
+                 : library.getBookHistory(id, fromDay, toDay, offset,
+                                          kHistoryPageSize);
+      for (const auto& record : *page) {
+        printRecord(record);
+        printStatus(record, today);
+        std::cout << "------------------------\n";
+      }
+      delete page;
+
+      if (offset + kHistoryPageSize < total &&
+          getStringInput("Enter for next page, q to stop: ") == "q") {
+        break;
+      }
+    }
+  }
+
+  void viewDashboard() {
+    TRACE_SCOPE("Console::viewDashboard");
+    CirculationStats& stats = library.getCirculation();
+    std::cout << "\n--- Circulation Dashboard ---\n";
+    std::cout << "Overdue loans: " << library.overdueCount() << "\n";
+
+    std::cout << "\nMost borrowed:\n";
+    Sequence<Facet>* top = library.mostBorrowedBooks(kDashboardTopBooks);
+    for (const auto& facet : *top) {
+      const Book* book = library.findBook(facet.value);
+      std::cout << "  " << std::setw(6) << facet.count << "  "
+                << (book != nullptr ? book->getTitle() : facet.value)
+                << "\n";
+    }
+    delete top;
+
+    std::cout << "\nBy genre (books / on loan / total loans):\n";
+    for (const auto& [genre, genreStats] : stats.genreStats()) {
+      std::cout << "  " << genre << ": " << genreStats.books << " / "
+                << genreStats.activeLoans << " / " << genreStats.totalLoans
                 << "\n";
-      std::cout << "------------------------\n";
+    }
+
+    std::cout << "\nBy user type (users / on loan / utilization):\n";
+    std::ios::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    for (UserType type :
+         {UserType::STUDENT, UserType::FACULTY, UserType::GUEST}) {
+      const UserTypeStats& typeStats = stats.userTypeStats(type);
+      std::cout << "  " << userTypeName(type) << ": " << typeStats.users
+                << " / " << typeStats.activeLoans << " / " << std::fixed
+                << std::setprecision(1) << typeStats.utilization() * 100
+                << "%\n";
+    }
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+
+    std::cout << "\nLast " << kDashboardDays
+              << " days (loans / returns):\n";
+    int32_t today = library.today();
+    for (int32_t day = today - kDashboardDays + 1; day <= today; ++day) {
+      DayRollup rollup = stats.dayRollup(day);
+      std::cout << "  " << library.formatDate(day) << ": " << rollup.loans
+                << " / " << rollup.returns << "\n";
+    }
+  }
+
+  static std::string formatMicros(uint64_t nanos) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.1f", nanos / 1000.0);
+    return buffer;
+  }
+
+  void viewMetrics() {
+#if LIBRARY_METRICS
+    Metrics& metrics = Metrics::instance();
+    std::cout << "\n--- Performance Metrics (latency in us) ---\n";
+    std::cout << std::left << std::setw(15) << "Operation" << std::right
+              << std::setw(8) << "Calls" << std::setw(8) << "Failed"
+              << std::setw(10) << "p50" << std::setw(10) << "p99"
+              << std::setw(10) << "Max" << std::setw(10) << "Results"
+              << "\n";
+    for (int i = 0; i < static_cast<int>(MetricOp::kCount); ++i) {
+      MetricOp op = static_cast<MetricOp>(i);
+      OperationMetrics stats = metrics.read(op);
+      if (stats.calls == 0) continue;
+
+      std::cout << std::left << std::setw(15) << metricOpName(op)
+                << std::right << std::setw(8) << stats.calls << std::setw(8)
+                << stats.failures << std::setw(10)
+                << formatMicros(stats.latency.percentile(0.5))
+                << std::setw(10)
+                << formatMicros(stats.latency.percentile(0.99))
+                << std::setw(10) << formatMicros(stats.latency.max())
+                << std::setw(10)
+                << (stats.resultSize.count == 0
+                        ? std::string("-")
+                        : std::to_string(stats.resultSize.percentile(0.5)))
+                << "\n";
+    }
+
+    std::string path =
+        getStringInput("\nWrite Prometheus dump to file (empty to skip): ");
+    if (path.empty()) return;
+    std::ofstream out(path);
+    out << metrics.dump() << MemoryAccounting::dump();
+    std::cout << (out ? "Metrics written to " + path + ".\n"
+                      : "Failed to write " + path + ".\n");
+#else
+    std::cout << "Metrics are disabled in this build.\n";
+#endif
+  }
+
+  void manageTracing() {
+#if LIBRARY_TRACING
+    Tracer& tracer = Tracer::instance();
+    std::cout << "\n--- Tracing ---\n";
+    std::cout << "Status: " << (tracer.isEnabled() ? "on" : "off")
+              << ", sampling 1 of " << tracer.getSampleEvery()
+              << " operations, dropped events: " << tracer.droppedEvents()
+              << "\n";
+    std::cout << "1. " << (tracer.isEnabled() ? "Disable" : "Enable") << "\n";
+    std::cout << "2. Set sampling\n";
+    std::cout << "3. Write Chrome trace file\n";
+
+    switch (getIntInput("Choose option: ")) {
+      case 1:
+        tracer.setEnabled(!tracer.isEnabled());
+        break;
+      case 2: {
+        int every = getIntInput("Trace 1 of N operations, N = ");
+        tracer.setSampleEvery(every > 0 ? static_cast<uint32_t>(every) : 1);
+        break;
+      }
+      case 3: {
+        std::string path = getStringInput("File path: ");
+        std::ofstream out(path);
+        out << tracer.flushChromeJson();
+        std::cout << (out ? "Trace written to " + path +
+                                " (open in chrome://tracing or Perfetto).\n"
+                          : "Failed to write " + path + ".\n");
+        break;
+      }
+      default:
+        std::cout << "Invalid choice.\n";
+    }
+#else
+    std::cout << "Tracing is disabled in this build.\n";
+#endif
+  }
+
+  void viewMemoryUsage() {
+#if LIBRARY_MEMORY_ACCOUNTING
+    std::cout << "\n--- Memory Usage ---\n";
+    std::cout << std::left << std::setw(10) << "Subsystem" << std::right
+              << std::setw(12) << "Live KB" << std::setw(12) << "Peak KB"
+              << std::setw(10) << "Allocs" << std::setw(10) << "Frees"
+              << "\n";
+    std::ios::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    for (int i = 0; i < static_cast<int>(MemoryTag::kCount); ++i) {
+      MemoryTag tag = static_cast<MemoryTag>(i);
+      MemoryStats stats = MemoryAccounting::stats(tag);
+      std::cout << std::left << std::setw(10) << memoryTagName(tag)
+                << std::right << std::fixed << std::setprecision(1)
+                << std::setw(12) << stats.liveBytes / 1024.0 << std::setw(12)
+                << stats.peakBytes / 1024.0 << std::setw(10)
+                << stats.allocations << std::setw(10) << stats.frees << "\n";
+    }
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+#else
+    std::cout << "Memory accounting is disabled in this build.\n";
+#endif
+  }
+
+  void manageFines() {
+    TRACE_SCOPE("Console::manageFines");
+    std::cout << "\n--- Fines ---\n";
+    std::cout << "1. Run daily assessment\n";
+    std::cout << "2. View user balance\n";
+    std::cout << "3. Pay fine\n";
+
+    switch (getIntInput("Choose option: ")) {
+      case 1:
+        std::cout << "Accrued on open loans: "
+                  << formatCents(library.assessFines()) << "\n";
+        break;
+      case 2: {
+        std::string userId = getStringInput("Enter user ID: ");
+        std::cout << "Balance: "
+                  << formatCents(library.getFineBalance(userId)) << "\n";
+        break;
+      }
+      case 3: {
+        std::string userId = getStringInput("Enter user ID: ");
+        int cents = getIntInput("Amount in cents: ");
+        std::cout << (library.payFine(userId, cents)
+                          ? "Payment accepted. Balance: " +
+                                formatCents(library.getFineBalance(userId)) +
+                                "\n"
+                          : "Payment rejected.\n");
+        break;
+      }
+      default:
+        std::cout << "Invalid choice.\n";
+    }
+  }
+
+  void manageHolds() {
+    TRACE_SCOPE("Console::manageHolds");
+    std::cout << "\n--- Holds ---\n";
+    std::cout << "1. Place hold\n";
+    std::cout << "2. View user holds\n";
+    std::cout << "3. Cancel hold\n";
+    std::cout << "4. Process expired reservations\n";
+    std::cout << "5. Returned books: "
+              << (library.getHoldHandoff() == HoldHandoff::DIRECT
+                      ? "lend to next holder (switch to set aside)\n"
+                      : "set aside for next holder (switch to lend)\n");
+
+    switch (getIntInput("Choose option: ")) {
+      case 1: {
+        std::string userId = getStringInput("User ID: ");
+        std::string isbn = getStringInput("Book ISBN: ");
+        std::cout << (library.placeHold(userId, isbn)
+                          ? "Hold placed.\n"
+                          : "Failed to place hold. The book must be on loan "
+                            "and the queue not full.\n");
+        break;
+      }
+      case 2: {
+        std::string userId = getStringInput("User ID: ");
+        Sequence<HoldInfo>* holds = library.getUserHolds(userId);
+        if (holds == nullptr) {
+          std::cout << "User not found.\n";
+          break;
+        }
+        if (holds->GetLength() == 0) std::cout << "No holds.\n";
+        for (const HoldInfo& hold : *holds) {
+          std::cout << library.getHoldBookId(hold) << ": ";
+          if (hold.isReserved()) {
+            std::cout << "set aside until "
+                      << library.formatDate(hold.expiryDay) << "\n";
+          } else {
+            std::cout << "position " << hold.position + 1 << " in queue\n";
+          }
+        }
+        delete holds;
+        break;
+      }
+      case 3: {
+        std::string userId = getStringInput("User ID: ");
+        std::string isbn = getStringInput("Book ISBN: ");
+        std::cout << (library.cancelHold(userId, isbn) ? "Hold cancelled.\n"
+                                                       : "No such hold.\n");
+        break;
+      }
+      case 4:
+        std::cout << "Expired reservations: " << library.processHoldExpiry()
+                  << "\n";
+        break;
+      case 5:
+        library.setHoldHandoff(library.getHoldHandoff() == HoldHandoff::DIRECT
+                                   ? HoldHandoff::RESERVE
+                                   : HoldHandoff::DIRECT);
+        break;
+      default:
+        std::cout << "Invalid choice.\n";
     }
   }
 
@@ -320,6 +793,33 @@ class ConsoleInterface {
         case 11:
           viewBorrowedBooksHistory();
           break;
+        case 12:
+          advancedSearch();
+          break;
+        case 13:
+          viewKeyedHistory(true);
+          break;
+        case 14:
+          viewKeyedHistory(false);
+          break;
+        case 15:
+          viewDashboard();
+          break;
+        case 16:
+          viewMetrics();
+          break;
+        case 17:
+          manageTracing();
+          break;
+        case 18:
+          viewMemoryUsage();
+          break;
+        case 19:
+          manageFines();
+          break;
+        case 20:
+          manageHolds();
+          break;
         case 0:
           std::cout << "Goodbye!\n";
           return;
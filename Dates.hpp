@@ -0,0 +1,84 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+// Дата хранится как число дней от 1970-01-01 (UTC).
+// Перевод в год/месяц/день и обратно - алгоритм Говарда Хиннанта, чистая
+// арифметика без обращений к ОС.
+
+inline int32_t daysFromCivil(int year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  const int era = (year >= 0 ? year : year - 399) / 400;
+  const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+  const unsigned dayOfYear =
+      (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  const unsigned dayOfEra =
+      yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + static_cast<int32_t>(dayOfEra) - 719468;
+}
+
+inline void civilFromDays(int32_t days, int& year, unsigned& month,
+                          unsigned& day) {
+  days += 719468;
+  const int era = (days >= 0 ? days : days - 146096) / 146097;
+  const unsigned dayOfEra = static_cast<unsigned>(days - era * 146097);
+  const unsigned yearOfEra =
+      (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) /
+      365;
+  const unsigned dayOfYear =
+      dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  const unsigned shiftedMonth = (5 * dayOfYear + 2) / 153;
+  day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+  month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+  year = static_cast<int>(yearOfEra) + era * 400 + (month <= 2);
+}
+
+// "YYYY-MM-DD" -> номер дня; false, если строка не дата
+inline bool parseDate(const std::string& text, int32_t& day) {
+  int year;
+  unsigned month, dayOfMonth;
+  char tail;
+  if (std::sscanf(text.c_str(), "%d-%u-%u%c", &year, &month, &dayOfMonth,
+                  &tail) != 3) {
+    return false;
+  }
+  if (month < 1 || month > 12 || dayOfMonth < 1) return false;
+
+  day = daysFromCivil(year, month, dayOfMonth);
+  int checkYear;
+  unsigned checkMonth, checkDay;
+  civilFromDays(day, checkYear, checkMonth, checkDay);
+  return checkMonth == month && checkDay == dayOfMonth;
+}
+
+inline int32_t currentEpochDay() {
+  auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+  return static_cast<int32_t>(
+      std::chrono::duration_cast<std::chrono::hours>(sinceEpoch).count() / 24);
+}
+
+// Строки "YYYY-MM-DD" по номеру дня. Различных дней в истории немного, а
+// записей миллионы, поэтому каждая дата форматируется один раз.
+class DateCache {
+ private:
+  std::unordered_map<int32_t, std::string> cache;
+
+ public:
+  const std::string& format(int32_t day) {
+    auto it = cache.find(day);
+    if (it != cache.end()) return it->second;
+
+    int year;
+    unsigned month, dayOfMonth;
+    civilFromDays(day, year, month, dayOfMonth);
+
+    // С запасом на любой int: "-2147483648-4294967295-4294967295"
+    char buffer[40];
+    std::snprintf(buffer, sizeof(buffer), "%04d-%02u-%02u", year, month,
+                  dayOfMonth);
+    return cache.emplace(day, buffer).first->second;
+  }
+};
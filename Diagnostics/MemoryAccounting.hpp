@@ -0,0 +1,222 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Учёт памяти по подсистемам: живые байты, пик, число выделений и
+// освобождений. Подсистема (тег) задаётся либо типом аллокатора
+// (TaggedAllocator для std-контейнеров), либо областью MEMORY_SCOPE:
+// DynamicArray и LinkedList запоминают тег области, в которой созданы.
+// Считаются только выделения самих контейнеров; строки внутри элементов
+// (длиннее SSO) идут мимо учёта.
+// Сборка с -DLIBRARY_NO_MEMORY_ACCOUNTING отключает подсчёт.
+#ifndef LIBRARY_NO_MEMORY_ACCOUNTING
+#define LIBRARY_MEMORY_ACCOUNTING 1
+#else
+#define LIBRARY_MEMORY_ACCOUNTING 0
+#endif
+
+enum class MemoryTag {
+  OTHER,
+  CATALOG,
+  USERS,
+  HISTORY,
+  SEARCH,
+  INDEXES,
+  kCount
+};
+
+inline const char* memoryTagName(MemoryTag tag) {
+  static const char* names[] = {"other",   "catalog", "users",
+                                "history", "search",  "indexes"};
+  return names[static_cast<int>(tag)];
+}
+
+struct MemoryStats {
+  int64_t liveBytes;
+  int64_t peakBytes;
+  uint64_t allocations;
+  uint64_t frees;
+};
+
+class MemoryAccounting {
+ private:
+  static const int kTags = static_cast<int>(MemoryTag::kCount);
+
+  struct Counters {
+    std::atomic<int64_t> live;
+    std::atomic<int64_t> peak;
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> frees;
+  };
+
+  static Counters& counters(MemoryTag tag) {
+    static Counters all[kTags] = {};
+    return all[static_cast<int>(tag)];
+  }
+
+  static MemoryTag& current() {
+    thread_local MemoryTag tag = MemoryTag::OTHER;
+    return tag;
+  }
+
+ public:
+  static void allocated(MemoryTag tag, size_t bytes) {
+#if LIBRARY_MEMORY_ACCOUNTING
+    Counters& c = counters(tag);
+    int64_t live = c.live.fetch_add(static_cast<int64_t>(bytes),
+                                    std::memory_order_relaxed) +
+                   static_cast<int64_t>(bytes);
+    int64_t peak = c.peak.load(std::memory_order_relaxed);
+    while (live > peak &&
+           !c.peak.compare_exchange_weak(peak, live,
+                                         std::memory_order_relaxed)) {
+    }
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+#else
+    (void)tag;
+    (void)bytes;
+#endif
+  }
+
+  static void freed(MemoryTag tag, size_t bytes) {
+#if LIBRARY_MEMORY_ACCOUNTING
+    Counters& c = counters(tag);
+    c.live.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+    c.frees.fetch_add(1, std::memory_order_relaxed);
+#else
+    (void)tag;
+    (void)bytes;
+#endif
+  }
+
+  static MemoryStats stats(MemoryTag tag) {
+    Counters& c = counters(tag);
+    return {c.live.load(std::memory_order_relaxed),
+            c.peak.load(std::memory_order_relaxed),
+            c.allocations.load(std::memory_order_relaxed),
+            c.frees.load(std::memory_order_relaxed)};
+  }
+
+  // Тег для контейнеров, которые создаются в текущей области
+  static MemoryTag currentTag() { return current(); }
+
+  // Текстовый формат Prometheus
+  static std::string dump() {
+    std::string out;
+    out += "# TYPE library_memory_live_bytes gauge\n";
+    out += "# TYPE library_memory_peak_bytes gauge\n";
+    out += "# TYPE library_memory_allocations_total counter\n";
+    for (int i = 0; i < kTags; ++i) {
+      MemoryTag tag = static_cast<MemoryTag>(i);
+      MemoryStats s = stats(tag);
+      std::string label =
+          std::string("{tag=\"") + memoryTagName(tag) + "\"} ";
+      out += "library_memory_live_bytes" + label +
+             std::to_string(s.liveBytes) + "\n";
+      out += "library_memory_peak_bytes" + label +
+             std::to_string(s.peakBytes) + "\n";
+      out += "library_memory_allocations_total" + label +
+             std::to_string(s.allocations) + "\n";
+    }
+    return out;
+  }
+
+  friend class MemoryScope;
+};
+
+// Внутри области новые DynamicArray и LinkedList считаются за tag
+class MemoryScope {
+ private:
+  MemoryTag previous;
+
+ public:
+  explicit MemoryScope(MemoryTag tag)
+      : previous(MemoryAccounting::current()) {
+    MemoryAccounting::current() = tag;
+  }
+
+  ~MemoryScope() { MemoryAccounting::current() = previous; }
+
+  MemoryScope(const MemoryScope&) = delete;
+  MemoryScope& operator=(const MemoryScope&) = delete;
+};
+
+#define MEMORY_SCOPE_CONCAT_INNER(a, b) a##b
+#define MEMORY_SCOPE_CONCAT(a, b) MEMORY_SCOPE_CONCAT_INNER(a, b)
+#define MEMORY_SCOPE(tag) \
+  MemoryScope MEMORY_SCOPE_CONCAT(memoryScope, __LINE__)(tag)
+
+// Аллокатор для std-контейнеров, который считает выделения за Tag
+template <typename T, MemoryTag Tag>
+class TaggedAllocator {
+ public:
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = TaggedAllocator<U, Tag>;
+  };
+
+  TaggedAllocator() noexcept {}
+  template <typename U>
+  TaggedAllocator(const TaggedAllocator<U, Tag>&) noexcept {}
+
+  T* allocate(size_t n) {
+    MemoryAccounting::allocated(Tag, n * sizeof(T));
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    MemoryAccounting::freed(Tag, n * sizeof(T));
+    ::operator delete(p);
+  }
+
+  template <typename U>
+  bool operator==(const TaggedAllocator<U, Tag>&) const noexcept {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const TaggedAllocator<U, Tag>&) const noexcept {
+    return false;
+  }
+};
+
+template <typename T, MemoryTag Tag>
+using TaggedVector = std::vector<T, TaggedAllocator<T, Tag>>;
+
+template <typename K, typename V, MemoryTag Tag>
+using TaggedMap =
+    std::unordered_map<K, V, std::hash<K>, std::equal_to<K>,
+                       TaggedAllocator<std::pair<const K, V>, Tag>>;
+
+// Упорядоченная карта, когда нужен обход по ключу
+template <typename K, typename V, MemoryTag Tag>
+using TaggedOrderedMap =
+    std::map<K, V, std::less<K>, TaggedAllocator<std::pair<const K, V>, Tag>>;
+
+template <typename T>
+using HistoryVector = TaggedVector<T, MemoryTag::HISTORY>;
+
+template <typename T>
+using IndexVector = TaggedVector<T, MemoryTag::INDEXES>;
+
+// Массив new T[count] с учётом за tag; освобождать через deleteTaggedArray
+template <typename T>
+T* newTaggedArray(MemoryTag tag, int count) {
+  if (count > 0) MemoryAccounting::allocated(tag, count * sizeof(T));
+  return new T[count];
+}
+
+template <typename T>
+void deleteTaggedArray(MemoryTag tag, T* data, int count) {
+  if (data != nullptr && count > 0) {
+    MemoryAccounting::freed(tag, count * sizeof(T));
+  }
+  delete[] data;
+}
@@ -0,0 +1,298 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Счётчики и гистограммы задержек операций библиотеки.
+// Каждый поток пишет только в свой блок (без блокировок и атомарных
+// read-modify-write), чтение складывает блоки всех потоков.
+// Сборка с -DLIBRARY_NO_METRICS убирает замеры целиком.
+#ifndef LIBRARY_NO_METRICS
+#define LIBRARY_METRICS 1
+#else
+#define LIBRARY_METRICS 0
+#endif
+
+enum class MetricOp {
+  ADD_BOOK,
+  REMOVE_BOOK,
+  FIND_BOOK,
+  SEARCH,
+  TOP_SEARCH,
+  FUZZY_SEARCH,
+  AUTOCOMPLETE,
+  QUERY,
+  FILTER,
+  REGISTER_USER,
+  REMOVE_USER,
+  BORROW,
+  RETURN,
+  OVERDUE,
+  HISTORY,
+  HOLD,
+  LIST,
+  kCount
+};
+
+inline const char* metricOpName(MetricOp op) {
+  static const char* names[] = {
+      "add_book",     "remove_book",   "find_book",   "search",
+      "top_search",   "fuzzy_search",  "autocomplete", "query",
+      "filter",       "register_user", "remove_user", "borrow",
+      "return",       "overdue",       "history",     "hold",
+      "list"};
+  return names[static_cast<int>(op)];
+}
+
+// Лог-линейные корзины в духе HDR: на каждую степень двойки 8 корзин,
+// относительная погрешность не больше 12.5%.
+struct LogLinearBuckets {
+  static const int kSubBits = 3;
+  static const int kSub = 1 << kSubBits;
+  static const int kCount = (64 - kSubBits + 1) * kSub;
+
+  static int index(uint64_t value) {
+    if (value < static_cast<uint64_t>(kSub)) return static_cast<int>(value);
+    int shift = 63 - __builtin_clzll(value) - kSubBits;
+    return (shift + 1) * kSub + static_cast<int>((value >> shift) & (kSub - 1));
+  }
+
+  static uint64_t lowerBound(int index) {
+    if (index < kSub) return static_cast<uint64_t>(index);
+    int shift = index / kSub - 1;
+    return static_cast<uint64_t>(kSub + index % kSub) << shift;
+  }
+
+  // Наибольшее значение, попадающее в корзину
+  static uint64_t upperBound(int index) {
+    if (index < kSub) return static_cast<uint64_t>(index);
+    int shift = index / kSub - 1;
+    return lowerBound(index) + ((uint64_t(1) << shift) - 1);
+  }
+};
+
+// Гистограмма, в которую пишет один поток. Читать можно из любого:
+// значения атомарные, но увеличиваются обычными load + store.
+class ThreadHistogram {
+ private:
+  std::atomic<uint64_t> buckets[LogLinearBuckets::kCount];
+  std::atomic<uint64_t> sum;
+
+  static void bump(std::atomic<uint64_t>& value, uint64_t by) {
+    value.store(value.load(std::memory_order_relaxed) + by,
+                std::memory_order_relaxed);
+  }
+
+ public:
+  ThreadHistogram() : sum(0) {
+    for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+  }
+
+  void record(uint64_t value) {
+    bump(buckets[LogLinearBuckets::index(value)], 1);
+    bump(sum, value);
+  }
+
+  uint64_t bucket(int index) const {
+    return buckets[index].load(std::memory_order_relaxed);
+  }
+
+  uint64_t total() const { return sum.load(std::memory_order_relaxed); }
+};
+
+// Сумма гистограмм всех потоков на момент чтения
+struct HistogramSnapshot {
+  std::vector<uint64_t> buckets;
+  uint64_t count;
+  uint64_t sum;
+
+  HistogramSnapshot()
+      : buckets(LogLinearBuckets::kCount, 0), count(0), sum(0) {}
+
+  void merge(const ThreadHistogram& histogram) {
+    for (int i = 0; i < LogLinearBuckets::kCount; ++i) {
+      uint64_t n = histogram.bucket(i);
+      buckets[i] += n;
+      count += n;
+    }
+    sum += histogram.total();
+  }
+
+  double mean() const {
+    return count == 0 ? 0.0 : static_cast<double>(sum) / count;
+  }
+
+  // Значение, не меньше которого q-я доля замеров (верхняя граница корзины)
+  uint64_t percentile(double q) const {
+    if (count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * (count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LogLinearBuckets::kCount; ++i) {
+      seen += buckets[i];
+      if (seen >= rank) return LogLinearBuckets::upperBound(i);
+    }
+    return LogLinearBuckets::upperBound(LogLinearBuckets::kCount - 1);
+  }
+
+  uint64_t max() const {
+    for (int i = LogLinearBuckets::kCount - 1; i >= 0; --i) {
+      if (buckets[i] != 0) return LogLinearBuckets::upperBound(i);
+    }
+    return 0;
+  }
+};
+
+struct OperationMetrics {
+  uint64_t calls;
+  uint64_t failures;
+  HistogramSnapshot latency;
+  HistogramSnapshot resultSize;
+
+  OperationMetrics() : calls(0), failures(0) {}
+};
+
+class Metrics {
+ private:
+  static const int kOps = static_cast<int>(MetricOp::kCount);
+
+  struct ThreadBlock {
+    std::atomic<uint64_t> calls[kOps];
+    std::atomic<uint64_t> failures[kOps];
+    ThreadHistogram latency[kOps];
+    ThreadHistogram resultSize[kOps];
+
+    ThreadBlock() {
+      for (int op = 0; op < kOps; ++op) {
+        calls[op].store(0, std::memory_order_relaxed);
+        failures[op].store(0, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  std::mutex mutex;
+  // Блоки переживают свои потоки: их замеры остаются в сумме
+  std::vector<std::unique_ptr<ThreadBlock>> blocks;
+
+  ThreadBlock* registerThread() {
+    std::lock_guard<std::mutex> lock(mutex);
+    blocks.push_back(std::unique_ptr<ThreadBlock>(new ThreadBlock()));
+    return blocks.back().get();
+  }
+
+  ThreadBlock& local() {
+    thread_local ThreadBlock* block = registerThread();
+    return *block;
+  }
+
+  static void bump(std::atomic<uint64_t>& value) {
+    value.store(value.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+  }
+
+ public:
+  static Metrics& instance() {
+    static Metrics metrics;
+    return metrics;
+  }
+
+  void record(MetricOp op, uint64_t nanos, bool success, int64_t resultSize) {
+    ThreadBlock& block = local();
+    int i = static_cast<int>(op);
+    bump(block.calls[i]);
+    if (!success) bump(block.failures[i]);
+    block.latency[i].record(nanos);
+    if (resultSize >= 0) {
+      block.resultSize[i].record(static_cast<uint64_t>(resultSize));
+    }
+  }
+
+  OperationMetrics read(MetricOp op) {
+    OperationMetrics metrics;
+    int i = static_cast<int>(op);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& block : blocks) {
+      metrics.calls += block->calls[i].load(std::memory_order_relaxed);
+      metrics.failures += block->failures[i].load(std::memory_order_relaxed);
+      metrics.latency.merge(block->latency[i]);
+      metrics.resultSize.merge(block->resultSize[i]);
+    }
+    return metrics;
+  }
+
+  // Текстовый формат Prometheus: счётчики и гистограммы задержек (секунды)
+  std::string dump() {
+    std::string out;
+    out += "# TYPE library_op_calls_total counter\n";
+    out += "# TYPE library_op_failures_total counter\n";
+    out += "# TYPE library_op_latency_seconds histogram\n";
+    out += "# TYPE library_op_result_size summary\n";
+    for (int i = 0; i < kOps; ++i) {
+      MetricOp op = static_cast<MetricOp>(i);
+      OperationMetrics metrics = read(op);
+      std::string label = std::string("{op=\"") + metricOpName(op) + "\"";
+
+      out += "library_op_calls_total" + label + "} " +
+             std::to_string(metrics.calls) + "\n";
+      out += "library_op_failures_total" + label + "} " +
+             std::to_string(metrics.failures) + "\n";
+
+      uint64_t cumulative = 0;
+      for (int b = 0; b < LogLinearBuckets::kCount; ++b) {
+        if (metrics.latency.buckets[b] == 0) continue;
+        cumulative += metrics.latency.buckets[b];
+        out += "library_op_latency_seconds_bucket" + label + ",le=\"" +
+               secondsText(LogLinearBuckets::upperBound(b)) + "\"} " +
+               std::to_string(cumulative) + "\n";
+      }
+      out += "library_op_latency_seconds_bucket" + label + ",le=\"+Inf\"} " +
+             std::to_string(metrics.latency.count) + "\n";
+      out += "library_op_latency_seconds_sum" + label + "} " +
+             secondsText(metrics.latency.sum) + "\n";
+      out += "library_op_latency_seconds_count" + label + "} " +
+             std::to_string(metrics.latency.count) + "\n";
+
+      if (metrics.resultSize.count == 0) continue;
+      for (double q : {0.5, 0.99}) {
+        out += "library_op_result_size" + label + ",quantile=\"" +
+               (q == 0.5 ? "0.5" : "0.99") + "\"} " +
+               std::to_string(metrics.resultSize.percentile(q)) + "\n";
+      }
+      out += "library_op_result_size_sum" + label + "} " +
+             std::to_string(metrics.resultSize.sum) + "\n";
+      out += "library_op_result_size_count" + label + "} " +
+             std::to_string(metrics.resultSize.count) + "\n";
+    }
+    return out;
+  }
+
+  static std::string secondsText(uint64_t nanos) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.9g", nanos * 1e-9);
+    return buffer;
+  }
+};
+
+// Замер одной операции: время от создания до finish()
+class MetricsTimer {
+ private:
+  MetricOp op;
+  std::chrono::steady_clock::time_point start;
+
+ public:
+  explicit MetricsTimer(MetricOp op)
+      : op(op), start(std::chrono::steady_clock::now()) {}
+
+  // resultSize < 0 - у операции нет размера результата
+  void finish(bool success, int64_t resultSize = -1) {
+    uint64_t nanos = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+    Metrics::instance().record(op, nanos, success, resultSize);
+  }
+};
@@ -0,0 +1,227 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Трассировка участков кода: TRACE_SCOPE("name") замеряет время до конца
+// блока. Завершённые участки складываются в кольцевой буфер своего потока
+// (один писатель, один читатель, без блокировок) и по запросу выгружаются
+// в JSON формата Chrome trace events (chrome://tracing, Perfetto).
+// Выборка решается на корневом участке: вложенные участки следуют ему.
+// Участки ставятся на операции и их фазы, а не на помощники, которые
+// зовутся для каждой книги или элемента: такие участки забивают буфер и
+// сами искажают замер.
+// Сборка с -DLIBRARY_NO_TRACING убирает трассировку целиком.
+#ifndef LIBRARY_NO_TRACING
+#define LIBRARY_TRACING 1
+#else
+#define LIBRARY_TRACING 0
+#endif
+
+struct TraceEvent {
+  // Только строковые литералы: имя не копируется
+  const char* name;
+  uint64_t start;
+  uint64_t duration;
+};
+
+// Буфер одного потока. Пишет только владелец, читает только flush.
+// Переполненный буфер теряет новые события, а не старые.
+class TraceRing {
+ private:
+  static const uint32_t kCapacity = 1 << 14;
+
+  TraceEvent events[kCapacity];
+  std::atomic<uint64_t> head;
+  std::atomic<uint64_t> tail;
+  std::atomic<uint64_t> dropped;
+
+ public:
+  const uint32_t threadId;
+
+  explicit TraceRing(uint32_t threadId)
+      : head(0), tail(0), dropped(0), threadId(threadId) {}
+
+  void push(const TraceEvent& event) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == kCapacity) {
+      dropped.store(dropped.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+      return;
+    }
+    events[h % kCapacity] = event;
+    head.store(h + 1, std::memory_order_release);
+  }
+
+  template <typename Fn>
+  void drain(Fn fn) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_acquire);
+    for (; t != h; ++t) fn(events[t % kCapacity]);
+    tail.store(t, std::memory_order_release);
+  }
+
+  uint64_t droppedCount() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
+};
+
+class Tracer {
+ public:
+  struct ThreadState {
+    TraceRing* ring;
+    uint32_t depth;
+    bool sampled;
+    uint32_t rootCounter;
+  };
+
+ private:
+  std::atomic<bool> enabled;
+  // Каждый sampleEvery-й корневой участок потока попадает в трассу
+  std::atomic<uint32_t> sampleEvery;
+  std::chrono::steady_clock::time_point epoch;
+
+  std::mutex mutex;
+  std::vector<std::unique_ptr<TraceRing>> rings;
+
+  Tracer()
+      : enabled(false),
+        sampleEvery(1),
+        epoch(std::chrono::steady_clock::now()) {}
+
+  TraceRing* registerThread() {
+    std::lock_guard<std::mutex> lock(mutex);
+    rings.push_back(std::unique_ptr<TraceRing>(
+        new TraceRing(static_cast<uint32_t>(rings.size() + 1))));
+    return rings.back().get();
+  }
+
+  static void appendEscaped(std::string& out, const char* text) {
+    for (; *text != '\0'; ++text) {
+      if (*text == '"' || *text == '\\') out += '\\';
+      out += *text;
+    }
+  }
+
+ public:
+  static Tracer& instance() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  ThreadState& local() {
+    thread_local ThreadState state = {nullptr, 0, false, 0};
+    return state;
+  }
+
+  bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+  void setEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+
+  uint32_t getSampleEvery() const {
+    return sampleEvery.load(std::memory_order_relaxed);
+  }
+  void setSampleEvery(uint32_t every) {
+    sampleEvery.store(every == 0 ? 1 : every, std::memory_order_relaxed);
+  }
+
+  uint64_t now() const {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch)
+            .count());
+  }
+
+  // Решение о выборке для нового участка; true - участок пишется
+  bool enter(ThreadState& state) {
+    if (state.depth++ == 0) {
+      state.sampled = ++state.rootCounter % getSampleEvery() == 0;
+      if (state.sampled && state.ring == nullptr) {
+        state.ring = registerThread();
+      }
+    }
+    return state.sampled;
+  }
+
+  void leave(ThreadState& state, const TraceEvent& event, bool sampled) {
+    --state.depth;
+    if (sampled) state.ring->push(event);
+  }
+
+  uint64_t droppedEvents() {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t total = 0;
+    for (const auto& ring : rings) total += ring->droppedCount();
+    return total;
+  }
+
+  // Забрать накопленные события всех потоков в JSON trace events.
+  // Время в микросекундах от запуска программы.
+  std::string flushChromeJson() {
+    std::string out = "{\"traceEvents\":[";
+    bool first = true;
+    char buffer[128];
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& ring : rings) {
+      ring->drain([&](const TraceEvent& event) {
+        out += first ? "\n" : ",\n";
+        first = false;
+        out += "{\"name\":\"";
+        appendEscaped(out, event.name);
+        std::snprintf(buffer, sizeof(buffer),
+                      "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,"
+                      "\"tid\":%u}",
+                      event.start / 1000.0, event.duration / 1000.0,
+                      ring->threadId);
+        out += buffer;
+      });
+    }
+    out += "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return out;
+  }
+};
+
+class TraceScope {
+ private:
+  const char* name;
+  uint64_t start;
+  bool sampled;
+  bool active;
+
+ public:
+  explicit TraceScope(const char* name)
+      : name(name), start(0), sampled(false), active(false) {
+    Tracer& tracer = Tracer::instance();
+    if (!tracer.isEnabled()) return;
+
+    active = true;
+    sampled = tracer.enter(tracer.local());
+    if (sampled) start = tracer.now();
+  }
+
+  ~TraceScope() {
+    if (!active) return;
+
+    Tracer& tracer = Tracer::instance();
+    TraceEvent event = {name, start, sampled ? tracer.now() - start : 0};
+    tracer.leave(tracer.local(), event, sampled);
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if LIBRARY_TRACING
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) \
+  do {                    \
+  } while (0)
+#endif
@@ -0,0 +1,160 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Diagnostics/MemoryAccounting.hpp"
+#include "Users.hpp"
+
+// Штраф за выдачу на день today - дни просрочки сверх льготных, умноженные
+// на ставку, но не больше потолка (см. UserPolicy). Суммы в центах.
+// Штрафы по всем открытым выдачам считаются разом. Выдачи лежат колонками
+// (день начала штрафа, ставка, потолок, читатель), так что пересчёт на
+// новый день - один проход по плотным массивам int32, который
+// компилятор векторизует; в баланс читателя попадает только разница с
+// прошлым пересчётом. Баланс читателя - долг по закрытым выдачам минус
+// оплаты плюс начисленное по открытым на день последнего пересчёта.
+// Память считается за MemoryTag::HISTORY.
+class FineEngine {
+ private:
+  // Блок пересчёта: свежие штрафы блока помещаются в стек и в L1
+  static constexpr size_t kBlock = 1024;
+  // Ограничения дней просрочки и ставки, чтобы их произведение
+  // не переполняло int32
+  static constexpr int32_t kMaxDays = 1 << 15;
+  static constexpr int32_t kMaxRate = 65535;
+
+  // Колонки открытых выдач; i-я выдача - i-й элемент каждой колонки
+  TaggedVector<int32_t, MemoryTag::HISTORY> startDay;
+  TaggedVector<int32_t, MemoryTag::HISTORY> rate;
+  TaggedVector<int32_t, MemoryTag::HISTORY> cap;
+  TaggedVector<int32_t, MemoryTag::HISTORY> accrued;
+  TaggedVector<uint32_t, MemoryTag::HISTORY> userOf;
+  TaggedVector<uint32_t, MemoryTag::HISTORY> bookOf;
+  // (читатель << 32 | книга) -> позиция в колонках
+  TaggedMap<uint64_t, uint32_t, MemoryTag::HISTORY> slots;
+
+  // Баланс читателя по номеру в хранилище пользователей
+  TaggedVector<int64_t, MemoryTag::HISTORY> balances;
+
+  static uint64_t loanKey(uint32_t userHandle, uint32_t bookKey) {
+    return static_cast<uint64_t>(userHandle) << 32 | bookKey;
+  }
+
+  int64_t& balance(uint32_t userHandle) {
+    if (userHandle >= balances.size()) balances.resize(userHandle + 1, 0);
+    return balances[userHandle];
+  }
+
+  static int32_t fineAt(int32_t startDay, int32_t rate, int32_t cap,
+                        int32_t today) {
+    int32_t days = today - startDay;
+    days = days < 0 ? 0 : days;
+    days = days < kMaxDays ? days : kMaxDays;
+    int32_t fine = days * rate;
+    return fine < cap ? fine : cap;
+  }
+
+ public:
+  // Штраф по одной выдаче, без учёта в балансах
+  static int32_t fine(int32_t dueDay, const UserPolicy& policy,
+                      int32_t today) {
+    return fineAt(dueDay + policy.graceDays,
+                  std::min(policy.finePerDay, kMaxRate), policy.fineCap,
+                  today);
+  }
+
+  // Выдача с днём возврата dueDay по правилам policy
+  void loanOpened(uint32_t userHandle, uint32_t bookKey, int32_t dueDay,
+                  const UserPolicy& policy) {
+    slots[loanKey(userHandle, bookKey)] =
+        static_cast<uint32_t>(startDay.size());
+    startDay.push_back(dueDay + policy.graceDays);
+    rate.push_back(std::min(policy.finePerDay, kMaxRate));
+    cap.push_back(policy.fineCap);
+    accrued.push_back(0);
+    userOf.push_back(userHandle);
+    bookOf.push_back(bookKey);
+    balance(userHandle);
+  }
+
+  // Книгу вернули в день returnDay: штраф фиксируется в балансе.
+  // Возвращает штраф по этой выдаче.
+  int32_t loanClosed(uint32_t userHandle, uint32_t bookKey,
+                     int32_t returnDay) {
+    auto it = slots.find(loanKey(userHandle, bookKey));
+    if (it == slots.end()) return 0;
+
+    uint32_t i = it->second;
+    slots.erase(it);
+    int32_t charged = fineAt(startDay[i], rate[i], cap[i], returnDay);
+    balance(userHandle) += charged - accrued[i];
+
+    uint32_t last = static_cast<uint32_t>(startDay.size() - 1);
+    if (i != last) {
+      startDay[i] = startDay[last];
+      rate[i] = rate[last];
+      cap[i] = cap[last];
+      accrued[i] = accrued[last];
+      userOf[i] = userOf[last];
+      bookOf[i] = bookOf[last];
+      slots[loanKey(userOf[i], bookOf[i])] = i;
+    }
+    startDay.pop_back();
+    rate.pop_back();
+    cap.pop_back();
+    accrued.pop_back();
+    userOf.pop_back();
+    bookOf.pop_back();
+    return charged;
+  }
+
+  // Пересчитать штрафы всех открытых выдач на день today и обновить
+  // балансы. Возвращает сумму штрафов по открытым выдачам.
+  int64_t assess(int32_t today) {
+    const size_t n = startDay.size();
+    const int32_t* __restrict starts = startDay.data();
+    const int32_t* __restrict rates = rate.data();
+    const int32_t* __restrict caps = cap.data();
+    int32_t* __restrict owed = accrued.data();
+    int32_t fresh[kBlock];
+    int64_t total = 0;
+
+    for (size_t base = 0; base < n; base += kBlock) {
+      const size_t count = std::min(kBlock, n - base);
+      // Без ветвлений и зависимостей между итерациями - векторизуется
+      for (size_t i = 0; i < count; ++i) {
+        fresh[i] = fineAt(starts[base + i], rates[base + i], caps[base + i],
+                          today);
+      }
+      for (size_t i = 0; i < count; ++i) {
+        int32_t delta = fresh[i] - owed[base + i];
+        total += fresh[i];
+        if (delta == 0) continue;
+        balances[userOf[base + i]] += delta;
+        owed[base + i] = fresh[i];
+      }
+    }
+    return total;
+  }
+
+  // Баланс на момент последнего пересчёта, возврата или оплаты
+  int64_t balanceOf(uint32_t userHandle) const {
+    return userHandle < balances.size() ? balances[userHandle] : 0;
+  }
+
+  // Оплата части долга; false, если сумма не положительна или больше долга
+  bool pay(uint32_t userHandle, int64_t amount) {
+    if (amount <= 0 || amount > balanceOf(userHandle)) return false;
+    balances[userHandle] -= amount;
+    return true;
+  }
+
+  // Начислено по выдаче на момент последнего пересчёта
+  int32_t accruedFor(uint32_t userHandle, uint32_t bookKey) const {
+    auto it = slots.find(loanKey(userHandle, bookKey));
+    return it == slots.end() ? 0 : accrued[it->second];
+  }
+
+  size_t openLoans() const { return startDay.size(); }
+};
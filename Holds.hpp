@@ -0,0 +1,299 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Diagnostics/MemoryAccounting.hpp"
+#include "Users.hpp"
+
+// Что делать с возвращённой книгой, на которую есть очередь
+enum class HoldHandoff {
+  // Отложить для первого в очереди до истечения срока
+  RESERVE,
+  // Сразу выдать первому в очереди, если он может взять ещё книгу;
+  // иначе отложить
+  DIRECT
+};
+
+// Бронь читателя: место в очереди на книгу или отложенная книга
+struct HoldInfo {
+  uint32_t bookKey;
+  // Место в очереди с нуля; -1 - книга отложена
+  int position;
+  // День, после которого отложенная книга уходит следующему
+  int32_t expiryDay;
+
+  bool isReserved() const { return position < 0; }
+};
+
+// Очередь на одну книгу: по кольцу FIFO на каждый тип читателя,
+// преподаватели впереди студентов, студенты впереди гостей. Размер
+// ограничен, первый в очереди находится за O(1).
+class HoldQueue {
+ public:
+  static constexpr int kPerType = 8;
+
+ private:
+  static constexpr int kTypes = 3;
+
+  uint32_t ring[kTypes][kPerType];
+  uint8_t head[kTypes];
+  uint8_t count[kTypes];
+
+  // Порядок обслуживания типов: FACULTY, STUDENT, GUEST
+  static int rank(UserType type) {
+    switch (type) {
+      case UserType::FACULTY:
+        return 0;
+      case UserType::STUDENT:
+        return 1;
+      default:
+        return 2;
+    }
+  }
+
+  uint32_t& at(int r, int i) { return ring[r][(head[r] + i) % kPerType]; }
+  uint32_t at(int r, int i) const {
+    return ring[r][(head[r] + i) % kPerType];
+  }
+
+ public:
+  HoldQueue() : head(), count() {}
+
+  bool push(uint32_t userHandle, UserType type) {
+    int r = rank(type);
+    if (count[r] == kPerType) return false;
+    at(r, count[r]++) = userHandle;
+    return true;
+  }
+
+  bool front(uint32_t& userHandle) const {
+    for (int r = 0; r < kTypes; ++r) {
+      if (count[r] != 0) {
+        userHandle = ring[r][head[r]];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void pop() {
+    for (int r = 0; r < kTypes; ++r) {
+      if (count[r] != 0) {
+        head[r] = (head[r] + 1) % kPerType;
+        --count[r];
+        return;
+      }
+    }
+  }
+
+  // Место читателя в очереди или -1
+  int position(uint32_t userHandle) const {
+    int before = 0;
+    for (int r = 0; r < kTypes; ++r) {
+      for (int i = 0; i < count[r]; ++i) {
+        if (at(r, i) == userHandle) return before + i;
+      }
+      before += count[r];
+    }
+    return -1;
+  }
+
+  bool remove(uint32_t userHandle) {
+    for (int r = 0; r < kTypes; ++r) {
+      for (int i = 0; i < count[r]; ++i) {
+        if (at(r, i) != userHandle) continue;
+        for (int j = i + 1; j < count[r]; ++j) at(r, j - 1) = at(r, j);
+        --count[r];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool isEmpty() const { return count[0] + count[1] + count[2] == 0; }
+};
+
+// Очереди и отложенные книги библиотеки. Книги и читатели - номера
+// в библиотеке, как в BorrowingRecord. Отложенные книги разложены по
+// дню окончания брони, так что истёкшие снимаются пачкой за день, без
+// обхода всех броней. Память считается за MemoryTag::HISTORY.
+class HoldBook {
+ public:
+  static constexpr int kMaxHoldsPerUser = 5;
+  static constexpr int kPickupDays = 3;
+
+ private:
+  struct Reservation {
+    uint32_t userHandle;
+    int32_t expiryDay;
+  };
+
+  // Только книги, на которые кто-то стоит в очереди
+  TaggedMap<uint32_t, HoldQueue, MemoryTag::HISTORY> queues;
+  TaggedMap<uint32_t, Reservation, MemoryTag::HISTORY> reservations;
+  // День окончания брони -> книги. Бронь, снятую раньше срока, из корзины
+  // не убираем: при разборе она просто не найдётся.
+  TaggedOrderedMap<int32_t, TaggedVector<uint32_t, MemoryTag::HISTORY>,
+                   MemoryTag::HISTORY>
+      expiring;
+  // Читатель -> книги, которые он ждёт или которые ему отложены
+  TaggedMap<uint32_t, TaggedVector<uint32_t, MemoryTag::HISTORY>,
+            MemoryTag::HISTORY>
+      byUser;
+
+  void forget(uint32_t userHandle, uint32_t bookKey) {
+    auto it = byUser.find(userHandle);
+    if (it == byUser.end()) return;
+
+    auto& held = it->second;
+    held.erase(std::remove(held.begin(), held.end(), bookKey), held.end());
+    if (held.empty()) byUser.erase(it);
+  }
+
+ public:
+  // Встать в очередь; false, если уже стоит, очередь его типа полна
+  // или у читателя kMaxHoldsPerUser броней
+  bool place(uint32_t userHandle, UserType type, uint32_t bookKey) {
+    auto& held = byUser[userHandle];
+    bool placed =
+        held.size() < static_cast<size_t>(kMaxHoldsPerUser) &&
+        std::find(held.begin(), held.end(), bookKey) == held.end() &&
+        queues[bookKey].push(userHandle, type);
+    if (placed) {
+      held.push_back(bookKey);
+      return true;
+    }
+
+    if (held.empty()) byUser.erase(userHandle);
+    auto queue = queues.find(bookKey);
+    if (queue != queues.end() && queue->second.isEmpty()) queues.erase(queue);
+    return false;
+  }
+
+  // Выйти из очереди (не снимает отложенную книгу)
+  bool cancel(uint32_t userHandle, uint32_t bookKey) {
+    auto it = queues.find(bookKey);
+    if (it == queues.end() || !it->second.remove(userHandle)) return false;
+
+    if (it->second.isEmpty()) queues.erase(it);
+    forget(userHandle, bookKey);
+    return true;
+  }
+
+  bool hasWaiting(uint32_t bookKey) const {
+    return queues.find(bookKey) != queues.end();
+  }
+
+  // Забрать первого из очереди на книгу
+  bool popNext(uint32_t bookKey, uint32_t& userHandle) {
+    auto it = queues.find(bookKey);
+    if (it == queues.end() || !it->second.front(userHandle)) return false;
+
+    it->second.pop();
+    if (it->second.isEmpty()) queues.erase(it);
+    forget(userHandle, bookKey);
+    return true;
+  }
+
+  // Отложить книгу для читателя до expiryDay включительно
+  void reserve(uint32_t bookKey, uint32_t userHandle, int32_t expiryDay) {
+    reservations[bookKey] = {userHandle, expiryDay};
+    expiring[expiryDay].push_back(bookKey);
+    byUser[userHandle].push_back(bookKey);
+  }
+
+  // Для кого отложена книга; false, если не отложена
+  bool reservedFor(uint32_t bookKey, uint32_t& userHandle) const {
+    auto it = reservations.find(bookKey);
+    if (it == reservations.end()) return false;
+
+    userHandle = it->second.userHandle;
+    return true;
+  }
+
+  // Снять бронь: книгу забрали или от неё отказались
+  bool release(uint32_t bookKey) {
+    auto it = reservations.find(bookKey);
+    if (it == reservations.end()) return false;
+
+    forget(it->second.userHandle, bookKey);
+    reservations.erase(it);
+    return true;
+  }
+
+  // Снять брони, истёкшие к дню today; для каждой книги вызывается
+  // onExpired(bookKey). Цена - число броней с истёкшим сроком.
+  template <typename Fn>
+  size_t expire(int32_t today, Fn onExpired) {
+    size_t expired = 0;
+    while (!expiring.empty() && expiring.begin()->first < today) {
+      auto bucket = expiring.begin();
+      int32_t day = bucket->first;
+      TaggedVector<uint32_t, MemoryTag::HISTORY> books;
+      books.swap(bucket->second);
+      expiring.erase(bucket);
+
+      for (uint32_t bookKey : books) {
+        auto it = reservations.find(bookKey);
+        if (it == reservations.end() || it->second.expiryDay != day) {
+          continue;
+        }
+        release(bookKey);
+        ++expired;
+        onExpired(bookKey);
+      }
+    }
+    return expired;
+  }
+
+  // Брони читателя в порядке постановки
+  std::vector<HoldInfo> holdsOf(uint32_t userHandle) const {
+    std::vector<HoldInfo> result;
+    auto it = byUser.find(userHandle);
+    if (it == byUser.end()) return result;
+
+    for (uint32_t bookKey : it->second) {
+      auto reserved = reservations.find(bookKey);
+      if (reserved != reservations.end() &&
+          reserved->second.userHandle == userHandle) {
+        result.push_back({bookKey, -1, reserved->second.expiryDay});
+        continue;
+      }
+      auto queue = queues.find(bookKey);
+      if (queue != queues.end()) {
+        result.push_back({bookKey, queue->second.position(userHandle), 0});
+      }
+    }
+    return result;
+  }
+
+  // Книгу убрали из каталога: очередь и бронь пропадают
+  void dropBook(uint32_t bookKey) {
+    uint32_t userHandle;
+    while (popNext(bookKey, userHandle)) {
+    }
+    release(bookKey);
+  }
+
+  // Читателя удалили: выйти из всех очередей. Возвращает книги, которые
+  // были ему отложены, - их нужно передать дальше.
+  std::vector<uint32_t> dropUser(uint32_t userHandle) {
+    std::vector<uint32_t> released;
+    auto it = byUser.find(userHandle);
+    if (it == byUser.end()) return released;
+
+    // Копия: cancel меняет этот же список
+    auto held = it->second;
+    for (uint32_t bookKey : held) {
+      uint32_t holder;
+      if (reservedFor(bookKey, holder) && holder == userHandle) {
+        release(bookKey);
+        released.push_back(bookKey);
+      } else {
+        cancel(userHandle, bookKey);
+      }
+    }
+    return released;
+  }
+};
@@ -1,145 +1,285 @@
 #pragma once
-#include <chrono>
-#include <ctime>
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <optional>
+#include <queue>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
+#include "Analytics/Circulation.hpp"
 #include "Books.hpp"
+#include "BorrowHistory.hpp"
+#include "Clock.hpp"
+#include "Dates.hpp"
+#include "Diagnostics/MemoryAccounting.hpp"
+#include "Diagnostics/Metrics.hpp"
+#include "Diagnostics/Tracing.hpp"
+#include "Fines.hpp"
+#include "Holds.hpp"
+#include "Search/Bitmap.hpp"
+#include "Search/FuzzyIndex.hpp"
+#include "Search/ImpactIndex.hpp"
+#include "Search/OrderedIndex.hpp"
+#include "Search/PrefixIndex.hpp"
+#include "Search/Query.hpp"
 #include "Sequence/Sequence.hpp"
+#include "Snapshot.hpp"
 #include "Users.hpp"
 
-enum class UserType { STUDENT, FACULTY, GUEST };
-
-class BorrowingRecord {
- private:
-  std::string userId;
-  std::string bookId;
-  std::chrono::steady_clock::time_point borrowDate;
-  std::chrono::steady_clock::time_point dueDate;
-  bool returned;
-
- public:
-  BorrowingRecord(const std::string& userId, const std::string& bookId,
-                  int borrowDays = 14)
-      : userId(userId), bookId(bookId), returned(false) {
-    borrowDate = std::chrono::steady_clock::now();
-    dueDate = borrowDate + std::chrono::hours(24 * borrowDays);
-  }
+// Поля книги, по которым сработал запрос (битовая маска)
+enum MatchField : unsigned {
+  MATCH_NONE = 0,
+  MATCH_ISBN = 1u << 0,
+  MATCH_TITLE = 1u << 1,
+  MATCH_AUTHOR = 1u << 2,
+  MATCH_GENRE = 1u << 3,
+};
 
-  ~BorrowingRecord() {}
+// Ссылка на книгу в каталоге, без копирования. Действительна, пока не
+// изменился каталог (см. SearchResults::generation).
+struct SearchMatch {
+  const Book* book;
+  unsigned fields;
+  // Релевантность; заполняется только ранжированным поиском
+  int score;
 
-  std::string getUserId() const { return userId; }
-  std::string getBookId() const { return bookId; }
+  SearchMatch() : book(nullptr), fields(MATCH_NONE), score(0) {}
+  SearchMatch(const Book* book, unsigned fields, int score = 0)
+      : book(book), fields(fields), score(score) {}
 
-  std::string getBorrowDateStr() const {
-    auto systemTime = std::chrono::system_clock::now() +
-                      (borrowDate - std::chrono::steady_clock::now());
-    std::time_t time = std::chrono::system_clock::to_time_t(systemTime);
+  bool matched(unsigned field) const { return (fields & field) != 0; }
+};
 
-    char buffer[26];
-    ctime_r(&time, buffer);
-    buffer[24] = '\0';
-    return std::string(buffer);
-  }
+// Порядок ранжированной выдачи: по убыванию score, при равенстве - по
+// названию
+inline bool betterMatch(const SearchMatch& a, const SearchMatch& b) {
+  if (a.score != b.score) return a.score > b.score;
+  return a.book->getTitle() < b.book->getTitle();
+}
 
-  std::string getDueDateStr() const {
-    auto systemTime = std::chrono::system_clock::now() +
-                      (dueDate - std::chrono::steady_clock::now());
-    std::time_t time = std::chrono::system_clock::to_time_t(systemTime);
+struct SearchResults {
+  Sequence<SearchMatch>* matches;
+  // Поколение каталога на момент поиска
+  unsigned long generation;
+  // Копии книг, на которые ссылаются совпадения после ownBooks; пусто,
+  // если ссылки ведут в каталог. Список: splice не меняет адреса книг.
+  std::list<Book> ownedBooks;
 
-    char buffer[26];
-    ctime_r(&time, buffer);
-    buffer[24] = '\0';
-    return std::string(buffer);
-  }
+  SearchResults(unsigned long generation = 0)
+      : matches(new MutableArraySequence<SearchMatch>()),
+        generation(generation) {}
 
-  std::chrono::steady_clock::time_point getDueDate() const { return dueDate; }
+  ~SearchResults() { delete matches; }
 
-  bool isReturned() const { return returned; }
-  void markReturned() { returned = true; }
+  SearchResults(const SearchResults&) = delete;
+  SearchResults& operator=(const SearchResults&) = delete;
 
-  static std::chrono::steady_clock::time_point now() {
-    return std::chrono::steady_clock::now();
-  }
+  size_t totalCount() const { return matches->GetLength(); }
 
-  bool isOverdue() const {
-    return !returned && std::chrono::steady_clock::now() > dueDate;
+  size_t countByField(unsigned field) const {
+    size_t count = 0;
+    for (int i = 0; i < matches->GetLength(); ++i) {
+      if (matches->Get(i).matched(field)) ++count;
+    }
+    return count;
   }
 
-  int getDaysOverdue() const {
-    if (!isOverdue()) return 0;
+  bool isEmpty() const { return matches->GetLength() == 0; }
 
-    auto now = std::chrono::steady_clock::now();
-    auto overdueDuration = now - dueDate;
-    return std::chrono::duration_cast<std::chrono::hours>(overdueDuration)
-               .count() /
-           24;
+  // Перевести совпадения на копии книг: результат перестаёт зависеть от
+  // каталога. Вызывается, пока каталог ещё не могут изменить.
+  void ownBooks() {
+    for (int i = 0; i < matches->GetLength(); ++i) {
+      SearchMatch& match = matches->Get(i);
+      ownedBooks.push_back(*match.book);
+      match.book = &ownedBooks.back();
+    }
   }
 };
 
-struct SearchResults {
-  Sequence<Book>* byAuthor;
-  Sequence<Book>* byTitle;
-  Sequence<Book>* byGenre;
-  Sequence<Book>* byISBN;
+// Порядок листинга каталога. CATALOG - по номерам книг (в порядке
+// первого появления ISBN), остальные - по полю без учёта регистра, при
+// равенстве по ISBN.
+enum class BookOrder { CATALOG, TITLE, AUTHOR, ISBN };
+
+// Страница листинга: ссылки на живые книги (пользователей), без копий.
+// Ссылки на книги действительны, пока не изменился каталог (см.
+// generation: поколение каталога у книг, пользователей - у читателей).
+// nextToken продолжает листинг со следующей страницы; пустой - страниц
+// больше нет.
+template <typename T>
+struct ListingPage {
+  Sequence<T>* items;
+  std::string nextToken;
+  unsigned long generation;
+
+  ListingPage(unsigned long generation = 0)
+      : items(new MutableArraySequence<T>()), generation(generation) {}
+
+  ~ListingPage() { delete items; }
+
+  ListingPage(const ListingPage&) = delete;
+  ListingPage& operator=(const ListingPage&) = delete;
+};
 
-  SearchResults()
-      : byAuthor(new MutableListSequence<Book>()),
-        byTitle(new MutableListSequence<Book>()),
-        byGenre(new MutableListSequence<Book>()),
-        byISBN(new MutableListSequence<Book>()) {}
+// Точный фильтр по каталогу; пустое поле ничего не ограничивает.
+// Жанр и автор сравниваются без учёта регистра и лишних пробелов.
+struct BookFilter {
+  std::string genre;
+  std::string author;
+  bool availableOnly;
+
+  BookFilter() : availableOnly(false) {}
+  BookFilter(const std::string& genre, const std::string& author,
+             bool availableOnly)
+      : genre(genre), author(author), availableOnly(availableOnly) {}
+};
 
-  ~SearchResults() {
-    delete byAuthor;
-    delete byTitle;
-    delete byGenre;
-    delete byISBN;
-  }
+// Значение поля и число книг с ним
+struct Facet {
+  std::string value;
+  size_t count;
 
-  size_t totalCount() const {
-    return byAuthor->GetLength() + byTitle->GetLength() + byGenre->GetLength() +
-           byISBN->GetLength();
-  }
-
-  bool isEmpty() const {
-    return byAuthor->GetLength() == 0 && byTitle->GetLength() == 0 &&
-           byGenre->GetLength() == 0 && byISBN->GetLength() == 0;
-  }
+  Facet() : count(0) {}
+  Facet(const std::string& value, size_t count) : value(value), count(count) {}
 };
 
+// Общие операции Library и ShardedLibrary. getBook/getUser и строки
+// записей истории отдают копии: у ShardedLibrary книги и читатели живут
+// в шарде, который после возврата из вызова меняют другие потоки; её
+// результаты поиска держат копии книг (SearchResults::ownedBooks). Сама
+// Library отдаёт и ссылки (findBook, findUser, getAllBooks, getAllUsers).
 class LibraryOperations {
  public:
   virtual bool addBook(const std::string& title, const std::string& author,
                        const std::string& isbn, const std::string& genre) = 0;
   virtual bool removeBook(const std::string& isbn) = 0;
-  virtual Book findBook(const std::string& isbn) = 0;
+  virtual std::optional<Book> getBook(const std::string& isbn) = 0;
   virtual SearchResults* searchBooks(const std::string& query) = 0;
-  virtual Sequence<Book>* getAllBooks() = 0;
+  virtual SearchResults* searchBooks(const std::string& query, int k) = 0;
 
   virtual bool registerUser(const std::string& name, const std::string& userId,
                             const std::string& email, UserType type) = 0;
   virtual bool registerUser(LibraryUser* user) = 0;
   virtual bool removeUser(const std::string& userId) = 0;
-  virtual LibraryUser* findUser(const std::string& userId) = 0;
-  virtual Sequence<LibraryUser*>* getAllUsers() = 0;
+  virtual std::optional<LibraryUser> getUser(const std::string& userId) = 0;
 
   virtual bool borrowBook(const std::string& userId,
                           const std::string& isbn) = 0;
   virtual bool returnBook(const std::string& userId,
                           const std::string& isbn) = 0;
   virtual Sequence<BorrowingRecord>* getOverdueBooks() = 0;
-  virtual Sequence<BorrowingRecord>* getBorrowHistory() = 0;
+  virtual HistoryCursor getBorrowHistory() = 0;
+
+  virtual std::string getRecordUserId(const BorrowingRecord& record) = 0;
+  virtual std::string getRecordBookId(const BorrowingRecord& record) = 0;
 
   virtual ~LibraryOperations() {};
 };
 
+// Первая строка публичной операции Library: трасса, подсистема учёта
+// памяти и замер operation (см. Library::OperationTimer)
+#define LIBRARY_OPERATION(op)              \
+  TRACE_SCOPE(metricOpName(op));           \
+  MEMORY_SCOPE(Library::memoryTagFor(op)); \
+  OperationTimer operation(op)
+
 class Library : public LibraryOperations {
  private:
-  std::unordered_map<std::string, Book>* books;
-  std::unordered_map<std::string, LibraryUser*>* users;
+  // Память каталога, пользователей и индексов считается по своим тегам
+  using BookMap = TaggedMap<std::string, Book, MemoryTag::CATALOG>;
+  using HandleMap = TaggedMap<std::string, uint32_t, MemoryTag::USERS>;
+  using OrdinalMap = TaggedMap<std::string, uint32_t, MemoryTag::INDEXES>;
+  using BitmapIndex =
+      TaggedMap<std::string, RoaringBitmap, MemoryTag::INDEXES>;
+
+  BookMap* books;
+  // userId -> номер в хранилище пользователей; номер закреплён за userId
+  // навсегда, удалённый пользователь в хранилище только деактивируется
+  HandleMap* userHandles;
+  UserSlab* users;
+
+  BorrowHistory* borrowHistory;
+  DateCache* dateCache;
+  CirculationStats* circulation;
+  FineEngine* fines;
+  HoldBook* holds;
+  HoldHandoff holdHandoff;
+  // Часы библиотеки; свои удаляются в деструкторе, чужие - нет
+  Clock* clock;
+  bool ownsClock;
+
+  // Слова названий и авторов для поиска с опечатками
+  FuzzyIndex<const Book*>* fuzzyIndex;
+  // Слова и целые названия/авторы для подсказок при вводе; вес - сколько
+  // раз ключ встречается в каталоге
+  PrefixIndex* prefixIndex;
+
+  // Плотные номера книг для битовых индексов. Номер закреплён за ISBN
+  // навсегда: удалённая и снова добавленная книга получит прежний.
+  OrdinalMap* bookOrdinals;
+  IndexVector<std::string>* isbnByOrdinal;
+  // nullptr - книги с этим номером сейчас нет в каталоге
+  IndexVector<const Book*>* bookByOrdinal;
+
+  // Нормализованный жанр/автор/название -> номера книг
+  BitmapIndex* genreIndex;
+  BitmapIndex* authorIndex;
+  BitmapIndex* titleIndex;
+  RoaringBitmap* catalogBooks;
+  RoaringBitmap* availableBooks;
+
+  // Ключ книги с номером ordinal для упорядоченного индекса: поле order,
+  // при равенстве ISBN
+  struct BookKeys {
+    const IndexVector<const Book*>* books;
+    BookOrder order;
+
+    OrderedKey operator()(uint32_t ordinal) const {
+      const Book& book = *(*books)[ordinal];
+      return {&orderKey(book, order), &book.getISBN()};
+    }
+  };
+  using BookOrderIndex = OrderedIndex<BookKeys>;
 
-  Sequence<BorrowingRecord>* borrowHistory;
+  // Номера книг каталога по названию, автору и ISBN
+  BookOrderIndex* titleOrder;
+  BookOrderIndex* authorOrder;
+  BookOrderIndex* isbnOrder;
+
+  // Записи с равным вкладом в списках слов идут по названию, как в
+  // betterMatch
+  struct TitleBefore {
+    const IndexVector<const Book*>* books;
+
+    bool operator()(uint32_t a, uint32_t b) const {
+      return (*books)[a]->getTitle() < (*books)[b]->getTitle();
+    }
+  };
+  using WordIndex = ImpactIndex<TitleBefore>;
+
+  // Слова названий, авторов и жанров -> книги по вкладу слова в
+  // релевантность: по весу полей со словом и по надбавке за фразу с
+  // этого слова (см. wordImpacts)
+  WordIndex* wordIndex;
+  WordIndex* phraseIndex;
+
+  // Растёт при каждом добавлении/удалении книги: ссылки на книги,
+  // выданные раньше, после этого могут стать недействительными
+  unsigned long catalogGeneration;
+  // То же для пользователей: растёт при регистрации и удалении
+  unsigned long usersGeneration;
+
+  // Версии каталога и пользователей для снимков (см. Snapshot.hpp);
+  // nullptr, когда живых снимков нет
+  LibraryVersions* versions;
+  // Метка живых снимков; истекла - версии больше никто не читает
+  std::weak_ptr<SnapshotLease> liveSnapshots;
 
   // Приблуды для поиска
 
@@ -149,204 +289,1676 @@ class Library : public LibraryOperations {
     return result;
   }
 
-  bool containsWord(const std::string& text, const std::string& word) {
-    std::string lowerText = toLower(text);
-    std::string lowerWord = toLower(word);
-    return lowerText.find(lowerWord) != std::string::npos;
+  std::string toUpper(const std::string& str) {
+    std::string result = str;
+    std::transform(result.begin(), result.end(), result.begin(), ::toupper);
+    return result;
+  }
+
+  static char lowerChar(char c) {
+    return static_cast<char>(::tolower(static_cast<unsigned char>(c)));
+  }
+
+  // lowerWord уже должен быть в нижнем регистре: text не копируется
+  static size_t findWord(const std::string& text,
+                         const std::string& lowerWord) {
+    auto it = std::search(
+        text.begin(), text.end(), lowerWord.begin(), lowerWord.end(),
+        [](char a, char b) { return lowerChar(a) == b; });
+    return it == text.end() ? std::string::npos : it - text.begin();
+  }
+
+  static bool containsWord(const std::string& text,
+                           const std::string& lowerWord) {
+    return findWord(text, lowerWord) != std::string::npos;
+  }
+
+  // normalizeText(text) == normalized, без построения копии text
+  static bool exactMatch(const std::string& text,
+                         const std::string& normalized) {
+    size_t j = 0;
+    bool gap = false;
+    for (char c : text) {
+      unsigned char u = static_cast<unsigned char>(c);
+      if (!std::isalnum(u) && u < 0x80) {
+        gap = true;
+        continue;
+      }
+      if (gap && j > 0 && (j == normalized.size() || normalized[j++] != ' ')) {
+        return false;
+      }
+      gap = false;
+      if (j == normalized.size() || normalized[j++] != lowerChar(c)) {
+        return false;
+      }
+    }
+    return j == normalized.size();
+  }
+
+  // Ранжирование: вес поля (ISBN > title > author > genre), доля слов
+  // запроса, найденных в поле, и место фразы запроса среди слов поля.
+  // Слова - как у tokenizeWords, совпадают только целиком.
+  static constexpr int kIsbnWeight = 1000;
+  static constexpr int kTitleWeight = 400;
+  static constexpr int kAuthorWeight = 300;
+  static constexpr int kGenreWeight = 100;
+
+  // Больше этого поле с весом weight дать не может
+  static int maxFieldScore(int weight) { return 2 * weight; }
+
+  // Надбавка поля из count слов, если фраза запроса начинается с его
+  // слова at: чем раньше, тем больше
+  static int phraseBonus(int weight, size_t at, size_t count) {
+    return weight / 2 * static_cast<int>(count - at) /
+           static_cast<int>(count);
+  }
+
+  // phrase - слова запроса по порядку, tokens - они же без повторов
+  static int scoreField(const std::string& text,
+                        const std::vector<std::string>& phrase,
+                        const std::vector<std::string>& tokens, int weight) {
+    std::vector<std::string> words = tokenizeWords(text);
+    int matchedTokens = 0;
+    for (const auto& token : tokens) {
+      if (std::find(words.begin(), words.end(), token) != words.end()) {
+        ++matchedTokens;
+      }
+    }
+    if (matchedTokens == 0) return 0;
+
+    int score = weight * matchedTokens / static_cast<int>(tokens.size());
+    auto at = std::search(words.begin(), words.end(), phrase.begin(),
+                          phrase.end());
+    if (at != words.end()) {
+      score += phraseBonus(weight, at - words.begin(), words.size());
+      if (words.size() == phrase.size()) score += weight / 2;
+    }
+    return score;
+  }
+
+  struct WordImpact {
+    std::string word;
+    // Сумма весов полей, где есть слово
+    uint32_t fields;
+    // Сумма надбавок за фразу с первого вхождения слова в эти поля
+    uint32_t phrase;
+  };
+
+  // Вклады слов книги. Каждое слово запроса даёт книге не больше
+  // fields / tokens.size(), первое - ещё не больше phrase (см.
+  // searchBooks(query, k)).
+  static std::vector<WordImpact> wordImpacts(const Book& book) {
+    std::vector<WordImpact> impacts;
+    const std::pair<const std::string*, int> fields[] = {
+        {&book.getTitle(), kTitleWeight},
+        {&book.getAuthor(), kAuthorWeight},
+        {&book.getGenre(), kGenreWeight}};
+    for (const auto& [text, weight] : fields) {
+      std::vector<std::string> words = tokenizeWords(*text);
+      for (size_t at = 0; at < words.size(); ++at) {
+        auto first = words.begin() + at;
+        if (std::find(words.begin(), first, *first) != first) continue;
+
+        auto it = std::find_if(
+            impacts.begin(), impacts.end(),
+            [&](const WordImpact& impact) { return impact.word == *first; });
+        if (it == impacts.end()) {
+          it = impacts.insert(impacts.end(), {*first, 0, 0});
+        }
+        it->fields += weight;
+        it->phrase += phraseBonus(weight, at, words.size());
+      }
+    }
+    return impacts;
+  }
+
+  uint32_t ordinalFor(const std::string& isbn) {
+    auto it = bookOrdinals->find(isbn);
+    if (it != bookOrdinals->end()) return it->second;
+
+    uint32_t ordinal = static_cast<uint32_t>(isbnByOrdinal->size());
+    bookOrdinals->insert({isbn, ordinal});
+    isbnByOrdinal->push_back(isbn);
+    bookByOrdinal->push_back(nullptr);
+    return ordinal;
+  }
+
+  static void removeFromIndex(BitmapIndex& index, const std::string& key,
+                              uint32_t ordinal) {
+    auto it = index.find(key);
+    if (it == index.end()) return;
+
+    it->second.remove(ordinal);
+    if (it->second.isEmpty()) index.erase(it);
+  }
+
+  void indexBook(const Book& book) {
+    uint32_t ordinal = ordinalFor(book.getISBN());
+    (*bookByOrdinal)[ordinal] = &book;
+    versionBook(ordinal);
+    catalogBooks->add(ordinal);
+    titleOrder->insert(ordinal);
+    authorOrder->insert(ordinal);
+    isbnOrder->insert(ordinal);
+    for (const WordImpact& impact : wordImpacts(book)) {
+      wordIndex->add(impact.word, ordinal, impact.fields);
+      phraseIndex->add(impact.word, ordinal, impact.phrase);
+    }
+    if (book.isAvailable()) availableBooks->add(ordinal);
+    (*genreIndex)[normalizeText(book.getGenre())].add(ordinal);
+    (*authorIndex)[normalizeText(book.getAuthor())].add(ordinal);
+    (*titleIndex)[normalizeText(book.getTitle())].add(ordinal);
+
+    fuzzyIndex->add(&book, book.getTitle(), MATCH_TITLE);
+    fuzzyIndex->add(&book, book.getAuthor(), MATCH_AUTHOR);
+    for (const std::string* text : {&book.getTitle(), &book.getAuthor()}) {
+      prefixIndex->add(normalizeText(*text));
+      for (const std::string& word : tokenizeWords(*text)) {
+        prefixIndex->add(word);
+      }
+    }
+  }
+
+  void unindexBook(const Book& book) {
+    uint32_t ordinal = bookOrdinals->at(book.getISBN());
+    // Ключи в индексах берутся по номеру, пока книга ещё на месте
+    titleOrder->erase(ordinal);
+    authorOrder->erase(ordinal);
+    isbnOrder->erase(ordinal);
+    for (const WordImpact& impact : wordImpacts(book)) {
+      wordIndex->remove(impact.word, ordinal, impact.fields);
+      phraseIndex->remove(impact.word, ordinal, impact.phrase);
+    }
+    (*bookByOrdinal)[ordinal] = nullptr;
+    versionBook(ordinal);
+    catalogBooks->remove(ordinal);
+    availableBooks->remove(ordinal);
+    removeFromIndex(*genreIndex, normalizeText(book.getGenre()), ordinal);
+    removeFromIndex(*authorIndex, normalizeText(book.getAuthor()), ordinal);
+    removeFromIndex(*titleIndex, normalizeText(book.getTitle()), ordinal);
+
+    fuzzyIndex->remove(&book, book.getTitle(), MATCH_TITLE);
+    fuzzyIndex->remove(&book, book.getAuthor(), MATCH_AUTHOR);
+    for (const std::string* text : {&book.getTitle(), &book.getAuthor()}) {
+      prefixIndex->remove(normalizeText(*text));
+      for (const std::string& word : tokenizeWords(*text)) {
+        prefixIndex->remove(word);
+      }
+    }
+  }
+
+  // Битмапы условий фильтра, от самого маленького к большому
+  std::vector<const RoaringBitmap*> filterBitmaps(const BookFilter& filter) {
+    static const RoaringBitmap empty;
+    std::vector<const RoaringBitmap*> bitmaps;
+    bitmaps.push_back(filter.availableOnly ? availableBooks : catalogBooks);
+
+    const std::pair<const std::string*, BitmapIndex*> conditions[] = {
+        {&filter.genre, genreIndex}, {&filter.author, authorIndex}};
+    for (const auto& [value, index] : conditions) {
+      if (value->empty()) continue;
+
+      auto it = index->find(normalizeText(*value));
+      bitmaps.push_back(it == index->end() ? &empty : &it->second);
+    }
+
+    std::sort(bitmaps.begin(), bitmaps.end(),
+              [](const RoaringBitmap* a, const RoaringBitmap* b) {
+                return a->cardinality() < b->cardinality();
+              });
+    return bitmaps;
+  }
+
+  Sequence<Facet>* facets(const BitmapIndex& index, bool availableOnly) {
+    std::vector<Facet> counts;
+    for (const auto& [value, bitmap] : index) {
+      size_t count = availableOnly ? bitmap.andCardinality(*availableBooks)
+                                   : bitmap.cardinality();
+      if (count > 0) counts.push_back(Facet(value, count));
+    }
+    std::sort(counts.begin(), counts.end(), [](const Facet& a, const Facet& b) {
+      if (a.count != b.count) return a.count > b.count;
+      return a.value < b.value;
+    });
+
+    Sequence<Facet>* result = new MutableArraySequence<Facet>();
+    for (const Facet& facet : counts) {
+      result->Append(facet);
+    }
+    return result;
+  }
+
+  // Оценки селективности для предикатов без индекса
+  static constexpr double kEqualsSelectivity = 0.01;
+  static constexpr double kContainsSelectivity = 0.1;
+  static constexpr double kRangeSelectivity = 0.3;
+
+  // Предикат, который можно вычислить по индексу. План сначала только
+  // считает, сколько книг он пропустит: у диапазона - разность rank
+  // границ, у битмапа - cardinality, ничего не выбирая.
+  struct IndexedPredicate {
+    const QueryPredicate* predicate;
+    std::string access;
+    // Сколько книг проходит предикат
+    size_t rows;
+    // Отрезок [from, to) упорядоченного индекса; nullptr - не диапазон
+    const BookOrderIndex* index;
+    size_t from;
+    size_t to;
+    // Битмап индекса; nullptr - множество в owned. complement - предикат
+    // проходят книги каталога вне битмапа.
+    const RoaringBitmap* shared;
+    RoaringBitmap owned;
+    bool complement;
+
+    const RoaringBitmap& bitmap() const { return shared ? *shared : owned; }
+  };
+
+  bool planIndexed(const QueryPredicate& predicate, IndexedPredicate& step) {
+    static const RoaringBitmap empty;
+    step.predicate = &predicate;
+    step.index = nullptr;
+    step.shared = nullptr;
+    step.complement = false;
+
+    // Диапазоны - отрезком упорядоченного индекса. Точное название
+    // сравнивается по normalizeText, а дерево упорядочено по названию
+    // как есть, поэтому оно идёт по битмапу нормализованных названий.
+    if (predicate.isRange()) {
+      const BookOrderIndex* index = orderIndex(fieldOrder(predicate.field));
+      if (index == nullptr) return false;
+
+      step.access = "BTREE RANGE";
+      step.index = index;
+      rangeBounds(*index, predicate, step.from, step.to);
+      step.rows = step.from < step.to ? step.to - step.from : 0;
+      return true;
+    }
+    if (predicate.op != QueryOp::EQUALS) return false;
+    switch (predicate.field) {
+      case QueryField::ISBN: {
+        step.access = "HASH LOOKUP";
+        for (const std::string& key :
+             {predicate.value, toUpper(predicate.value)}) {
+          if (books->find(key) != books->end()) {
+            step.owned.add(bookOrdinals->at(key));
+            break;
+          }
+        }
+        step.rows = step.owned.cardinality();
+        return true;
+      }
+      case QueryField::TITLE:
+      case QueryField::AUTHOR:
+      case QueryField::GENRE: {
+        auto& index = predicate.field == QueryField::TITLE    ? *titleIndex
+                      : predicate.field == QueryField::AUTHOR ? *authorIndex
+                                                              : *genreIndex;
+        auto it = index.find(normalizeText(predicate.value));
+        step.access = "BITMAP";
+        step.shared = it == index.end() ? &empty : &it->second;
+        step.rows = step.shared->cardinality();
+        return true;
+      }
+      case QueryField::AVAILABLE:
+        step.access = "BITMAP";
+        step.shared = availableBooks;
+        step.complement = !predicate.availableValue();
+        step.rows = step.complement ? catalogBooks->cardinality() -
+                                          availableBooks->cardinality()
+                                    : availableBooks->cardinality();
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Книги ведущего шага плана - только его и выбираем целиком
+  RoaringBitmap materialize(const IndexedPredicate& step) {
+    if (step.index != nullptr) {
+      // Номера идут в порядке ключей; в битмап - по возрастанию, так блоки-
+      // массивы заполняются без сдвигов
+      std::vector<uint32_t> ordinals;
+      ordinals.reserve(step.rows);
+      BookOrderIndex::Cursor cursor = step.index->at(step.from);
+      for (size_t i = step.from; i < step.to; ++i, cursor.next()) {
+        ordinals.push_back(cursor.ordinal());
+      }
+      std::sort(ordinals.begin(), ordinals.end());
+      RoaringBitmap rows;
+      for (uint32_t ordinal : ordinals) rows.add(ordinal);
+      return rows;
+    }
+    if (step.complement) return *catalogBooks - step.bitmap();
+    return step.bitmap();
+  }
+
+  // Проверка остальных индексных предикатов на отобранной книге: битмап -
+  // поиском номера, диапазон - сравнением поля, как в evaluate. value -
+  // predicate.value после filterValue.
+  bool passes(const IndexedPredicate& step, uint32_t ordinal,
+              const Book& book, const std::string& value) {
+    if (step.index != nullptr) {
+      return evaluate(*step.predicate, book, value) != MATCH_NONE;
+    }
+    return step.bitmap().contains(ordinal) != step.complement;
   }
 
-  bool exactMatch(const std::string& text, const std::string& word) {
-    return toLower(text) == toLower(word);
+  // Порядок, в котором упорядочен индекс поля; CATALOG - индекса нет
+  static BookOrder fieldOrder(QueryField field) {
+    switch (field) {
+      case QueryField::TITLE:
+        return BookOrder::TITLE;
+      case QueryField::AUTHOR:
+        return BookOrder::AUTHOR;
+      case QueryField::ISBN:
+        return BookOrder::ISBN;
+      default:
+        return BookOrder::CATALOG;
+    }
   }
 
+  // Отрезок [from, to) индекса, ключи которого проходят диапазон
+  // predicate: два спуска по дереву
+  static void rangeBounds(const BookOrderIndex& index,
+                          const QueryPredicate& predicate, size_t& from,
+                          size_t& to) {
+    from = 0;
+    to = index.size();
+    switch (predicate.op) {
+      case QueryOp::LESS:
+        to = index.rank(predicate.value);
+        break;
+      case QueryOp::LESS_EQUAL:
+        to = index.rank(predicate.value, true);
+        break;
+      case QueryOp::GREATER:
+        from = index.rank(predicate.value, true);
+        break;
+      case QueryOp::GREATER_EQUAL:
+        from = index.rank(predicate.value);
+        break;
+      default:
+        from = index.rank(predicate.value);
+        to = index.rank(predicate.value, true);
+    }
+  }
+
+  // Значение предиката для evaluate: точное совпадение сравнивается, как
+  // в индексах названия, автора и жанра, по normalizeText; остальное - в
+  // нижнем регистре
+  std::string filterValue(const QueryPredicate& predicate) {
+    return predicate.op == QueryOp::EQUALS ? normalizeText(predicate.value)
+                                           : toLower(predicate.value);
+  }
+
+  // Проверка предиката без индекса; возвращает совпавшие поля. value -
+  // predicate.value после filterValue.
+  unsigned evaluate(const QueryPredicate& predicate, const Book& book,
+                    const std::string& value) {
+    auto test = [&](const std::string& text) {
+      switch (predicate.op) {
+        case QueryOp::EQUALS:
+          return exactMatch(text, value);
+        case QueryOp::CONTAINS:
+          return containsWord(text, value);
+        default:
+          return predicate.acceptsOrder(compareFolded(text, value));
+      }
+    };
+
+    switch (predicate.field) {
+      case QueryField::TITLE:
+        return test(book.getTitle()) ? MATCH_TITLE : MATCH_NONE;
+      case QueryField::AUTHOR:
+        return test(book.getAuthor()) ? MATCH_AUTHOR : MATCH_NONE;
+      case QueryField::GENRE:
+        return test(book.getGenre()) ? MATCH_GENRE : MATCH_NONE;
+      case QueryField::ISBN:
+        return test(book.getISBN()) ? MATCH_ISBN : MATCH_NONE;
+      case QueryField::ANY: {
+        unsigned fields = MATCH_NONE;
+        if (test(book.getTitle())) fields |= MATCH_TITLE;
+        if (test(book.getAuthor())) fields |= MATCH_AUTHOR;
+        if (test(book.getGenre())) fields |= MATCH_GENRE;
+        if (test(book.getISBN())) fields |= MATCH_ISBN;
+        return fields;
+      }
+      default:
+        return MATCH_NONE;
+    }
+  }
+
+  static unsigned fieldMask(QueryField field) {
+    switch (field) {
+      case QueryField::TITLE:
+        return MATCH_TITLE;
+      case QueryField::AUTHOR:
+        return MATCH_AUTHOR;
+      case QueryField::GENRE:
+        return MATCH_GENRE;
+      case QueryField::ISBN:
+        return MATCH_ISBN;
+      default:
+        return MATCH_NONE;
+    }
+  }
+
+  // Порядок выдачи: по убыванию score, при равенстве по названию
+  Sequence<BorrowingRecord>* historyPage(HistoryKey by, uint32_t key,
+                                         int32_t fromDay, int32_t toDay,
+                                         size_t offset, size_t limit) {
+    std::vector<BorrowingRecord> records =
+        borrowHistory->query(by, key, fromDay, toDay, offset, limit);
+    return new MutableArraySequence<BorrowingRecord>(
+        records.data(), static_cast<int>(records.size()));
+  }
+
+  // Токен листинга по номерам - номер, с которого продолжать
+  static bool parseOrdinalToken(const std::string& token, uint32_t& next) {
+    next = 0;
+    if (token.size() > 9) return false;
+    for (char c : token) {
+      if (c < '0' || c > '9') return false;
+      next = next * 10 + static_cast<uint32_t>(c - '0');
+    }
+    return true;
+  }
+
+  static const std::string& orderKey(const Book& book, BookOrder order) {
+    switch (order) {
+      case BookOrder::TITLE:
+        return book.getTitle();
+      case BookOrder::AUTHOR:
+        return book.getAuthor();
+      default:
+        return book.getISBN();
+    }
+  }
+
+  BookOrderIndex* orderIndex(BookOrder order) {
+    switch (order) {
+      case BookOrder::TITLE:
+        return titleOrder;
+      case BookOrder::AUTHOR:
+        return authorOrder;
+      case BookOrder::ISBN:
+        return isbnOrder;
+      default:
+        return nullptr;
+    }
+  }
+
+  ListingPage<const Book*>* catalogPage(const std::string& token,
+                                        size_t pageSize) {
+    uint32_t ordinal;
+    if (!parseOrdinalToken(token, ordinal)) return nullptr;
+
+    ListingPage<const Book*>* page =
+        new ListingPage<const Book*>(catalogGeneration);
+    size_t taken = 0;
+    for (; ordinal < bookByOrdinal->size(); ++ordinal) {
+      const Book* book = (*bookByOrdinal)[ordinal];
+      if (book == nullptr) continue;
+      if (taken == pageSize) {
+        page->nextToken = std::to_string(ordinal);
+        break;
+      }
+      page->items->Append(book);
+      ++taken;
+    }
+    return page;
+  }
+
+  // Страница по упорядоченному индексу: спуск к ключу токена (ключ '\0'
+  // ISBN) за O(log n) и pageSize шагов по листьям
+  ListingPage<const Book*>* keyedPage(const std::string& token,
+                                      size_t pageSize, BookOrder order) {
+    const BookOrderIndex* index = orderIndex(order);
+    BookOrderIndex::Cursor cursor = index->begin();
+    if (!token.empty()) {
+      size_t split = token.rfind('\0');
+      if (split == std::string::npos) return nullptr;
+      cursor =
+          index->seekAfter(token.substr(0, split), token.substr(split + 1));
+    }
+    return pageFrom(cursor, pageSize, order);
+  }
+
+  ListingPage<const Book*>* pageFrom(BookOrderIndex::Cursor cursor,
+                                     size_t pageSize, BookOrder order) {
+    ListingPage<const Book*>* page =
+        new ListingPage<const Book*>(catalogGeneration);
+    const Book* last = nullptr;
+    for (size_t taken = 0; cursor.valid() && taken < pageSize; ++taken) {
+      last = (*bookByOrdinal)[cursor.ordinal()];
+      page->items->Append(last);
+      cursor.next();
+    }
+    if (cursor.valid()) {
+      page->nextToken = orderKey(*last, order) + '\0' + last->getISBN();
+    }
+    return page;
+  }
+
+  // Выдать книгу; все проверки уже сделаны
+  void lend(LibraryUser& user, uint32_t handle, Book& book, uint32_t ordinal,
+            int32_t day) {
+    book.setAvailable(false);
+    availableBooks->remove(ordinal);
+    user.addBorrowed(ordinal);
+    versionBook(ordinal);
+    versionUser(handle);
+    BorrowingRecord record(handle, ordinal, day, user.getBorrowDays());
+    borrowHistory->append(record, day);
+    circulation->loanOpened(ordinal, book.getGenre(), user.getType(), day,
+                            record.getDueDay());
+    fines->loanOpened(handle, ordinal, record.getDueDay(),
+                      userPolicy(user.getType()));
+  }
+
+  // Книга освободилась: первому в очереди её выдают или откладывают
+  // (см. HoldHandoff), без очереди она возвращается на полку
+  void passOn(uint32_t ordinal, int32_t day) {
+    Book& book = books->at((*isbnByOrdinal)[ordinal]);
+    uint32_t next;
+    while (holds->popNext(ordinal, next)) {
+      if (!users->isActive(next)) continue;
+
+      LibraryUser& user = users->get(next);
+      if (holdHandoff == HoldHandoff::DIRECT && user.canBorrow()) {
+        lend(user, next, book, ordinal, day);
+      } else {
+        holds->reserve(ordinal, next, day + HoldBook::kPickupDays);
+      }
+      return;
+    }
+    book.setAvailable(true);
+    availableBooks->add(ordinal);
+    versionBook(ordinal);
+  }
+
+  // Истёкшие брони уходят следующим в очереди. Пока ничего не истекло,
+  // это одна проверка.
+  size_t expireHolds(int32_t day) {
+    return holds->expire(day, [&](uint32_t ordinal) { passOn(ordinal, day); });
+  }
+
+  // Версии нужны, пока жив хоть один снимок; после последнего они
+  // освобождаются при первом же изменении
+  bool versioning() {
+    if (versions != nullptr && liveSnapshots.expired()) {
+      delete versions;
+      versions = nullptr;
+    }
+    return versions != nullptr;
+  }
+
+  // Снимки видят книги и пользователей только через версии: после каждого
+  // изменения новое состояние копируется туда. Без снимков - ничего.
+  void versionBook(uint32_t ordinal) {
+    if (!versioning()) return;
+    if (ordinal == versions->catalog.size()) {
+      versions->catalog.push_back(CatalogSlot());
+    }
+    const Book* book = (*bookByOrdinal)[ordinal];
+    CatalogSlot& slot = versions->catalog.mutate(ordinal);
+    if (book != nullptr) slot.book = *book;
+    slot.present = book != nullptr;
+  }
+
+  void versionUser(uint32_t handle) {
+    if (!versioning()) return;
+    if (handle == versions->users.size()) {
+      versions->users.push_back(UserSlot());
+    }
+    versions->users.mutate(handle) =
+        UserSlot(users->get(handle), users->isActive(handle));
+  }
+
+  // Исход операции для метрик: успех и размер результата (-1 - нет)
+  static bool succeeded(bool result) { return result; }
+  static bool succeeded(const void* result) { return result != nullptr; }
+  static bool succeeded(std::nullptr_t) { return false; }
+  static int64_t resultSize(bool) { return -1; }
+  static int64_t resultSize(std::nullptr_t) { return -1; }
+  static int64_t resultSize(const Book*) { return -1; }
+  static int64_t resultSize(const SearchResults* results) {
+    return results != nullptr ? results->matches->GetLength() : -1;
+  }
+  template <typename T>
+  static int64_t resultSize(Sequence<T>* sequence) {
+    return sequence != nullptr ? sequence->GetLength() : -1;
+  }
+  template <typename T>
+  static int64_t resultSize(const ListingPage<T>* page) {
+    return page != nullptr ? page->items->GetLength() : -1;
+  }
+
+  // Подсистема, за которую считается память, выделенная операцией
+  static MemoryTag memoryTagFor(MetricOp op) {
+    switch (op) {
+      case MetricOp::ADD_BOOK:
+      case MetricOp::REMOVE_BOOK:
+      case MetricOp::FIND_BOOK:
+      case MetricOp::LIST:
+        return MemoryTag::CATALOG;
+      case MetricOp::REGISTER_USER:
+      case MetricOp::REMOVE_USER:
+        return MemoryTag::USERS;
+      case MetricOp::BORROW:
+      case MetricOp::RETURN:
+      case MetricOp::OVERDUE:
+      case MetricOp::HISTORY:
+      case MetricOp::HOLD:
+        return MemoryTag::HISTORY;
+      default:
+        return MemoryTag::SEARCH;
+    }
+  }
+
+#if LIBRARY_METRICS
+  // Замер операции (см. Diagnostics/Metrics.hpp) от LIBRARY_OPERATION до
+  // выхода из метода. Исход записывается в точке возврата:
+  // return operation.done(result). Выход без done (исключение) - неудача.
+  class OperationTimer {
+   private:
+    MetricsTimer timer;
+    bool finished;
+
+   public:
+    explicit OperationTimer(MetricOp op) : timer(op), finished(false) {}
+
+    ~OperationTimer() {
+      if (!finished) timer.finish(false);
+    }
+
+    template <typename T>
+    T done(T result) {
+      timer.finish(succeeded(result), resultSize(result));
+      finished = true;
+      return result;
+    }
+  };
+#else
+  // Без метрик замера нет, done просто возвращает результат
+  class OperationTimer {
+   public:
+    explicit OperationTimer(MetricOp) {}
+
+    template <typename T>
+    T done(T result) {
+      return result;
+    }
+  };
+#endif
+
+  // Наверху кучи - худшее совпадение в порядке betterMatch
+  struct WorseMatch {
+    bool operator()(const SearchMatch& a, const SearchMatch& b) const {
+      return betterMatch(a, b);
+    }
+  };
+
  public:
-  Library()
-      : books(new std::unordered_map<std::string, Book>()),
-        users(new std::unordered_map<std::string, LibraryUser*>()),
-        borrowHistory(new MutableListSequence<BorrowingRecord>()) {}
+  // clock == nullptr - настоящие системные часы
+  explicit Library(Clock* clock = nullptr)
+      : books(new BookMap()),
+        userHandles(new HandleMap()),
+        users(new UserSlab()),
+        borrowHistory(new BorrowHistory()),
+        dateCache(new DateCache()),
+        circulation(new CirculationStats()),
+        fines(new FineEngine()),
+        holds(new HoldBook()),
+        holdHandoff(HoldHandoff::RESERVE),
+        clock(clock != nullptr ? clock : new SystemClock()),
+        ownsClock(clock == nullptr),
+        fuzzyIndex(new FuzzyIndex<const Book*>()),
+        prefixIndex(new PrefixIndex()),
+        bookOrdinals(new OrdinalMap()),
+        isbnByOrdinal(new IndexVector<std::string>()),
+        bookByOrdinal(new IndexVector<const Book*>()),
+        genreIndex(new BitmapIndex()),
+        authorIndex(new BitmapIndex()),
+        titleIndex(new BitmapIndex()),
+        catalogBooks(new RoaringBitmap()),
+        availableBooks(new RoaringBitmap()),
+        titleOrder(new BookOrderIndex({bookByOrdinal, BookOrder::TITLE})),
+        authorOrder(new BookOrderIndex({bookByOrdinal, BookOrder::AUTHOR})),
+        isbnOrder(new BookOrderIndex({bookByOrdinal, BookOrder::ISBN})),
+        wordIndex(new WordIndex({bookByOrdinal})),
+        phraseIndex(new WordIndex({bookByOrdinal})),
+        catalogGeneration(0),
+        usersGeneration(0),
+        versions(nullptr) {}
 
   ~Library() {
     delete books;
+    delete userHandles;
     delete users;
     delete borrowHistory;
+    delete dateCache;
+    delete circulation;
+    delete fines;
+    delete holds;
+    if (ownsClock) delete clock;
+    delete fuzzyIndex;
+    delete prefixIndex;
+    delete bookOrdinals;
+    delete isbnByOrdinal;
+    delete bookByOrdinal;
+    delete genreIndex;
+    delete authorIndex;
+    delete titleIndex;
+    delete catalogBooks;
+    delete availableBooks;
+    delete titleOrder;
+    delete authorOrder;
+    delete isbnOrder;
+    delete wordIndex;
+    delete phraseIndex;
+    delete versions;
   }
 
   Library(std::unordered_map<std::string, Book>* books,
-          std::unordered_map<std::string, LibraryUser*>* users) {
-    this->books = books;
-    this->users = users;
+          std::unordered_map<std::string, LibraryUser*>* users,
+          Clock* clock = nullptr) {
+    // Книги переносятся в каталог с учётом памяти
+    this->books = new BookMap(books->begin(), books->end());
+    delete books;
+    this->userHandles = new HandleMap();
+    this->users = new UserSlab();
+    this->borrowHistory = new BorrowHistory();
+    this->dateCache = new DateCache();
+    this->circulation = new CirculationStats();
+    this->fines = new FineEngine();
+    this->holds = new HoldBook();
+    this->holdHandoff = HoldHandoff::RESERVE;
+    this->clock = clock != nullptr ? clock : new SystemClock();
+    this->ownsClock = clock == nullptr;
+    this->fuzzyIndex = new FuzzyIndex<const Book*>();
+    this->prefixIndex = new PrefixIndex();
+    this->bookOrdinals = new OrdinalMap();
+    this->isbnByOrdinal = new IndexVector<std::string>();
+    this->bookByOrdinal = new IndexVector<const Book*>();
+    this->genreIndex = new BitmapIndex();
+    this->authorIndex = new BitmapIndex();
+    this->titleIndex = new BitmapIndex();
+    this->catalogBooks = new RoaringBitmap();
+    this->availableBooks = new RoaringBitmap();
+    this->titleOrder = new BookOrderIndex({bookByOrdinal, BookOrder::TITLE});
+    this->authorOrder = new BookOrderIndex({bookByOrdinal, BookOrder::AUTHOR});
+    this->isbnOrder = new BookOrderIndex({bookByOrdinal, BookOrder::ISBN});
+    this->wordIndex = new WordIndex({bookByOrdinal});
+    this->phraseIndex = new WordIndex({bookByOrdinal});
+    this->catalogGeneration = 0;
+    this->usersGeneration = 0;
+    this->versions = nullptr;
+    for (const auto& [isbn, book] : *this->books) {
+      indexBook(book);
+      circulation->bookAdded(book.getGenre());
+    }
+    // Пользователи копируются в своё хранилище, переданные объекты
+    // удаляются вместе с картой
+    for (const auto& [userId, user] : *users) {
+      registerUser(user);
+      delete user;
+    }
+    delete users;
   }
 
   // поиск по запросу
 
-  SearchResults* searchBooks(const std::string& query) {
-    SearchResults* results = new SearchResults();
+  virtual SearchResults* searchBooks(const std::string& query) override {
+    LIBRARY_OPERATION(MetricOp::SEARCH);
+    SearchResults* results = new SearchResults(catalogGeneration);
 
     if (query.empty()) {
-      return results;
+      return operation.done(results);
     }
 
     std::string lowerQuery = toLower(query);
+    std::string normalizedQuery = normalizeText(query);
 
     for (const auto& pair : *books) {
       const Book& book = pair.second;
 
-      if (exactMatch(book.getISBN(), lowerQuery)) {
-        results->byISBN->Append(book);
+      if (exactMatch(book.getISBN(), normalizedQuery)) {
+        results->matches->Append(SearchMatch(&book, MATCH_ISBN));
         continue;
       }
 
-      if (containsWord(book.getAuthor(), lowerQuery))
-        results->byAuthor->Append(book);
+      unsigned fields = MATCH_NONE;
+      if (containsWord(book.getAuthor(), lowerQuery)) fields |= MATCH_AUTHOR;
+      if (containsWord(book.getTitle(), lowerQuery)) fields |= MATCH_TITLE;
+      if (containsWord(book.getGenre(), lowerQuery)) fields |= MATCH_GENRE;
 
-      if (containsWord(book.getTitle(), lowerQuery))
-        results->byTitle->Append(book);
+      if (fields != MATCH_NONE)
+        results->matches->Append(SearchMatch(&book, fields));
+    }
+
+    return operation.done(results);
+  }
 
-      if (containsWord(book.getGenre(), lowerQuery))
-        results->byGenre->Append(book);
+  // Не больше k лучших совпадений, по убыванию релевантности. Книги
+  // читаются из списков слов запроса по убыванию вклада (порог Фейджина):
+  // поиск останавливается, как только оценка сверху для ещё не прочитанных
+  // книг не выше худшей из k найденных, так что он читает порядка k
+  // записей, а не весь каталог.
+  virtual SearchResults* searchBooks(const std::string& query,
+                                     int k) override {
+    LIBRARY_OPERATION(MetricOp::TOP_SEARCH);
+    SearchResults* results = new SearchResults(catalogGeneration);
+
+    std::vector<std::string> phrase = tokenizeWords(query);
+    if (phrase.empty() || k <= 0) {
+      return operation.done(results);
+    }
+    // Без повторов, в порядке первого появления: tokens[0] == phrase[0]
+    std::vector<std::string> tokens;
+    for (const std::string& word : phrase) {
+      if (std::find(tokens.begin(), tokens.end(), word) == tokens.end()) {
+        tokens.push_back(word);
+      }
     }
 
-    return results;
+    std::priority_queue<SearchMatch, std::vector<SearchMatch>, WorseMatch> top;
+    auto offer = [&](const SearchMatch& match) {
+      if (static_cast<int>(top.size()) < k) {
+        top.push(match);
+      } else if (betterMatch(match, top.top())) {
+        top.pop();
+        top.push(match);
+      }
+    };
+
+    const int fieldWeights[] = {kTitleWeight, kAuthorWeight, kGenreWeight};
+    const unsigned fieldMasks[] = {MATCH_TITLE, MATCH_AUTHOR, MATCH_GENRE};
+    RoaringBitmap seen;
+    auto score = [&](uint32_t ordinal) {
+      seen.add(ordinal);
+      const Book& book = *(*bookByOrdinal)[ordinal];
+      const std::string* fieldTexts[] = {&book.getTitle(), &book.getAuthor(),
+                                         &book.getGenre()};
+      SearchMatch match(&book, MATCH_NONE);
+      for (int i = 0; i < 3; ++i) {
+        int fieldScore =
+            scoreField(*fieldTexts[i], phrase, tokens, fieldWeights[i]);
+        if (fieldScore > 0) {
+          match.score += fieldScore;
+          match.fields |= fieldMasks[i];
+        }
+      }
+      if (match.fields != MATCH_NONE) offer(match);
+    };
+
+    // ISBN совпадает только точно, поэтому ищем его по ключу
+    for (const std::string& key : {query, toUpper(query)}) {
+      auto it = books->find(key);
+      if (it != books->end()) {
+        seen.add(bookOrdinals->at(key));
+        offer(SearchMatch(&it->second, MATCH_ISBN,
+                          maxFieldScore(kIsbnWeight)));
+        break;
+      }
+    }
+
+    // Оценка сверху для непрочитанной книги, умноженная на n =
+    // tokens.size(), - сумма очередных вкладов по спискам слов, очередной
+    // надбавки за фразу у первого слова (с множителем n) и надбавок
+    // weight / 2 * n за поля, целиком равные запросу: такие книги вклады
+    // слов не учитывают, их поле читается из индекса поля разом, когда
+    // его надбавка больше очередных вкладов
+    const uint64_t n = tokens.size();
+    struct Cursor {
+      const WordIndex::PostingList* postings;
+      size_t next;
+      uint64_t weight;
+    };
+    std::vector<Cursor> cursors;
+    for (const std::string& token : tokens) {
+      const WordIndex::PostingList* postings = wordIndex->find(token);
+      if (postings != nullptr) cursors.push_back({postings, 0, 1});
+    }
+    const WordIndex::PostingList* phrasePostings = phraseIndex->find(phrase[0]);
+    if (phrasePostings != nullptr) cursors.push_back({phrasePostings, 0, n});
+    struct ExactField {
+      const RoaringBitmap* books;
+      uint64_t key;
+    };
+    std::vector<ExactField> exactFields;
+    std::string normalizedQuery = normalizeText(query);
+    const std::pair<BitmapIndex*, int> exactIndexes[] = {
+        {titleIndex, kTitleWeight},
+        {authorIndex, kAuthorWeight},
+        {genreIndex, kGenreWeight}};
+    for (const auto& [index, weight] : exactIndexes) {
+      auto it = index->find(normalizedQuery);
+      if (it != index->end()) {
+        exactFields.push_back({&it->second, n * (weight / 2)});
+      }
+    }
+
+    while (true) {
+      Cursor* best = nullptr;
+      uint64_t bestKey = 0;
+      uint64_t bound = 0;
+      for (Cursor& cursor : cursors) {
+        if (cursor.next == cursor.postings->size()) continue;
+        uint64_t key = cursor.weight * (*cursor.postings)[cursor.next].impact;
+        bound += key;
+        if (best == nullptr || key > bestKey) {
+          best = &cursor;
+          bestKey = key;
+        }
+      }
+      ExactField* exact = nullptr;
+      for (ExactField& field : exactFields) {
+        if (field.books == nullptr) continue;
+        bound += field.key;
+        if (exact == nullptr || field.key > exact->key) exact = &field;
+      }
+      if (best == nullptr && exact == nullptr) break;
+
+      if (static_cast<int>(top.size()) == k) {
+        const SearchMatch& worst = top.top();
+        uint64_t worstScore = static_cast<uint64_t>(worst.score) * n;
+        if (worstScore > bound) break;
+        // Книга со score, равным оценке, стоит в каждом списке слов не
+        // раньше очередной записи - значит, и по названию тоже
+        if (worstScore == bound && bestKey > 0 &&
+            !((*bookByOrdinal)[(*best->postings)[best->next].ordinal]
+                  ->getTitle() < worst.book->getTitle())) {
+          break;
+        }
+      }
+
+      if (exact != nullptr && (best == nullptr || exact->key > bestKey)) {
+        exact->books->forEach([&](uint32_t ordinal) {
+          if (!seen.contains(ordinal)) score(ordinal);
+        });
+        exact->books = nullptr;
+        continue;
+      }
+      uint32_t ordinal = (*best->postings)[best->next++].ordinal;
+      if (!seen.contains(ordinal)) score(ordinal);
+    }
+
+    std::vector<SearchMatch> ranked;
+    ranked.reserve(top.size());
+    while (!top.empty()) {
+      ranked.push_back(top.top());
+      top.pop();
+    }
+    std::sort(ranked.begin(), ranked.end(), betterMatch);
+    for (const SearchMatch& match : ranked) {
+      results->matches->Append(match);
+    }
+
+    return operation.done(results);
+  }
+
+  // Поиск по названию и автору с опечатками: каждое слово запроса должно
+  // найтись в книге с точностью до maxDistance правок. Чем меньше правок,
+  // тем выше score.
+  SearchResults* fuzzySearchBooks(const std::string& query, int maxDistance) {
+    LIBRARY_OPERATION(MetricOp::FUZZY_SEARCH);
+    SearchResults* results = new SearchResults(catalogGeneration);
+    if (maxDistance < 0) return operation.done(results);
+
+    int words = static_cast<int>(tokenizeWords(query).size());
+    std::vector<SearchMatch> ranked;
+    for (const auto& [book, hit] : fuzzyIndex->search(query, maxDistance)) {
+      ranked.push_back(SearchMatch(book, hit.fields,
+                                   (maxDistance + 1) * words - hit.distance));
+    }
+    std::sort(ranked.begin(), ranked.end(), betterMatch);
+    for (const SearchMatch& match : ranked) {
+      results->matches->Append(match);
+    }
+
+    return operation.done(results);
   }
 
-  virtual Book findBook(const std::string& isbn) override {
-    if (books->find(isbn) == books->end()) return Book();
+  // Подсказки при вводе: до limit самых частых слов, названий и авторов,
+  // начинающихся с prefix
+  Sequence<Completion>* autocomplete(const std::string& prefix, int limit) {
+    LIBRARY_OPERATION(MetricOp::AUTOCOMPLETE);
+    Sequence<Completion>* completions = new MutableArraySequence<Completion>();
+    if (limit <= 0) return operation.done(completions);
+
+    std::string key = normalizeText(prefix);
+    if (!key.empty() &&
+        std::isspace(static_cast<unsigned char>(prefix.back()))) {
+      key += ' ';
+    }
+
+    for (const Completion& completion : prefixIndex->complete(key, limit)) {
+      completions->Append(completion);
+    }
+    return operation.done(completions);
+  }
+
+  size_t autocompleteMemoryUsage() const { return prefixIndex->memoryUsage(); }
+
+  // Точная выборка по жанру/автору/доступности через пересечение битмапов
+  SearchResults* filterBooks(const BookFilter& filter) {
+    LIBRARY_OPERATION(MetricOp::FILTER);
+    SearchResults* results = new SearchResults(catalogGeneration);
+    std::vector<const RoaringBitmap*> bitmaps = filterBitmaps(filter);
+
+    RoaringBitmap matched = *bitmaps[0];
+    for (size_t i = 1; i < bitmaps.size() && !matched.isEmpty(); ++i) {
+      matched = matched & *bitmaps[i];
+    }
 
-    return books->at(isbn);
+    unsigned fields = MATCH_NONE;
+    if (!filter.genre.empty()) fields |= MATCH_GENRE;
+    if (!filter.author.empty()) fields |= MATCH_AUTHOR;
+    matched.forEach([&](uint32_t ordinal) {
+      results->matches->Append(SearchMatch((*bookByOrdinal)[ordinal], fields));
+    });
+    return operation.done(results);
   }
 
-  virtual Sequence<Book>* getAllBooks() override {
-    Sequence<Book>* allBooks = new MutableListSequence<Book>();
+  size_t countBooks(const BookFilter& filter) {
+    std::vector<const RoaringBitmap*> bitmaps = filterBitmaps(filter);
+    if (bitmaps.size() == 1) return bitmaps[0]->cardinality();
+
+    RoaringBitmap matched = *bitmaps[0];
+    for (size_t i = 1; i + 1 < bitmaps.size(); ++i) {
+      matched = matched & *bitmaps[i];
+    }
+    return matched.andCardinality(*bitmaps.back());
+  }
+
+  Sequence<Facet>* genreFacets(bool availableOnly) {
+    return facets(*genreIndex, availableOnly);
+  }
+
+  Sequence<Facet>* authorFacets(bool availableOnly) {
+    return facets(*authorIndex, availableOnly);
+  }
+
+  // Структурированный запрос (см. Search/Query.hpp). Для предикатов с
+  // индексом (ISBN - хэш, точные название/автор/жанр и доступность -
+  // битмапы, диапазоны - упорядоченные индексы) сначала по индексу
+  // считается, сколько книг они пропустят; книги выбираются только по
+  // самому селективному, остальные предикаты проверяются на каждой
+  // отобранной книге. Весь каталог просматривается, лишь если индексных
+  // предикатов нет.
+  // В explain записывается выбранный план. nullptr - запрос не разобран,
+  // тогда в explain текст ошибки.
+  SearchResults* query(const std::string& text,
+                       std::string* explain = nullptr) {
+    LIBRARY_OPERATION(MetricOp::QUERY);
+    ParsedQuery parsed = parseQuery(text);
+    if (!parsed.ok()) {
+      if (explain) *explain = "error: " + parsed.error + "\n";
+      return operation.done(nullptr);
+    }
+
+    std::vector<IndexedPredicate> indexed;
+    std::vector<const QueryPredicate*> filters;
+    for (const QueryPredicate& predicate : parsed.predicates) {
+      IndexedPredicate step;
+      if (planIndexed(predicate, step)) {
+        indexed.push_back(std::move(step));
+      } else {
+        filters.push_back(&predicate);
+      }
+    }
+    std::sort(indexed.begin(), indexed.end(),
+              [](const IndexedPredicate& a, const IndexedPredicate& b) {
+                return a.rows < b.rows;
+              });
+    std::stable_sort(filters.begin(), filters.end(),
+                     [](const QueryPredicate* a, const QueryPredicate* b) {
+                       return a->op == QueryOp::EQUALS &&
+                              b->op != QueryOp::EQUALS;
+                     });
+
+    std::vector<QueryPlanStep> steps;
+    RoaringBitmap candidates;
+    unsigned indexedFields = MATCH_NONE;
+    double catalogSize = static_cast<double>(books->size());
+    double estimate = catalogSize;
+    if (indexed.empty()) {
+      candidates = *catalogBooks;
+      steps.push_back(QueryPlanStep("SCAN catalog", "", estimate));
+    } else {
+      candidates = materialize(indexed[0]);
+      estimate = static_cast<double>(indexed[0].rows);
+      steps.push_back(QueryPlanStep(indexed[0].access,
+                                    indexed[0].predicate->describe(),
+                                    estimate));
+    }
+    // Остальные индексные предикаты - фильтрами с точной долей книг
+    std::vector<std::string> indexedValues;
+    for (size_t i = 0; i < indexed.size(); ++i) {
+      indexedFields |= fieldMask(indexed[i].predicate->field);
+      indexedValues.push_back(filterValue(*indexed[i].predicate));
+      if (i == 0) continue;
+      estimate *= catalogSize > 0 ? indexed[i].rows / catalogSize : 0;
+      steps.push_back(
+          QueryPlanStep("FILTER", indexed[i].predicate->describe(), estimate));
+    }
+
+    std::vector<std::string> values;
+    for (const QueryPredicate* predicate : filters) {
+      estimate *= predicate->op == QueryOp::EQUALS     ? kEqualsSelectivity
+                  : predicate->op == QueryOp::CONTAINS ? kContainsSelectivity
+                                                       : kRangeSelectivity;
+      steps.push_back(QueryPlanStep("FILTER", predicate->describe(), estimate));
+      values.push_back(filterValue(*predicate));
+    }
+
+    SearchResults* results = new SearchResults(catalogGeneration);
+    candidates.forEach([&](uint32_t ordinal) {
+      const Book* book = (*bookByOrdinal)[ordinal];
+      for (size_t i = 1; i < indexed.size(); ++i) {
+        if (!passes(indexed[i], ordinal, *book, indexedValues[i])) return;
+      }
+      unsigned fields = indexedFields;
+      for (size_t i = 0; i < filters.size(); ++i) {
+        unsigned matched = evaluate(*filters[i], *book, values[i]);
+        if (matched == MATCH_NONE) return;
+        fields |= matched;
+      }
+      results->matches->Append(SearchMatch(book, fields));
+    });
+
+    if (explain) *explain = explainPlan(steps, results->totalCount());
+    return operation.done(results);
+  }
+
+  // Книга в каталоге, без копии; nullptr, если нет. Действительна, пока
+  // не изменился каталог (см. getCatalogGeneration)
+  const Book* findBook(const std::string& isbn) {
+    LIBRARY_OPERATION(MetricOp::FIND_BOOK);
+    auto it = books->find(isbn);
+    if (it == books->end()) return operation.done(nullptr);
+
+    return operation.done(&it->second);
+  }
+
+  virtual std::optional<Book> getBook(const std::string& isbn) override {
+    const Book* book = findBook(isbn);
+    if (book == nullptr) return std::nullopt;
+    return *book;
+  }
+
+  // Весь каталог одной последовательностью; длинные листинги - страницами
+  // через getBooksPage
+  Sequence<const Book*>* getAllBooks() {
+    Sequence<const Book*>* allBooks = new MutableArraySequence<const Book*>();
     for (auto& [key, val] : *books) {
-      allBooks->Append(val);
+      allBooks->Append(&val);
     }
     return allBooks;
   }
 
+  // Страница каталога: не больше pageSize книг после token ("" - с
+  // начала) в порядке order. Каталог не копируется и не сортируется: в
+  // порядке CATALOG обход продолжается с номера из токена, в остальных -
+  // по упорядоченному индексу от последнего показанного ключа, за
+  // O(log n + pageSize). Книги, добавленные или удалённые между
+  // страницами, обход не сбивают. nullptr - токен не разобран или
+  // pageSize == 0.
+  ListingPage<const Book*>* getBooksPage(const std::string& token,
+                                         size_t pageSize,
+                                         BookOrder order = BookOrder::CATALOG) {
+    LIBRARY_OPERATION(MetricOp::LIST);
+    if (pageSize == 0) return operation.done(nullptr);
+    if (order == BookOrder::CATALOG) {
+      return operation.done(catalogPage(token, pageSize));
+    }
+    return operation.done(keyedPage(token, pageSize, order));
+  }
+
+  // Страница с места offset в порядке order (TITLE, AUTHOR, ISBN), для
+  // перехода сразу на N-ю страницу; дальше можно идти по nextToken.
+  // nullptr - порядок CATALOG или pageSize == 0.
+  ListingPage<const Book*>* getBooksPageAt(BookOrder order, size_t offset,
+                                           size_t pageSize) {
+    LIBRARY_OPERATION(MetricOp::LIST);
+    const BookOrderIndex* index = orderIndex(order);
+    if (index == nullptr || pageSize == 0) return operation.done(nullptr);
+    return operation.done(pageFrom(index->at(offset), pageSize, order));
+  }
+
+  // Место книги в порядке order (с нуля), за O(log n). false - книги нет
+  // или порядок CATALOG.
+  bool getBookRank(const std::string& isbn, BookOrder order, size_t& rank) {
+    const BookOrderIndex* index = orderIndex(order);
+    if (index == nullptr || books->find(isbn) == books->end()) return false;
+    return index->rankOf(bookOrdinals->at(isbn), rank);
+  }
+
+  // Сколько книг с ключом order от from до to включительно, без учёта
+  // регистра, за O(log n). Для CATALOG - 0.
+  size_t countBooksInRange(BookOrder order, const std::string& from,
+                           const std::string& to) {
+    const BookOrderIndex* index = orderIndex(order);
+    if (index == nullptr) return 0;
+
+    size_t begin = index->rank(from);
+    size_t end = index->rank(to, true);
+    return begin < end ? end - begin : 0;
+  }
+
+  unsigned long getCatalogGeneration() const { return catalogGeneration; }
+  unsigned long getUsersGeneration() const { return usersGeneration; }
+
+  // Ссылки из results ещё указывают на живые книги
+  bool isCurrent(const SearchResults* results) const {
+    return results->generation == catalogGeneration;
+  }
+
   // Операции по книгами
 
   virtual bool addBook(const std::string& title, const std::string& author,
                        const std::string& isbn,
                        const std::string& genre) override {
-    if (books->find(isbn) != books->end()) return false;
-
-    books->insert({isbn, Book(title, author, genre, isbn)});
-    return true;
+    LIBRARY_OPERATION(MetricOp::ADD_BOOK);
+    if (books->find(isbn) != books->end()) return operation.done(false);
+
+    auto inserted = books->insert({isbn, Book(title, author, genre, isbn)});
+    indexBook(inserted.first->second);
+    circulation->bookAdded(genre);
+    ++catalogGeneration;
+    return operation.done(true);
   }
 
+  // Выданную книгу удалить нельзя: её номер есть у читателя
   virtual bool removeBook(const std::string& isbn) override {
-    if (books->find(isbn) == books->end()) return false;
+    LIBRARY_OPERATION(MetricOp::REMOVE_BOOK);
+    auto it = books->find(isbn);
+    if (it == books->end() || !it->second.isAvailable()) {
+      return operation.done(false);
+    }
 
-    books->erase(isbn);
-    return true;
+    uint32_t ordinal = bookOrdinals->at(isbn);
+    circulation->bookRemoved(ordinal, it->second.getGenre());
+    holds->dropBook(ordinal);
+    unindexBook(it->second);
+    books->erase(it);
+    ++catalogGeneration;
+    return operation.done(true);
   }
 
   // Операции по пользователями
 
   virtual bool registerUser(const std::string& name, const std::string& userId,
                             const std::string& email, UserType type) override {
-    if (users->find(userId) != users->end()) return false;
-
-    LibraryUser* user = nullptr;
-    switch (type) {
-      case UserType::STUDENT:
-        user = new Student(name, userId, email);
-        break;
-      case UserType::FACULTY:
-        user = new Faculty(name, userId, email);
-        break;
-      case UserType::GUEST:
-        user = new Guest(name, userId, email);
-        break;
-      default:
-        return false;
+    LIBRARY_OPERATION(MetricOp::REGISTER_USER);
+    if (findUser(userId) != nullptr) return operation.done(false);
+
+    LibraryUser user(type, name, userId, email);
+    auto it = userHandles->find(userId);
+    uint32_t handle;
+    if (it == userHandles->end()) {
+      handle = users->allocate(user);
+      userHandles->insert({userId, handle});
+    } else {
+      handle = it->second;
+      users->reactivate(handle, user);
     }
-
-    users->insert({userId, user});
-    return true;
+    versionUser(handle);
+    ++usersGeneration;
+    circulation->userAdded(type);
+    return operation.done(true);
   }
 
+  // Библиотека хранит копию пользователя, объект user остаётся у вызывающего
   virtual bool registerUser(LibraryUser* user) override {
-    if (users->find(user->getUserId()) != users->end()) return false;
-
-    users->insert({user->getUserId(), user});
-    return true;
+    return registerUser(user->getName(), user->getUserId(), user->getEmail(),
+                        user->getType());
   }
 
+  // Читателя с книгами на руках удалить нельзя: их некому было бы вернуть
   virtual bool removeUser(const std::string& userId) override {
-    if (users->find(userId) == users->end()) return false;
+    LIBRARY_OPERATION(MetricOp::REMOVE_USER);
+    auto it = userHandles->find(userId);
+    if (it == userHandles->end() || !users->isActive(it->second) ||
+        users->get(it->second).getBorrowedCount() > 0) {
+      return operation.done(false);
+    }
 
-    users->erase(userId);
-    return true;
+    users->deactivate(it->second);
+    versionUser(it->second);
+    ++usersGeneration;
+    circulation->userRemoved(users->get(it->second).getType());
+    // Отложенные ему книги уходят следующим в очереди
+    for (uint32_t ordinal : holds->dropUser(it->second)) {
+      passOn(ordinal, today());
+    }
+    return operation.done(true);
   }
 
-  virtual LibraryUser* findUser(const std::string& userId) override {
-    if (users->find(userId) == users->end()) return nullptr;
+  // Читатель в хранилище; nullptr, если нет или удалён
+  LibraryUser* findUser(const std::string& userId) {
+    auto it = userHandles->find(userId);
+    if (it == userHandles->end() || !users->isActive(it->second))
+      return nullptr;
+
+    return &users->get(it->second);
+  }
 
-    return users->at(userId);
+  virtual std::optional<LibraryUser> getUser(
+      const std::string& userId) override {
+    LibraryUser* user = findUser(userId);
+    if (user == nullptr) return std::nullopt;
+    return *user;
   }
 
-  virtual Sequence<LibraryUser*>* getAllUsers() override {
-    Sequence<LibraryUser*>* allUsers = new MutableListSequence<LibraryUser*>();
-    for (auto& [key, val] : *users) {
-      allUsers->Append(val);
+  // Все пользователи разом; длинные листинги - через getUsersPage
+  Sequence<LibraryUser*>* getAllUsers() {
+    Sequence<LibraryUser*>* allUsers = new MutableArraySequence<LibraryUser*>();
+    for (uint32_t handle = 0; handle < users->size(); ++handle) {
+      if (users->isActive(handle)) allUsers->Append(&users->get(handle));
     }
     return allUsers;
   }
 
+  // Страница пользователей в порядке регистрации, как getBooksPage в
+  // порядке CATALOG. Адреса пользователей не меняются, ссылки живут до
+  // их удаления; generation страницы - getUsersGeneration().
+  ListingPage<LibraryUser*>* getUsersPage(const std::string& token,
+                                          size_t pageSize) {
+    LIBRARY_OPERATION(MetricOp::LIST);
+    uint32_t handle;
+    if (pageSize == 0 || !parseOrdinalToken(token, handle)) {
+      return operation.done(nullptr);
+    }
+
+    ListingPage<LibraryUser*>* page =
+        new ListingPage<LibraryUser*>(usersGeneration);
+    size_t taken = 0;
+    for (; handle < users->size(); ++handle) {
+      if (!users->isActive(handle)) continue;
+      if (taken == pageSize) {
+        page->nextToken = std::to_string(handle);
+        break;
+      }
+      page->items->Append(&users->get(handle));
+      ++taken;
+    }
+    return operation.done(page);
+  }
+
+  // ISBN книг, которые сейчас на руках у пользователя
+  Sequence<std::string>* getBorrowedBooks(const std::string& userId) {
+    Sequence<std::string>* borrowed = new MutableArraySequence<std::string>();
+    LibraryUser* user = findUser(userId);
+    if (user == nullptr) return borrowed;
+
+    for (int i = 0; i < user->getBorrowedCount(); ++i) {
+      borrowed->Append((*isbnByOrdinal)[user->getBorrowedBook(i)]);
+    }
+    return borrowed;
+  }
+
   // Операции в билиблиотеке
 
   virtual bool borrowBook(const std::string& userId,
                           const std::string& isbn) override {
-    if (users->find(userId) == users->end() ||
-        books->find(isbn) == books->end())
-      return false;
-
-    LibraryUser* user = users->at(userId);
-    Book& book = books->at(isbn);
-    if (!user->canBorrow() || !book.isAvailable()) return false;
-
-    book.setAvailable(false);
-    user->getBorrowedBooks()->insert(isbn);
-    borrowHistory->Append(BorrowingRecord(userId, isbn, user->getBorrowDays()));
-    return true;
+    LIBRARY_OPERATION(MetricOp::BORROW);
+    LibraryUser* user = findUser(userId);
+    auto bookIt = books->find(isbn);
+    if (user == nullptr || bookIt == books->end()) return operation.done(false);
+
+    Book& book = bookIt->second;
+    if (!user->canBorrow()) return operation.done(false);
+
+    int32_t day = today();
+    expireHolds(day);
+    uint32_t ordinal = bookOrdinals->at(isbn);
+    uint32_t handle = userHandles->at(userId);
+    if (!book.isAvailable()) {
+      // Занятую книгу можно взять, только если она отложена для него
+      uint32_t holder;
+      if (!holds->reservedFor(ordinal, holder) || holder != handle) {
+        return operation.done(false);
+      }
+      holds->release(ordinal);
+    }
+    lend(*user, handle, book, ordinal, day);
+    return operation.done(true);
   }
 
   virtual bool returnBook(const std::string& userId,
                           const std::string& isbn) override {
-    if (users->find(userId) == users->end() ||
-        books->find(isbn) == books->end())
-      return false;
-
-    LibraryUser* user = users->at(userId);
-    Book& book = books->at(isbn);
-    if (user->getBorrowedBooks()->find(isbn) == user->getBorrowedBooks()->end())
-      return false;
-
-    book.setAvailable(true);
-    user->getBorrowedBooks()->erase(isbn);
-    for (BorrowingRecord& record : *borrowHistory) {
-      if (record.getUserId() == userId && record.getBookId() == isbn) {
-        record.markReturned();
-        break;
-      }
+    LIBRARY_OPERATION(MetricOp::RETURN);
+    LibraryUser* user = findUser(userId);
+    auto bookIt = books->find(isbn);
+    if (user == nullptr || bookIt == books->end()) return operation.done(false);
+
+    uint32_t ordinal = bookOrdinals->at(isbn);
+    if (!user->hasBorrowed(ordinal)) return operation.done(false);
+
+    user->removeBorrowed(ordinal);
+    uint32_t handle = userHandles->at(userId);
+    versionUser(handle);
+    int32_t day = today();
+    BorrowingRecord record;
+    if (borrowHistory->close(handle, ordinal, &record)) {
+      circulation->loanClosed(bookIt->second.getGenre(), user->getType(),
+                              record.getDueDay(), day);
     }
+    fines->loanClosed(handle, ordinal, day);
+    expireHolds(day);
+    passOn(ordinal, day);
 
-    return true;
+    return operation.done(true);
   }
 
   virtual Sequence<BorrowingRecord>* getOverdueBooks() override {
+    LIBRARY_OPERATION(MetricOp::OVERDUE);
     Sequence<BorrowingRecord>* overdue =
-        new MutableListSequence<BorrowingRecord>();
-    for (BorrowingRecord& record : *borrowHistory) {
-      if (record.isOverdue() && !record.isReturned()) {
+        new MutableArraySequence<BorrowingRecord>();
+    int32_t day = today();
+    for (const BorrowingRecord& record : borrowHistory->hot()) {
+      if (record.isOverdue(day)) {
         overdue->Append(record);
       }
     }
-    return overdue;
+    return operation.done(overdue);
+  }
+
+  virtual HistoryCursor getBorrowHistory() override {
+    return borrowHistory->cursor();
+  }
+
+  // Выдачи читателя (книги) с днём выдачи в [fromDay, toDay] по дате,
+  // страницей: пропустить offset, не больше limit. Удалённые читатели и
+  // книги тоже находятся. nullptr, если такого id никогда не было.
+  Sequence<BorrowingRecord>* getUserHistory(const std::string& userId,
+                                            int32_t fromDay, int32_t toDay,
+                                            size_t offset, size_t limit) {
+    LIBRARY_OPERATION(MetricOp::HISTORY);
+    auto it = userHandles->find(userId);
+    if (it == userHandles->end()) return operation.done(nullptr);
+    return operation.done(historyPage(HistoryKey::USER, it->second, fromDay,
+                                      toDay, offset, limit));
+  }
+
+  Sequence<BorrowingRecord>* getBookHistory(const std::string& isbn,
+                                            int32_t fromDay, int32_t toDay,
+                                            size_t offset, size_t limit) {
+    LIBRARY_OPERATION(MetricOp::HISTORY);
+    auto it = bookOrdinals->find(isbn);
+    if (it == bookOrdinals->end()) return operation.done(nullptr);
+    return operation.done(historyPage(HistoryKey::BOOK, it->second, fromDay,
+                                      toDay, offset, limit));
+  }
+
+  size_t countUserHistory(const std::string& userId, int32_t fromDay,
+                          int32_t toDay) const {
+    auto it = userHandles->find(userId);
+    if (it == userHandles->end()) return 0;
+    return borrowHistory->count(HistoryKey::USER, it->second, fromDay, toDay);
+  }
+
+  size_t countBookHistory(const std::string& isbn, int32_t fromDay,
+                          int32_t toDay) const {
+    auto it = bookOrdinals->find(isbn);
+    if (it == bookOrdinals->end()) return 0;
+    return borrowHistory->count(HistoryKey::BOOK, it->second, fromDay, toDay);
+  }
+
+  // Сводки по выдачам (см. Analytics/Circulation.hpp)
+  CirculationStats& getCirculation() { return *circulation; }
+
+  // k самых выдаваемых книг: ISBN и число выдач (оценка сверху)
+  Sequence<Facet>* mostBorrowedBooks(size_t k) {
+    Sequence<Facet>* result = new MutableArraySequence<Facet>();
+    for (const HeavyHitter& hit : circulation->mostBorrowed(k)) {
+      result->Append(Facet((*isbnByOrdinal)[hit.item], hit.count));
+    }
+    return result;
+  }
+
+  uint32_t overdueCount() { return circulation->overdueLoans(today()); }
+
+  // Ежедневный пересчёт штрафов по всем открытым выдачам (см. Fines.hpp).
+  // Возвращает сумму начисленного по ним в центах.
+  int64_t assessFines() { return fines->assess(today()); }
+
+  // Долг читателя в центах: закрытые выдачи и начисленное при последнем
+  // пересчёте. 0, если такого читателя нет.
+  int64_t getFineBalance(const std::string& userId) const {
+    auto it = userHandles->find(userId);
+    return it == userHandles->end() ? 0 : fines->balanceOf(it->second);
+  }
+
+  bool payFine(const std::string& userId, int64_t cents) {
+    auto it = userHandles->find(userId);
+    return it != userHandles->end() && fines->pay(it->second, cents);
+  }
+
+  // Штраф по выдаче, если вернуть книгу сегодня
+  int32_t getRecordFine(const BorrowingRecord& record) const {
+    if (record.isReturned()) return 0;
+    UserType type = users->get(record.getUserHandle()).getType();
+    return FineEngine::fine(record.getDueDay(), userPolicy(type), today());
+  }
+
+  // Встать в очередь на выданную книгу (см. Holds.hpp). false, если
+  // книга свободна или уже у читателя, очередь полна или у читателя
+  // слишком много броней.
+  bool placeHold(const std::string& userId, const std::string& isbn) {
+    LIBRARY_OPERATION(MetricOp::HOLD);
+    LibraryUser* user = findUser(userId);
+    auto bookIt = books->find(isbn);
+    if (user == nullptr || bookIt == books->end()) return operation.done(false);
+
+    expireHolds(today());
+    uint32_t ordinal = bookOrdinals->at(isbn);
+    if (bookIt->second.isAvailable() || user->hasBorrowed(ordinal)) {
+      return operation.done(false);
+    }
+    return operation.done(
+        holds->place(userHandles->at(userId), user->getType(), ordinal));
+  }
+
+  // Выйти из очереди или отказаться от отложенной книги
+  bool cancelHold(const std::string& userId, const std::string& isbn) {
+    LIBRARY_OPERATION(MetricOp::HOLD);
+    auto userIt = userHandles->find(userId);
+    auto ordinalIt = bookOrdinals->find(isbn);
+    if (userIt == userHandles->end() || ordinalIt == bookOrdinals->end()) {
+      return operation.done(false);
+    }
+
+    uint32_t handle = userIt->second;
+    uint32_t ordinal = ordinalIt->second;
+    if (holds->cancel(handle, ordinal)) return operation.done(true);
+
+    uint32_t holder;
+    if (!holds->reservedFor(ordinal, holder) || holder != handle) {
+      return operation.done(false);
+    }
+    holds->release(ordinal);
+    passOn(ordinal, today());
+    return operation.done(true);
+  }
+
+  // Брони читателя; nullptr, если читателя нет
+  Sequence<HoldInfo>* getUserHolds(const std::string& userId) {
+    LIBRARY_OPERATION(MetricOp::HOLD);
+    if (findUser(userId) == nullptr) return operation.done(nullptr);
+
+    expireHolds(today());
+    std::vector<HoldInfo> list = holds->holdsOf(userHandles->at(userId));
+    return operation.done(new MutableArraySequence<HoldInfo>(
+        list.data(), static_cast<int>(list.size())));
+  }
+
+  const std::string& getHoldBookId(const HoldInfo& hold) {
+    return (*isbnByOrdinal)[hold.bookKey];
+  }
+
+  // Снять истёкшие брони (ежедневная задача); возвращает их число
+  size_t processHoldExpiry() { return expireHolds(today()); }
+
+  HoldHandoff getHoldHandoff() const { return holdHandoff; }
+  void setHoldHandoff(HoldHandoff handoff) { holdHandoff = handoff; }
+
+  // Неизменяемый вид на каталог, пользователей и историю на этот момент
+  // (см. Snapshot.hpp); удаляет вызывающий. Снимок, при котором живых
+  // больше нет, копирует каталог и пользователей в версии, следующие
+  // стоят копирования указателей на страницы. Когда удалён последний
+  // снимок, версии освобождаются при следующем изменении или снимке.
+  // Снимать - там же, где идут изменения (в том же потоке или под той же
+  // блокировкой); читать и удалять снимок - где угодно.
+  LibrarySnapshot* snapshot() {
+    std::shared_ptr<SnapshotLease> lease = liveSnapshots.lock();
+    if (lease == nullptr) {
+      delete versions;
+      versions = nullptr;
+      lease = std::make_shared<SnapshotLease>();
+      liveSnapshots = lease;
+    }
+    if (versions == nullptr) {
+      versions = new LibraryVersions();
+      for (uint32_t ordinal = 0; ordinal < isbnByOrdinal->size(); ++ordinal) {
+        const Book* book = (*bookByOrdinal)[ordinal];
+        versions->catalog.push_back(
+            book != nullptr
+                ? CatalogSlot(*book, true)
+                : CatalogSlot(Book("", "", "", (*isbnByOrdinal)[ordinal]),
+                              false));
+      }
+      for (uint32_t handle = 0; handle < users->size(); ++handle) {
+        versionUser(handle);
+      }
+    }
+    return new LibrarySnapshot(std::move(lease), *versions,
+                               borrowHistory->version(), today(),
+                               catalogGeneration);
   }
 
-  virtual Sequence<BorrowingRecord>* getBorrowHistory() override {
-    return borrowHistory;
+  // Размеры ярусов истории и занимаемая память
+  const BorrowHistory& getHistoryStorage() const { return *borrowHistory; }
+
+  // Запечатать закрытые выдачи, взятые больше keepDays дней назад
+  void sealHistory(int keepDays) { borrowHistory->seal(today() - keepDays); }
+
+  virtual std::string getRecordUserId(const BorrowingRecord& record) override {
+    return users->get(record.getUserHandle()).getUserId();
   }
+
+  virtual std::string getRecordBookId(const BorrowingRecord& record) override {
+    return (*isbnByOrdinal)[record.getBookKey()];
+  }
+
+  // Текущий день по часам библиотеки (см. Clock.hpp)
+  int32_t today() const { return clock->today(); }
+
+  Clock* getClock() const { return clock; }
+
+  // "YYYY-MM-DD"; строка кэшируется по дню
+  const std::string& formatDate(int32_t day) { return dateCache->format(day); }
 };
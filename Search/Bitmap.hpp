@@ -0,0 +1,356 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <vector>
+
+#include "../Diagnostics/MemoryAccounting.hpp"
+
+// Сжатое множество 32-битных чисел в духе Roaring: числа делятся на блоки
+// по старшим 16 битам, блок хранится либо отсортированным массивом младших
+// половин (пока их не больше 4096), либо битсетом на 65536 бит.
+// Пересечение, объединение и подсчёт идут поблочно.
+// Память считается за MemoryTag::INDEXES.
+class RoaringBitmap {
+ private:
+  static const uint32_t kArrayLimit = 4096;
+  static const size_t kBitsetWords = 65536 / 64;
+
+  struct Container {
+    uint16_t key;
+    uint32_t cardinality;
+    IndexVector<uint16_t> array;
+    // Пустой, если блок хранится массивом
+    IndexVector<uint64_t> bits;
+
+    Container(uint16_t key = 0) : key(key), cardinality(0) {}
+
+    bool isBitset() const { return !bits.empty(); }
+
+    bool contains(uint16_t low) const {
+      if (isBitset()) return (bits[low >> 6] >> (low & 63)) & 1;
+      return std::binary_search(array.begin(), array.end(), low);
+    }
+
+    bool add(uint16_t low) {
+      if (isBitset()) {
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (bits[low >> 6] & mask) return false;
+        bits[low >> 6] |= mask;
+        ++cardinality;
+        return true;
+      }
+
+      auto it = std::lower_bound(array.begin(), array.end(), low);
+      if (it != array.end() && *it == low) return false;
+      array.insert(it, low);
+      ++cardinality;
+      if (cardinality > kArrayLimit) toBitset();
+      return true;
+    }
+
+    bool remove(uint16_t low) {
+      if (isBitset()) {
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (!(bits[low >> 6] & mask)) return false;
+        bits[low >> 6] &= ~mask;
+        --cardinality;
+        if (cardinality <= kArrayLimit) toArray();
+        return true;
+      }
+
+      auto it = std::lower_bound(array.begin(), array.end(), low);
+      if (it == array.end() || *it != low) return false;
+      array.erase(it);
+      --cardinality;
+      return true;
+    }
+
+    void toBitset() {
+      bits.assign(kBitsetWords, 0);
+      for (uint16_t low : array) bits[low >> 6] |= uint64_t(1) << (low & 63);
+      IndexVector<uint16_t>().swap(array);
+    }
+
+    void toArray() {
+      array.clear();
+      array.reserve(cardinality);
+      for (size_t word = 0; word < kBitsetWords; ++word) {
+        uint64_t w = bits[word];
+        while (w) {
+          array.push_back(
+              static_cast<uint16_t>(word * 64 + __builtin_ctzll(w)));
+          w &= w - 1;
+        }
+      }
+      IndexVector<uint64_t>().swap(bits);
+    }
+
+    // Битсет с пересчитанной мощностью; в массив, если стал маленьким
+    void normalize() {
+      if (!isBitset()) {
+        cardinality = static_cast<uint32_t>(array.size());
+        if (cardinality > kArrayLimit) toBitset();
+        return;
+      }
+      uint32_t count = 0;
+      for (uint64_t w : bits) count += __builtin_popcountll(w);
+      cardinality = count;
+      if (cardinality <= kArrayLimit) toArray();
+    }
+
+    template <typename Fn>
+    void forEach(uint32_t high, Fn fn) const {
+      if (!isBitset()) {
+        for (uint16_t low : array) fn(high | low);
+        return;
+      }
+      for (size_t word = 0; word < kBitsetWords; ++word) {
+        uint64_t w = bits[word];
+        while (w) {
+          fn(high | static_cast<uint32_t>(word * 64 + __builtin_ctzll(w)));
+          w &= w - 1;
+        }
+      }
+    }
+  };
+
+  static Container intersect(const Container& a, const Container& b) {
+    Container result(a.key);
+    if (a.isBitset() && b.isBitset()) {
+      result.bits.resize(kBitsetWords);
+      for (size_t i = 0; i < kBitsetWords; ++i) {
+        result.bits[i] = a.bits[i] & b.bits[i];
+      }
+      result.normalize();
+    } else if (a.isBitset() || b.isBitset()) {
+      const Container& small = a.isBitset() ? b : a;
+      const Container& large = a.isBitset() ? a : b;
+      for (uint16_t low : small.array) {
+        if (large.contains(low)) result.array.push_back(low);
+      }
+      result.cardinality = static_cast<uint32_t>(result.array.size());
+    } else {
+      std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(),
+                            b.array.end(), std::back_inserter(result.array));
+      result.cardinality = static_cast<uint32_t>(result.array.size());
+    }
+    return result;
+  }
+
+  static uint32_t intersectCount(const Container& a, const Container& b) {
+    uint32_t count = 0;
+    if (a.isBitset() && b.isBitset()) {
+      for (size_t i = 0; i < kBitsetWords; ++i) {
+        count += __builtin_popcountll(a.bits[i] & b.bits[i]);
+      }
+    } else if (a.isBitset() || b.isBitset()) {
+      const Container& small = a.isBitset() ? b : a;
+      const Container& large = a.isBitset() ? a : b;
+      for (uint16_t low : small.array) count += large.contains(low);
+    } else {
+      size_t i = 0, j = 0;
+      while (i < a.array.size() && j < b.array.size()) {
+        if (a.array[i] < b.array[j]) {
+          ++i;
+        } else if (b.array[j] < a.array[i]) {
+          ++j;
+        } else {
+          ++count;
+          ++i;
+          ++j;
+        }
+      }
+    }
+    return count;
+  }
+
+  static Container unite(const Container& a, const Container& b) {
+    Container result(a.key);
+    if (a.isBitset() || b.isBitset()) {
+      result.bits.assign(kBitsetWords, 0);
+      for (const Container* c : {&a, &b}) {
+        if (c->isBitset()) {
+          for (size_t i = 0; i < kBitsetWords; ++i) {
+            result.bits[i] |= c->bits[i];
+          }
+        } else {
+          for (uint16_t low : c->array) {
+            result.bits[low >> 6] |= uint64_t(1) << (low & 63);
+          }
+        }
+      }
+    } else {
+      std::set_union(a.array.begin(), a.array.end(), b.array.begin(),
+                     b.array.end(), std::back_inserter(result.array));
+    }
+    result.normalize();
+    return result;
+  }
+
+  static Container subtract(const Container& a, const Container& b) {
+    Container result(a.key);
+    if (a.isBitset()) {
+      result.bits = a.bits;
+      if (b.isBitset()) {
+        for (size_t i = 0; i < kBitsetWords; ++i) {
+          result.bits[i] &= ~b.bits[i];
+        }
+      } else {
+        for (uint16_t low : b.array) {
+          result.bits[low >> 6] &= ~(uint64_t(1) << (low & 63));
+        }
+      }
+    } else if (b.isBitset()) {
+      for (uint16_t low : a.array) {
+        if (!b.contains(low)) result.array.push_back(low);
+      }
+    } else {
+      std::set_difference(a.array.begin(), a.array.end(), b.array.begin(),
+                          b.array.end(), std::back_inserter(result.array));
+    }
+    result.normalize();
+    return result;
+  }
+
+  IndexVector<Container> containers;
+
+  IndexVector<Container>::iterator findContainer(uint16_t key) {
+    return std::lower_bound(
+        containers.begin(), containers.end(), key,
+        [](const Container& c, uint16_t k) { return c.key < k; });
+  }
+
+  IndexVector<Container>::const_iterator findContainer(uint16_t key) const {
+    return std::lower_bound(
+        containers.begin(), containers.end(), key,
+        [](const Container& c, uint16_t k) { return c.key < k; });
+  }
+
+ public:
+  bool add(uint32_t value) {
+    uint16_t key = static_cast<uint16_t>(value >> 16);
+    auto it = findContainer(key);
+    if (it == containers.end() || it->key != key) {
+      it = containers.insert(it, Container(key));
+    }
+    return it->add(static_cast<uint16_t>(value & 0xFFFF));
+  }
+
+  bool remove(uint32_t value) {
+    uint16_t key = static_cast<uint16_t>(value >> 16);
+    auto it = findContainer(key);
+    if (it == containers.end() || it->key != key) return false;
+
+    bool removed = it->remove(static_cast<uint16_t>(value & 0xFFFF));
+    if (it->cardinality == 0) containers.erase(it);
+    return removed;
+  }
+
+  bool contains(uint32_t value) const {
+    uint16_t key = static_cast<uint16_t>(value >> 16);
+    auto it = findContainer(key);
+    return it != containers.end() && it->key == key &&
+           it->contains(static_cast<uint16_t>(value & 0xFFFF));
+  }
+
+  size_t cardinality() const {
+    size_t count = 0;
+    for (const Container& c : containers) count += c.cardinality;
+    return count;
+  }
+
+  bool isEmpty() const { return containers.empty(); }
+
+  RoaringBitmap operator&(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    size_t i = 0, j = 0;
+    while (i < containers.size() && j < other.containers.size()) {
+      const Container& a = containers[i];
+      const Container& b = other.containers[j];
+      if (a.key < b.key) {
+        ++i;
+      } else if (b.key < a.key) {
+        ++j;
+      } else {
+        Container c = intersect(a, b);
+        if (c.cardinality > 0) result.containers.push_back(std::move(c));
+        ++i;
+        ++j;
+      }
+    }
+    return result;
+  }
+
+  RoaringBitmap operator|(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    size_t i = 0, j = 0;
+    while (i < containers.size() || j < other.containers.size()) {
+      bool takeLeft = j == other.containers.size() ||
+                      (i < containers.size() &&
+                       containers[i].key < other.containers[j].key);
+      if (takeLeft) {
+        result.containers.push_back(containers[i++]);
+      } else if (i == containers.size() ||
+                 other.containers[j].key < containers[i].key) {
+        result.containers.push_back(other.containers[j++]);
+      } else {
+        result.containers.push_back(
+            unite(containers[i++], other.containers[j++]));
+      }
+    }
+    return result;
+  }
+
+  // Значения this, которых нет в other
+  RoaringBitmap operator-(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    size_t j = 0;
+    for (const Container& a : containers) {
+      while (j < other.containers.size() && other.containers[j].key < a.key) {
+        ++j;
+      }
+      if (j == other.containers.size() || other.containers[j].key != a.key) {
+        result.containers.push_back(a);
+        continue;
+      }
+      Container c = subtract(a, other.containers[j]);
+      if (c.cardinality > 0) result.containers.push_back(std::move(c));
+    }
+    return result;
+  }
+
+  // |this & other| без построения пересечения
+  size_t andCardinality(const RoaringBitmap& other) const {
+    size_t count = 0;
+    size_t i = 0, j = 0;
+    while (i < containers.size() && j < other.containers.size()) {
+      if (containers[i].key < other.containers[j].key) {
+        ++i;
+      } else if (other.containers[j].key < containers[i].key) {
+        ++j;
+      } else {
+        count += intersectCount(containers[i++], other.containers[j++]);
+      }
+    }
+    return count;
+  }
+
+  // fn(value) для всех значений по возрастанию
+  template <typename Fn>
+  void forEach(Fn fn) const {
+    for (const Container& c : containers) {
+      c.forEach(static_cast<uint32_t>(c.key) << 16, fn);
+    }
+  }
+
+  size_t memoryUsage() const {
+    size_t bytes = sizeof(*this) + containers.capacity() * sizeof(Container);
+    for (const Container& c : containers) {
+      bytes += c.array.capacity() * sizeof(uint16_t) +
+               c.bits.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+  }
+};
@@ -0,0 +1,318 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../Diagnostics/MemoryAccounting.hpp"
+#include "Tokenizer.hpp"
+
+// Расстояние Левенштейна через битовый алгоритм Майерса: шаблон до 64
+// символов обрабатывается за O(|text|) операций над словом. Таблица
+// Peq строится один раз на шаблон и переиспользуется для всех сравнений.
+class MyersPattern {
+ private:
+  std::string pattern;
+  uint64_t peq[256];
+
+  static int dynamicDistance(const std::string& a, const std::string& b) {
+    std::vector<int> row(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); ++j) row[j] = static_cast<int>(j);
+
+    for (size_t i = 1; i <= a.size(); ++i) {
+      int diagonal = row[0];
+      row[0] = static_cast<int>(i);
+      for (size_t j = 1; j <= b.size(); ++j) {
+        int above = row[j];
+        row[j] = std::min({row[j] + 1, row[j - 1] + 1,
+                           diagonal + (a[i - 1] == b[j - 1] ? 0 : 1)});
+        diagonal = above;
+      }
+    }
+    return row[b.size()];
+  }
+
+ public:
+  static const size_t kMaxLength = 64;
+
+  MyersPattern(const std::string& pattern) : pattern(pattern) {
+    std::fill(peq, peq + 256, 0);
+    if (pattern.size() > kMaxLength) return;
+
+    for (size_t i = 0; i < pattern.size(); ++i) {
+      peq[static_cast<unsigned char>(pattern[i])] |= uint64_t(1) << i;
+    }
+  }
+
+  const std::string& getPattern() const { return pattern; }
+
+  int distance(const std::string& text) const {
+    const size_t m = pattern.size();
+    if (m == 0) return static_cast<int>(text.size());
+    if (m > kMaxLength) return dynamicDistance(pattern, text);
+
+    const uint64_t highBit = uint64_t(1) << (m - 1);
+    uint64_t pv = m == 64 ? ~uint64_t(0) : (uint64_t(1) << m) - 1;
+    uint64_t mv = 0;
+    int score = static_cast<int>(m);
+
+    for (char c : text) {
+      uint64_t eq = peq[static_cast<unsigned char>(c)];
+      uint64_t xv = eq | mv;
+      uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+      uint64_t ph = mv | ~(xh | pv);
+      uint64_t mh = pv & xh;
+
+      if (ph & highBit) {
+        ++score;
+      } else if (mh & highBit) {
+        --score;
+      }
+
+      // Верхняя граница матрицы растёт на 1 в каждом столбце
+      ph = (ph << 1) | 1;
+      mh <<= 1;
+      pv = mh | ~(xv | ph);
+      mv = ph & xv;
+    }
+    return score;
+  }
+};
+
+// Нечёткий поиск по словам: BK-деревья над уникальными словами, по одному
+// на длину слова (слова длиннее запроса больше чем на k правок заранее не
+// подходят), у каждого слова список документов (Id -> маска полей, где оно
+// встретилось). Удалённые слова остаются узлами без документов и не
+// выдаются, пока таких в дереве не больше половины: тогда дерево
+// перестраивается из живых слов, а места мёртвых узлов идут под новые
+// слова. Память считается за MemoryTag::INDEXES.
+template <typename Id>
+class FuzzyIndex {
+ private:
+  struct Node {
+    std::string word;
+    // (расстояние до родителя, индекс узла)
+    IndexVector<std::pair<int, int>> children;
+
+    Node(const std::string& word) : word(word) {}
+  };
+
+  // Документы лежат отдельно от узлов, чтобы обход дерева не тащил их в кэш
+  using Postings = TaggedMap<Id, unsigned, MemoryTag::INDEXES>;
+
+  // Дерево слов одной длины; dead - узлы без документов
+  struct Tree {
+    int root;
+    int size;
+    int dead;
+  };
+
+  // Меньшие деревья не перестраиваются: мёртвые узлы в них дёшевы
+  static constexpr int kMinRebuildSize = 32;
+
+  IndexVector<Node> nodes;
+  IndexVector<Postings> postings;
+  TaggedMap<std::string, int, MemoryTag::INDEXES> nodeByWord;
+  // Дерево по длине слова; root == -1 - слов такой длины нет
+  IndexVector<Tree> trees;
+  // Места в nodes, освобождённые перестройкой
+  IndexVector<int> freeNodes;
+
+  // Подвесить узел index в дерево tree
+  void link(Tree& tree, int index) {
+    if (tree.root < 0) {
+      tree.root = index;
+      return;
+    }
+
+    MyersPattern pattern(nodes[index].word);
+    int current = tree.root;
+    while (true) {
+      int d = pattern.distance(nodes[current].word);
+      int next = -1;
+      for (const auto& [childDistance, child] : nodes[current].children) {
+        if (childDistance == d) {
+          next = child;
+          break;
+        }
+      }
+      if (next < 0) {
+        nodes[current].children.push_back({d, index});
+        return;
+      }
+      current = next;
+    }
+  }
+
+  int findOrInsert(const std::string& word) {
+    auto it = nodeByWord.find(word);
+    if (it != nodeByWord.end()) return it->second;
+
+    int index;
+    if (freeNodes.empty()) {
+      index = static_cast<int>(nodes.size());
+      nodes.emplace_back(word);
+      postings.emplace_back();
+    } else {
+      index = freeNodes.back();
+      freeNodes.pop_back();
+      nodes[index].word = word;
+    }
+    nodeByWord.insert({word, index});
+    if (trees.size() <= word.size()) {
+      trees.resize(word.size() + 1, Tree{-1, 0, 0});
+    }
+    // Документов у нового узла ещё нет, их добавит add
+    Tree& tree = trees[word.size()];
+    ++tree.size;
+    ++tree.dead;
+    link(tree, index);
+    return index;
+  }
+
+  // Дерево слов длины length заново из живых узлов; места мёртвых
+  // освобождаются. Перестройка идёт после size / 2 удалений, так что на
+  // одно удаление приходится O(1) вставок.
+  void rebuild(size_t length) {
+    Tree& tree = trees[length];
+    std::vector<int> live;
+    std::vector<int> stack;
+    if (tree.root >= 0) stack.push_back(tree.root);
+    while (!stack.empty()) {
+      int index = stack.back();
+      stack.pop_back();
+
+      Node& node = nodes[index];
+      for (const auto& child : node.children) stack.push_back(child.second);
+      IndexVector<std::pair<int, int>>().swap(node.children);
+      if (postings[index].empty()) {
+        nodeByWord.erase(node.word);
+        std::string().swap(node.word);
+        Postings().swap(postings[index]);
+        freeNodes.push_back(index);
+      } else {
+        live.push_back(index);
+      }
+    }
+
+    tree = Tree{-1, static_cast<int>(live.size()), 0};
+    for (int index : live) link(tree, index);
+  }
+
+ public:
+  void add(const Id& id, const std::string& text, unsigned field) {
+    for (const std::string& token : tokenizeWords(text)) {
+      int index = findOrInsert(token);
+      if (postings[index].empty()) --trees[token.size()].dead;
+      postings[index][id] |= field;
+    }
+  }
+
+  void remove(const Id& id, const std::string& text, unsigned field) {
+    for (const std::string& token : tokenizeWords(text)) {
+      auto it = nodeByWord.find(token);
+      if (it == nodeByWord.end()) continue;
+
+      auto& documents = postings[it->second];
+      auto posting = documents.find(id);
+      if (posting == documents.end()) continue;
+
+      posting->second &= ~field;
+      if (posting->second != 0) continue;
+      documents.erase(posting);
+      if (!documents.empty()) continue;
+
+      Tree& tree = trees[token.size()];
+      ++tree.dead;
+      if (tree.size >= kMinRebuildSize && tree.dead * 2 > tree.size) {
+        rebuild(token.size());
+      }
+    }
+  }
+
+  // Живые слова на расстоянии не больше maxDistance: (узел, расстояние)
+  std::vector<std::pair<int, int>> lookup(const std::string& word,
+                                          int maxDistance) const {
+    std::vector<std::pair<int, int>> found;
+
+    MyersPattern pattern(word);
+    std::vector<int> stack;
+    size_t minLength = word.size() > static_cast<size_t>(maxDistance)
+                           ? word.size() - maxDistance
+                           : 0;
+    size_t maxLength = word.size() + maxDistance;
+    for (size_t length = minLength;
+         length <= maxLength && length < trees.size(); ++length) {
+      if (trees[length].root >= 0) stack.push_back(trees[length].root);
+    }
+
+    while (!stack.empty()) {
+      const Node& node = nodes[stack.back()];
+      int index = stack.back();
+      stack.pop_back();
+
+      int d = pattern.distance(node.word);
+      if (d <= maxDistance && !postings[index].empty()) {
+        found.push_back({index, d});
+      }
+      for (const auto& [childDistance, child] : node.children) {
+        if (childDistance >= d - maxDistance &&
+            childDistance <= d + maxDistance) {
+          stack.push_back(child);
+        }
+      }
+    }
+    return found;
+  }
+
+  struct Hit {
+    unsigned fields;
+    int distance;
+  };
+
+  // Документы, где каждое слово запроса нашлось с точностью до
+  // maxDistance правок; distance - сумма лучших расстояний по словам
+  std::unordered_map<Id, Hit> search(const std::string& query,
+                                     int maxDistance) const {
+    std::unordered_map<Id, Hit> hits;
+    std::vector<std::string> words = tokenizeWords(query);
+
+    for (size_t w = 0; w < words.size(); ++w) {
+      std::unordered_map<Id, Hit> wordHits;
+      for (const auto& [index, d] : lookup(words[w], maxDistance)) {
+        for (const auto& [id, fields] : postings[index]) {
+          if (w > 0 && hits.find(id) == hits.end()) continue;
+
+          auto it = wordHits.find(id);
+          if (it == wordHits.end()) {
+            wordHits.insert({id, Hit{fields, d}});
+          } else {
+            it->second.fields |= fields;
+            it->second.distance = std::min(it->second.distance, d);
+          }
+        }
+      }
+
+      if (w == 0) {
+        hits = std::move(wordHits);
+        continue;
+      }
+      for (auto it = hits.begin(); it != hits.end();) {
+        auto wordHit = wordHits.find(it->first);
+        if (wordHit == wordHits.end()) {
+          it = hits.erase(it);
+        } else {
+          it->second.fields |= wordHit->second.fields;
+          it->second.distance += wordHit->second.distance;
+          ++it;
+        }
+      }
+    }
+    return hits;
+  }
+
+  // Слова в деревьях, вместе с ещё не убранными удалёнными
+  size_t wordCount() const { return nodeByWord.size(); }
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "../Diagnostics/MemoryAccounting.hpp"
+
+// Списки вхождений слов, упорядоченные по вкладу: у каждого слова -
+// номера записей по убыванию impact, при равном impact - по before(a, b),
+// затем по номеру. Ранжированный поиск читает списки слов запроса с
+// начала и останавливается, когда оставшиеся записи уже не обгонят
+// найденные. Вклад и порядок записи не должны меняться, пока она в
+// индексе. Память считается за MemoryTag::INDEXES.
+template <typename Before>
+class ImpactIndex {
+ public:
+  struct Posting {
+    uint32_t ordinal;
+    uint32_t impact;
+  };
+  using PostingList = TaggedVector<Posting, MemoryTag::INDEXES>;
+
+ private:
+  TaggedMap<std::string, PostingList, MemoryTag::INDEXES> lists;
+  Before before;
+
+  bool precedes(const Posting& a, const Posting& b) const {
+    if (a.impact != b.impact) return a.impact > b.impact;
+    if (before(a.ordinal, b.ordinal)) return true;
+    if (before(b.ordinal, a.ordinal)) return false;
+    return a.ordinal < b.ordinal;
+  }
+
+  typename PostingList::iterator place(PostingList& list,
+                                       const Posting& posting) {
+    return std::lower_bound(
+        list.begin(), list.end(), posting,
+        [this](const Posting& a, const Posting& b) { return precedes(a, b); });
+  }
+
+ public:
+  explicit ImpactIndex(Before before) : before(before) {}
+
+  ImpactIndex(const ImpactIndex&) = delete;
+  ImpactIndex& operator=(const ImpactIndex&) = delete;
+
+  void add(const std::string& word, uint32_t ordinal, uint32_t impact) {
+    PostingList& list = lists[word];
+    Posting posting{ordinal, impact};
+    list.insert(place(list, posting), posting);
+  }
+
+  // impact - тот же, с которым запись добавлялась
+  void remove(const std::string& word, uint32_t ordinal, uint32_t impact) {
+    auto it = lists.find(word);
+    if (it == lists.end()) return;
+
+    PostingList& list = it->second;
+    auto at = place(list, {ordinal, impact});
+    if (at != list.end() && at->ordinal == ordinal) list.erase(at);
+    if (list.empty()) lists.erase(it);
+  }
+
+  // nullptr - слова нет ни в одной записи
+  const PostingList* find(const std::string& word) const {
+    auto it = lists.find(word);
+    return it == lists.end() ? nullptr : &it->second;
+  }
+
+  size_t wordCount() const { return lists.size(); }
+};
@@ -0,0 +1,478 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <new>
+#include <string>
+
+#include "../Diagnostics/MemoryAccounting.hpp"
+
+inline char foldChar(char c) {
+  return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+// Сравнение строк без учёта регистра: <0, 0 или >0
+inline int compareFolded(const std::string& a, const std::string& b) {
+  size_t n = std::min(a.size(), b.size());
+  for (size_t i = 0; i < n; ++i) {
+    unsigned char x = static_cast<unsigned char>(foldChar(a[i]));
+    unsigned char y = static_cast<unsigned char>(foldChar(b[i]));
+    if (x != y) return x < y ? -1 : 1;
+  }
+  return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
+}
+
+// Первые 8 байт строки без учёта регистра одним числом. Если у двух строк
+// эти числа разные, они упорядочены так же, как сами строки.
+inline uint64_t foldedPrefix(const std::string& key) {
+  uint64_t prefix = 0;
+  for (size_t i = 0; i < 8; ++i) {
+    prefix <<= 8;
+    if (i < key.size()) {
+      prefix |= static_cast<unsigned char>(foldChar(key[i]));
+    }
+  }
+  return prefix;
+}
+
+// Ключ записи упорядоченного индекса: строка и уникальное значение,
+// которое упорядочивает записи с равными строками
+struct OrderedKey {
+  const std::string* key;
+  const std::string* tie;
+};
+
+// Упорядоченный индекс: B+-дерево номеров записей по (key без учёта
+// регистра, tie). Строки в узлах не хранятся: у записи лежат её номер и
+// первые 8 байт ключа числом, полный ключ берётся через keys(номер) лишь
+// при совпадении этих байт, и поиск в узле идёт по плотному массиву
+// чисел на пару кэш-линий. Листы связаны для обхода по порядку.
+// Внутренние узлы знают размеры поддеревьев, поэтому место записи (ранг)
+// и запись по месту находятся за O(log n). Ключ записи не должен
+// меняться, пока она в индексе. Память считается за MemoryTag::INDEXES.
+template <typename Keys>
+class OrderedIndex {
+ public:
+  static constexpr int kFanout = 16;
+
+ private:
+  struct Node {
+    bool leaf;
+    int size;
+    // Записи листа или наименьшие записи поддеревьев внутреннего узла
+    uint64_t prefix[kFanout];
+    uint32_t ordinal[kFanout];
+
+    explicit Node(bool leaf) : leaf(leaf), size(0) {}
+  };
+
+  struct Leaf : Node {
+    Leaf* next;
+
+    Leaf() : Node(true), next(nullptr) {}
+  };
+
+  struct Inner : Node {
+    Node* child[kFanout];
+    uint32_t count[kFanout];
+
+    Inner() : Node(false) {}
+  };
+
+  // Положение ключа относительно записей с той же строкой
+  enum class Tie { FIRST, EXACT, LAST };
+
+  struct Probe {
+    uint64_t prefix;
+    const std::string* key;
+    const std::string* tie;
+    Tie mode;
+  };
+
+  Keys keys;
+  Node* root;
+  Leaf* first;
+  size_t count;
+
+  template <typename T>
+  static T* create() {
+    return new (TaggedAllocator<T, MemoryTag::INDEXES>().allocate(1)) T();
+  }
+
+  static void destroy(Node* node) {
+    if (node->leaf) {
+      TaggedAllocator<Leaf, MemoryTag::INDEXES>().deallocate(
+          static_cast<Leaf*>(node), 1);
+    } else {
+      TaggedAllocator<Inner, MemoryTag::INDEXES>().deallocate(
+          static_cast<Inner*>(node), 1);
+    }
+  }
+
+  static void destroyTree(Node* node) {
+    if (!node->leaf) {
+      Inner* inner = static_cast<Inner*>(node);
+      for (int i = 0; i < inner->size; ++i) destroyTree(inner->child[i]);
+    }
+    destroy(node);
+  }
+
+  Probe probeFor(uint32_t ordinal) const {
+    OrderedKey key = keys(ordinal);
+    return {foldedPrefix(*key.key), key.key, key.tie, Tie::EXACT};
+  }
+
+  // <0 - probe раньше записи (prefix, ordinal), 0 - это она, >0 - позже
+  int compare(const Probe& probe, uint64_t prefix, uint32_t ordinal) const {
+    if (probe.prefix != prefix) return probe.prefix < prefix ? -1 : 1;
+    OrderedKey other = keys(ordinal);
+    int cmp = compareFolded(*probe.key, *other.key);
+    if (cmp != 0) return cmp;
+    if (probe.mode != Tie::EXACT) return probe.mode == Tie::FIRST ? -1 : 1;
+    return probe.tie->compare(*other.tie);
+  }
+
+  // Сколько записей узла раньше probe (inclusive - не позже); двоичный
+  // поиск, чтобы реже доставать полные ключи при общих префиксах
+  int countBefore(const Node* node, const Probe& probe, bool inclusive) const {
+    int low = 0;
+    int high = node->size;
+    while (low < high) {
+      int middle = (low + high) / 2;
+      if (compare(probe, node->prefix[middle], node->ordinal[middle]) >=
+          (inclusive ? 0 : 1)) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return low;
+  }
+
+  // Потомок, в поддереве которого probe лежит или лёг бы
+  int childFor(const Inner* inner, const Probe& probe, bool inclusive) const {
+    return std::max(countBefore(inner, probe, inclusive) - 1, 0);
+  }
+
+  static uint32_t total(const Node* node) {
+    if (node->leaf) return static_cast<uint32_t>(node->size);
+    const Inner* inner = static_cast<const Inner*>(node);
+    uint32_t sum = 0;
+    for (int i = 0; i < inner->size; ++i) sum += inner->count[i];
+    return sum;
+  }
+
+  // Перенести n записей source с места from в target на место at
+  static void moveEntries(Node* source, int from, int n, Node* target,
+                          int at) {
+    auto shift = [](auto* array, int begin, int end, int delta) {
+      if (delta > 0) {
+        std::copy_backward(array + begin, array + end, array + end + delta);
+      } else {
+        std::copy(array + begin, array + end, array + begin + delta);
+      }
+    };
+    auto transfer = [&](auto* src, auto* dst) {
+      shift(dst, at, target->size, n);
+      std::copy(src + from, src + from + n, dst + at);
+      shift(src, from + n, source->size, -n);
+    };
+
+    transfer(source->prefix, target->prefix);
+    transfer(source->ordinal, target->ordinal);
+    if (!source->leaf) {
+      Inner* in = static_cast<Inner*>(source);
+      Inner* out = static_cast<Inner*>(target);
+      transfer(in->child, out->child);
+      transfer(in->count, out->count);
+    }
+    source->size -= n;
+    target->size += n;
+  }
+
+  static void insertEntry(Node* node, int at, uint64_t prefix,
+                          uint32_t ordinal) {
+    std::copy_backward(node->prefix + at, node->prefix + node->size,
+                       node->prefix + node->size + 1);
+    std::copy_backward(node->ordinal + at, node->ordinal + node->size,
+                       node->ordinal + node->size + 1);
+    node->prefix[at] = prefix;
+    node->ordinal[at] = ordinal;
+    ++node->size;
+  }
+
+  static void insertChild(Inner* inner, int at, Node* child) {
+    std::copy_backward(inner->child + at, inner->child + inner->size,
+                       inner->child + inner->size + 1);
+    std::copy_backward(inner->count + at, inner->count + inner->size,
+                       inner->count + inner->size + 1);
+    inner->child[at] = child;
+    inner->count[at] = total(child);
+    insertEntry(inner, at, child->prefix[0], child->ordinal[0]);
+  }
+
+  static void removeEntry(Node* node, int at) {
+    std::copy(node->prefix + at + 1, node->prefix + node->size,
+              node->prefix + at);
+    std::copy(node->ordinal + at + 1, node->ordinal + node->size,
+              node->ordinal + at);
+    if (!node->leaf) {
+      Inner* inner = static_cast<Inner*>(node);
+      std::copy(inner->child + at + 1, inner->child + inner->size,
+                inner->child + at);
+      std::copy(inner->count + at + 1, inner->count + inner->size,
+                inner->count + at);
+    }
+    --node->size;
+  }
+
+  // Наименьшая запись потомка c изменилась
+  static void refreshMin(Inner* inner, int c) {
+    inner->prefix[c] = inner->child[c]->prefix[0];
+    inner->ordinal[c] = inner->child[c]->ordinal[0];
+  }
+
+  // Вставка в поддерево. Полный узел сначала делится пополам; правая
+  // половина возвращается, чтобы родитель её принял.
+  Node* insert(Node* node, const Probe& probe, uint32_t ordinal) {
+    if (node->leaf) {
+      Leaf* leaf = static_cast<Leaf*>(node);
+      int at = countBefore(leaf, probe, false);
+      Leaf* right = nullptr;
+      if (leaf->size == kFanout) {
+        right = create<Leaf>();
+        moveEntries(leaf, kFanout / 2, kFanout / 2, right, 0);
+        right->next = leaf->next;
+        leaf->next = right;
+        if (at > kFanout / 2) {
+          leaf = right;
+          at -= kFanout / 2;
+        }
+      }
+      insertEntry(leaf, at, probe.prefix, ordinal);
+      return right;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    int c = childFor(inner, probe, false);
+    Node* split = insert(inner->child[c], probe, ordinal);
+    refreshMin(inner, c);
+    if (split == nullptr) {
+      ++inner->count[c];
+      return nullptr;
+    }
+
+    inner->count[c] = total(inner->child[c]);
+    Inner* right = nullptr;
+    int at = c + 1;
+    if (inner->size == kFanout) {
+      right = create<Inner>();
+      moveEntries(inner, kFanout / 2, kFanout / 2, right, 0);
+      if (at > kFanout / 2) {
+        insertChild(right, at - kFanout / 2, split);
+        return right;
+      }
+    }
+    insertChild(inner, at, split);
+    return right;
+  }
+
+  // Потомок c стал меньше половины: он сливается с соседом, если вместе
+  // они помещаются в узел, иначе записи делятся между ними поровну
+  void rebalance(Inner* inner, int c) {
+    int left = c + 1 < inner->size ? c : c - 1;
+    Node* a = inner->child[left];
+    Node* b = inner->child[left + 1];
+
+    if (a->size + b->size <= kFanout) {
+      moveEntries(b, 0, b->size, a, a->size);
+      if (a->leaf) static_cast<Leaf*>(a)->next = static_cast<Leaf*>(b)->next;
+      inner->count[left] += inner->count[left + 1];
+      destroy(b);
+      removeEntry(inner, left + 1);
+      refreshMin(inner, left);
+      return;
+    }
+
+    int half = (a->size + b->size) / 2;
+    if (a->size < half) {
+      moveEntries(b, 0, half - a->size, a, a->size);
+    } else {
+      moveEntries(a, half, a->size - half, b, 0);
+    }
+    inner->count[left] = total(a);
+    inner->count[left + 1] = total(b);
+    refreshMin(inner, left);
+    refreshMin(inner, left + 1);
+  }
+
+  bool erase(Node* node, const Probe& probe) {
+    if (node->leaf) {
+      int at = countBefore(node, probe, false);
+      if (at == node->size ||
+          compare(probe, node->prefix[at], node->ordinal[at]) != 0) {
+        return false;
+      }
+      removeEntry(node, at);
+      return true;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    int c = childFor(inner, probe, true);
+    Node* child = inner->child[c];
+    if (!erase(child, probe)) return false;
+
+    --inner->count[c];
+    if (child->size > 0) refreshMin(inner, c);
+    if (child->size < kFanout / 2 && inner->size > 1) rebalance(inner, c);
+    return true;
+  }
+
+ public:
+  // Место в индексе; обход по возрастанию ключей
+  class Cursor {
+   private:
+    const Leaf* leaf;
+    int at;
+
+    void skipEnd() {
+      while (leaf != nullptr && at == leaf->size) {
+        leaf = leaf->next;
+        at = 0;
+      }
+    }
+
+   public:
+    Cursor() : leaf(nullptr), at(0) {}
+    Cursor(const Leaf* leaf, int at) : leaf(leaf), at(at) { skipEnd(); }
+
+    // false - записи кончились
+    bool valid() const { return leaf != nullptr; }
+    uint32_t ordinal() const { return leaf->ordinal[at]; }
+
+    void next() {
+      ++at;
+      skipEnd();
+    }
+  };
+
+  explicit OrderedIndex(Keys keys)
+      : keys(keys), root(nullptr), first(nullptr), count(0) {
+    first = create<Leaf>();
+    root = first;
+  }
+
+  ~OrderedIndex() { destroyTree(root); }
+
+  OrderedIndex(const OrderedIndex&) = delete;
+  OrderedIndex& operator=(const OrderedIndex&) = delete;
+
+  size_t size() const { return count; }
+
+  void insert(uint32_t ordinal) {
+    Node* split = insert(root, probeFor(ordinal), ordinal);
+    if (split != nullptr) {
+      Inner* top = create<Inner>();
+      insertChild(top, 0, root);
+      insertChild(top, 1, split);
+      root = top;
+    }
+    ++count;
+  }
+
+  // Ключ записи должен быть тем же, что при вставке
+  bool erase(uint32_t ordinal) {
+    if (!erase(root, probeFor(ordinal))) return false;
+
+    --count;
+    while (!root->leaf && root->size == 1) {
+      Node* only = static_cast<Inner*>(root)->child[0];
+      destroy(root);
+      root = only;
+    }
+    return true;
+  }
+
+  Cursor begin() const { return Cursor(first, 0); }
+
+  // Первая запись со строкой не меньше key; afterKey - первая после
+  // всех записей со строкой key. В rank - сколько записей раньше неё.
+  Cursor seek(const std::string& key, bool afterKey = false,
+              size_t* rank = nullptr) const {
+    return locate({foldedPrefix(key), &key, nullptr,
+                   afterKey ? Tie::LAST : Tie::FIRST},
+                  rank);
+  }
+
+  // Сколько записей со строкой меньше key (afterKey - не больше key)
+  size_t rank(const std::string& key, bool afterKey = false) const {
+    size_t before;
+    seek(key, afterKey, &before);
+    return before;
+  }
+
+  // Первая запись после (key, tie)
+  Cursor seekAfter(const std::string& key, const std::string& tie) const {
+    Probe probe = {foldedPrefix(key), &key, &tie, Tie::EXACT};
+    size_t rank;
+    Cursor cursor = locate(probe, &rank);
+    if (cursor.valid() &&
+        compare(probe, foldedPrefix(*keys(cursor.ordinal()).key),
+                cursor.ordinal()) == 0) {
+      cursor.next();
+    }
+    return cursor;
+  }
+
+  // Место записи среди всех по порядку; false - её нет в индексе
+  bool rankOf(uint32_t ordinal, size_t& rank) const {
+    Cursor cursor = locate(probeFor(ordinal), &rank);
+    return cursor.valid() && cursor.ordinal() == ordinal;
+  }
+
+  // Запись на месте position (с нуля)
+  Cursor at(size_t position) const {
+    if (position >= count) return Cursor();
+
+    const Node* node = root;
+    while (!node->leaf) {
+      const Inner* inner = static_cast<const Inner*>(node);
+      int c = 0;
+      while (position >= inner->count[c]) position -= inner->count[c++];
+      node = inner->child[c];
+    }
+    return Cursor(static_cast<const Leaf*>(node), static_cast<int>(position));
+  }
+
+  size_t memoryUsage() const {
+    size_t bytes = 0;
+    forEachNode(root, [&](const Node* node) {
+      bytes += node->leaf ? sizeof(Leaf) : sizeof(Inner);
+    });
+    return bytes;
+  }
+
+ private:
+  // Первая запись не раньше probe; в rank - сколько записей раньше неё
+  Cursor locate(const Probe& probe, size_t* rank) const {
+    size_t before = 0;
+    const Node* node = root;
+    while (!node->leaf) {
+      const Inner* inner = static_cast<const Inner*>(node);
+      int c = childFor(inner, probe, false);
+      for (int i = 0; i < c; ++i) before += inner->count[i];
+      node = inner->child[c];
+    }
+    int at = countBefore(node, probe, false);
+    if (rank != nullptr) *rank = before + static_cast<size_t>(at);
+    return Cursor(static_cast<const Leaf*>(node), at);
+  }
+
+  template <typename Fn>
+  static void forEachNode(const Node* node, Fn fn) {
+    fn(node);
+    if (node->leaf) return;
+    const Inner* inner = static_cast<const Inner*>(node);
+    for (int i = 0; i < inner->size; ++i) forEachNode(inner->child[i], fn);
+  }
+};
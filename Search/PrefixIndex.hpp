@@ -0,0 +1,263 @@
+#pragma once
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "../Diagnostics/MemoryAccounting.hpp"
+
+struct Completion {
+  std::string text;
+  int weight;
+
+  Completion() : weight(0) {}
+  Completion(const std::string& text, int weight)
+      : text(text), weight(weight) {}
+};
+
+// Сжатое префиксное дерево (radix trie) с весами ключей. В каждом узле
+// хранится максимальный вес в поддереве, поэтому лучшие N дополнений
+// находятся перебором по убыванию этого веса, без обхода всего поддерева.
+// Память считается за MemoryTag::INDEXES.
+class PrefixIndex {
+ private:
+  struct Node {
+    std::string label;
+    // Отсортированы по первой букве метки
+    IndexVector<int> children;
+    // Вес ключа, который заканчивается в этом узле; 0 - ключа нет
+    int weight;
+    int bestWeight;
+
+    Node() : weight(0), bestWeight(0) {}
+    Node(const std::string& label) : label(label), weight(0), bestWeight(0) {}
+  };
+
+  struct Candidate {
+    int weight;
+    int node;
+    bool complete;
+    std::string text;
+  };
+
+  struct WorseCandidate {
+    bool operator()(const Candidate& a, const Candidate& b) const {
+      if (a.weight != b.weight) return a.weight < b.weight;
+      return a.text > b.text;
+    }
+  };
+
+  IndexVector<Node> nodes;
+  IndexVector<int> freeNodes;
+  size_t keyCount;
+
+  int allocate(const std::string& label) {
+    if (!freeNodes.empty()) {
+      int index = freeNodes.back();
+      freeNodes.pop_back();
+      nodes[index] = Node(label);
+      return index;
+    }
+    nodes.emplace_back(label);
+    return static_cast<int>(nodes.size()) - 1;
+  }
+
+  void release(int index) {
+    nodes[index] = Node();
+    freeNodes.push_back(index);
+  }
+
+  int findChild(int node, char c) const {
+    for (int child : nodes[node].children) {
+      if (nodes[child].label[0] == c) return child;
+    }
+    return -1;
+  }
+
+  void insertChild(int node, int child) {
+    IndexVector<int>& children = nodes[node].children;
+    char c = nodes[child].label[0];
+    auto it = children.begin();
+    while (it != children.end() && nodes[*it].label[0] < c) ++it;
+    children.insert(it, child);
+  }
+
+  void replaceChild(int node, int oldChild, int newChild) {
+    for (int& child : nodes[node].children) {
+      if (child == oldChild) child = newChild;
+    }
+  }
+
+  void eraseChild(int node, int child) {
+    IndexVector<int>& children = nodes[node].children;
+    children.erase(std::find(children.begin(), children.end(), child));
+  }
+
+  void refresh(int index) {
+    Node& node = nodes[index];
+    int best = node.weight;
+    for (int child : node.children) {
+      best = std::max(best, nodes[child].bestWeight);
+    }
+    node.bestWeight = best;
+  }
+
+  static size_t commonLength(const std::string& key, size_t from,
+                             const std::string& label) {
+    size_t length = 0;
+    while (length < label.size() && from + length < key.size() &&
+           key[from + length] == label[length]) {
+      ++length;
+    }
+    return length;
+  }
+
+  // Путь от корня до узла, где заканчивается key; пустой, если ключа нет
+  std::vector<int> findPath(const std::string& key) const {
+    std::vector<int> path = {0};
+    size_t pos = 0;
+    while (pos < key.size()) {
+      int child = findChild(path.back(), key[pos]);
+      if (child < 0) return {};
+
+      const std::string& label = nodes[child].label;
+      if (commonLength(key, pos, label) != label.size()) return {};
+      pos += label.size();
+      path.push_back(child);
+    }
+    return path;
+  }
+
+ public:
+  PrefixIndex() : nodes(1), keyCount(0) {}
+
+  void add(const std::string& key, int weight = 1) {
+    if (key.empty() || weight <= 0) return;
+
+    std::vector<int> path = {0};
+    size_t pos = 0;
+    while (pos < key.size()) {
+      int node = path.back();
+      int child = findChild(node, key[pos]);
+      if (child < 0) {
+        int leaf = allocate(key.substr(pos));
+        insertChild(node, leaf);
+        path.push_back(leaf);
+        break;
+      }
+
+      size_t common = commonLength(key, pos, nodes[child].label);
+      if (common < nodes[child].label.size()) {
+        int middle = allocate(nodes[child].label.substr(0, common));
+        nodes[child].label.erase(0, common);
+        nodes[middle].children.push_back(child);
+        replaceChild(node, child, middle);
+        refresh(middle);
+        child = middle;
+      }
+      path.push_back(child);
+      pos += common;
+    }
+
+    Node& last = nodes[path.back()];
+    if (last.weight == 0) ++keyCount;
+    last.weight += weight;
+    for (auto it = path.rbegin(); it != path.rend(); ++it) refresh(*it);
+  }
+
+  bool remove(const std::string& key, int weight = 1) {
+    std::vector<int> path = findPath(key);
+    if (path.size() < 2 || nodes[path.back()].weight == 0) return false;
+
+    Node& last = nodes[path.back()];
+    last.weight = std::max(0, last.weight - weight);
+    if (last.weight == 0) --keyCount;
+
+    // Лишние узлы: пустой лист удаляется, пустой узел с одним ребёнком
+    // склеивается с ним
+    for (size_t i = path.size() - 1; i > 0; --i) {
+      int index = path[i];
+      int parent = path[i - 1];
+      Node& node = nodes[index];
+      if (node.weight > 0 || node.children.size() > 1) break;
+
+      if (node.children.empty()) {
+        eraseChild(parent, index);
+        release(index);
+        path.resize(i);
+        continue;
+      }
+
+      int child = node.children[0];
+      nodes[child].label = node.label + nodes[child].label;
+      replaceChild(parent, index, child);
+      release(index);
+      path.resize(i);
+      break;
+    }
+
+    for (auto it = path.rbegin(); it != path.rend(); ++it) refresh(*it);
+    return true;
+  }
+
+  // До limit ключей с данным префиксом, по убыванию веса
+  std::vector<Completion> complete(const std::string& prefix,
+                                   size_t limit) const {
+    std::vector<Completion> completions;
+    if (limit == 0) return completions;
+
+    int node = 0;
+    std::string text;
+    size_t pos = 0;
+    while (pos < prefix.size()) {
+      int child = findChild(node, prefix[pos]);
+      if (child < 0) return completions;
+
+      const std::string& label = nodes[child].label;
+      size_t common = commonLength(prefix, pos, label);
+      if (common < label.size() && pos + common < prefix.size()) {
+        return completions;
+      }
+      text += label;
+      pos += label.size();
+      node = child;
+    }
+
+    std::priority_queue<Candidate, std::vector<Candidate>, WorseCandidate>
+        queue;
+    queue.push({nodes[node].bestWeight, node, false, text});
+    while (!queue.empty() && completions.size() < limit) {
+      Candidate candidate = queue.top();
+      queue.pop();
+
+      if (candidate.complete) {
+        completions.emplace_back(candidate.text, candidate.weight);
+        continue;
+      }
+
+      const Node& current = nodes[candidate.node];
+      if (current.weight > 0) {
+        queue.push({current.weight, candidate.node, true, candidate.text});
+      }
+      for (int child : current.children) {
+        queue.push({nodes[child].bestWeight, child, false,
+                    candidate.text + nodes[child].label});
+      }
+    }
+    return completions;
+  }
+
+  size_t size() const { return keyCount; }
+
+  // Оценка занимаемой памяти в байтах (строки до 15 символов хранятся
+  // внутри std::string и отдельно не считаются)
+  size_t memoryUsage() const {
+    size_t bytes = sizeof(*this) + nodes.capacity() * sizeof(Node) +
+                   freeNodes.capacity() * sizeof(int);
+    for (const Node& node : nodes) {
+      if (node.label.capacity() > 15) bytes += node.label.capacity() + 1;
+      bytes += node.children.capacity() * sizeof(int);
+    }
+    return bytes;
+  }
+};
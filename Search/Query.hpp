@@ -0,0 +1,219 @@
+#pragma once
+#include <cctype>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Язык запросов к каталогу:
+//   author:"J. R. R. Tolkien" genre:fantasy available:true title~ring
+// field:value - точное совпадение поля (без учёта регистра; у title,
+// author и genre - и пробелов с пунктуацией, см. normalizeText),
+// field~value - поле содержит value, слово без поля ищется во всех полях.
+// field<value, field<=value, field>value, field>=value - диапазон (тоже
+// без учёта регистра), только для title, author, genre и isbn.
+// Поля: title, author, genre, isbn, available (true/false).
+enum class QueryField { ANY, TITLE, AUTHOR, GENRE, ISBN, AVAILABLE };
+
+enum class QueryOp {
+  EQUALS,
+  CONTAINS,
+  LESS,
+  LESS_EQUAL,
+  GREATER,
+  GREATER_EQUAL
+};
+
+struct QueryPredicate {
+  QueryField field;
+  QueryOp op;
+  std::string value;
+
+  QueryPredicate(QueryField field, QueryOp op, const std::string& value)
+      : field(field), op(op), value(value) {}
+
+  bool availableValue() const { return value == "true" || value == "yes"; }
+
+  bool isRange() const {
+    return op != QueryOp::EQUALS && op != QueryOp::CONTAINS;
+  }
+
+  // Проходит ли диапазон поле, которое сравнилось с value как cmp
+  // (<0, 0, >0)
+  bool acceptsOrder(int cmp) const {
+    switch (op) {
+      case QueryOp::LESS:
+        return cmp < 0;
+      case QueryOp::LESS_EQUAL:
+        return cmp <= 0;
+      case QueryOp::GREATER:
+        return cmp > 0;
+      case QueryOp::GREATER_EQUAL:
+        return cmp >= 0;
+      default:
+        return cmp == 0;
+    }
+  }
+
+  std::string describe() const {
+    static const char* names[] = {"any", "title", "author",
+                                  "genre", "isbn", "available"};
+    static const char* ops[] = {":", "~", "<", "<=", ">", ">="};
+    return std::string(names[static_cast<int>(field)]) +
+           ops[static_cast<int>(op)] + "\"" + value + "\"";
+  }
+};
+
+struct ParsedQuery {
+  std::vector<QueryPredicate> predicates;
+  // Пусто, если запрос разобран
+  std::string error;
+
+  bool ok() const { return error.empty(); }
+};
+
+inline bool parseQueryField(const std::string& name, QueryField& field) {
+  static const std::pair<const char*, QueryField> fields[] = {
+      {"title", QueryField::TITLE},   {"author", QueryField::AUTHOR},
+      {"genre", QueryField::GENRE},   {"isbn", QueryField::ISBN},
+      {"available", QueryField::AVAILABLE}};
+  for (const auto& [fieldName, value] : fields) {
+    if (name == fieldName) {
+      field = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Оператор после имени поля на позиции i; i сдвигается за него
+inline bool parseQueryOp(const std::string& text, size_t& i, QueryOp& op) {
+  if (i >= text.size()) return false;
+  bool orEqual = i + 1 < text.size() && text[i + 1] == '=';
+  switch (text[i]) {
+    case ':':
+      op = QueryOp::EQUALS;
+      break;
+    case '~':
+      op = QueryOp::CONTAINS;
+      break;
+    case '<':
+      op = orEqual ? QueryOp::LESS_EQUAL : QueryOp::LESS;
+      break;
+    case '>':
+      op = orEqual ? QueryOp::GREATER_EQUAL : QueryOp::GREATER;
+      break;
+    default:
+      return false;
+  }
+  i += op == QueryOp::LESS_EQUAL || op == QueryOp::GREATER_EQUAL ? 2 : 1;
+  return true;
+}
+
+inline char lowerQueryChar(char c) {
+  return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+inline ParsedQuery parseQuery(const std::string& text) {
+  ParsedQuery query;
+  size_t i = 0;
+
+  // Слово или строка в кавычках, начиная с позиции i
+  auto readValue = [&](std::string& value) {
+    value.clear();
+    if (i < text.size() && text[i] == '"') {
+      size_t close = text.find('"', i + 1);
+      if (close == std::string::npos) return false;
+      value = text.substr(i + 1, close - i - 1);
+      i = close + 1;
+      return true;
+    }
+    while (i < text.size() &&
+           !std::isspace(static_cast<unsigned char>(text[i]))) {
+      value += text[i++];
+    }
+    return true;
+  };
+
+  while (i < text.size()) {
+    if (std::isspace(static_cast<unsigned char>(text[i]))) {
+      ++i;
+      continue;
+    }
+
+    size_t start = i;
+    std::string name;
+    while (i < text.size() &&
+           std::isalpha(static_cast<unsigned char>(text[i]))) {
+      name += lowerQueryChar(text[i++]);
+    }
+
+    QueryField field = QueryField::ANY;
+    QueryOp op = QueryOp::CONTAINS;
+    if (name.empty() || !parseQueryOp(text, i, op)) {
+      op = QueryOp::CONTAINS;
+      i = start;
+    } else if (!parseQueryField(name, field)) {
+      // < и > - операторы только после известного поля: a<b остаётся
+      // словом для поиска во всех полях
+      if (op == QueryOp::EQUALS || op == QueryOp::CONTAINS) {
+        query.error = "unknown field '" + name + "'";
+        return query;
+      }
+      op = QueryOp::CONTAINS;
+      i = start;
+    }
+
+    std::string value;
+    if (!readValue(value)) {
+      query.error = "unterminated quote at position " + std::to_string(i);
+      return query;
+    }
+    if (value.empty()) {
+      query.error = "empty value at position " + std::to_string(start);
+      return query;
+    }
+
+    if (field == QueryField::AVAILABLE) {
+      if (op != QueryOp::EQUALS && op != QueryOp::CONTAINS) {
+        query.error = "available does not support ranges";
+        return query;
+      }
+      for (char& c : value) c = lowerQueryChar(c);
+      if (value != "true" && value != "false" && value != "yes" &&
+          value != "no") {
+        query.error = "available expects true or false";
+        return query;
+      }
+      op = QueryOp::EQUALS;
+    }
+    query.predicates.push_back(QueryPredicate(field, op, value));
+  }
+
+  if (query.predicates.empty()) query.error = "empty query";
+  return query;
+}
+
+// Шаг выбранного плана: как вычисляется предикат и сколько строк ожидается
+struct QueryPlanStep {
+  std::string access;
+  std::string predicate;
+  double estimatedRows;
+
+  QueryPlanStep(const std::string& access, const std::string& predicate,
+                double estimatedRows)
+      : access(access), predicate(predicate), estimatedRows(estimatedRows) {}
+};
+
+inline std::string explainPlan(const std::vector<QueryPlanStep>& steps,
+                               size_t rows) {
+  std::string plan;
+  for (size_t i = 0; i < steps.size(); ++i) {
+    plan += std::to_string(i + 1) + ". " + steps[i].access;
+    if (!steps[i].predicate.empty()) plan += " " + steps[i].predicate;
+    long long rowsEstimate =
+        static_cast<long long>(steps[i].estimatedRows + 0.5);
+    plan += " (est. rows " + std::to_string(rowsEstimate) + ")\n";
+  }
+  plan += "=> " + std::to_string(rows) + " rows\n";
+  return plan;
+}
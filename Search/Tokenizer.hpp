@@ -0,0 +1,32 @@
+#pragma once
+#include <cctype>
+#include <string>
+#include <vector>
+
+// Слова текста в нижнем регистре; разделитель - всё, кроме букв и цифр.
+// Байты UTF-8 старше 0x7F считаются частью слова.
+inline std::vector<std::string> tokenizeWords(const std::string& text) {
+  std::vector<std::string> tokens;
+  std::string current;
+  for (char c : text) {
+    unsigned char u = static_cast<unsigned char>(c);
+    if (std::isalnum(u) || u >= 0x80) {
+      current += static_cast<char>(std::tolower(u));
+    } else if (!current.empty()) {
+      tokens.push_back(current);
+      current.clear();
+    }
+  }
+  if (!current.empty()) tokens.push_back(current);
+  return tokens;
+}
+
+// Слова через один пробел: "  The  Lord-of " -> "the lord of"
+inline std::string normalizeText(const std::string& text) {
+  std::string result;
+  for (const std::string& token : tokenizeWords(text)) {
+    if (!result.empty()) result += ' ';
+    result += token;
+  }
+  return result;
+}
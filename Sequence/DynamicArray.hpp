@@ -1,7 +1,9 @@
 #pragma once
+#include <atomic>
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include "../Diagnostics/MemoryAccounting.hpp"
 
 
 template <typename T>
@@ -10,6 +12,11 @@ private:
     T* data;
     int size;
     int capacity;
+    // Подсистема, за которую считается память (см. MemoryAccounting.hpp)
+    MemoryTag tag;
+    // Сколько владельцев делят массив (ArraySequence, срезы, куски
+    // RopeSequence); последний удаляет его в Release
+    std::atomic<int> refs;
 
     int _getCapacity(int val) {
         if (val == 0) return 0;
@@ -27,24 +34,42 @@ private:
     }
 
 public:
-    DynamicArray(): data(nullptr), size(0), capacity(0) {}
+    DynamicArray(): data(nullptr), size(0), capacity(0), tag(MemoryAccounting::currentTag()), refs(1) {}
 
-    DynamicArray(int initialCapacity) : size(initialCapacity), capacity(_getCapacity(initialCapacity)) {
-        data = new T[capacity];
+    DynamicArray(int initialCapacity) : size(initialCapacity), capacity(_getCapacity(initialCapacity)), tag(MemoryAccounting::currentTag()), refs(1) {
+        data = newTaggedArray<T>(tag, capacity);
     }
 
-    DynamicArray(const T* items, int count) : size(count), capacity(_getCapacity(count)) {
-        data = new T[capacity];
+    DynamicArray(const T* items, int count) : size(count), capacity(_getCapacity(count)), tag(MemoryAccounting::currentTag()), refs(1) {
+        data = newTaggedArray<T>(tag, capacity);
         std::copy(items, items + count, data);
     }
 
-    DynamicArray(const DynamicArray& other) : size(other.size), capacity(other.capacity) {
-        data = new T[capacity];
+    DynamicArray(const DynamicArray& other) : size(other.size), capacity(other.capacity), tag(MemoryAccounting::currentTag()), refs(1) {
+        data = newTaggedArray<T>(tag, capacity);
         std::copy(other.data, other.data + size, data);
     }
 
     ~DynamicArray() {
-        delete[] data;
+        deleteTaggedArray(tag, data, capacity);
+    }
+
+    // Ещё один владелец. Счётчик уменьшается с release, а проверяется с
+    // acquire: запись в массив, который отпустили в другом потоке,
+    // начинается после того, как там его дочитали.
+    void Retain() {
+        refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    // true - менять на месте нельзя, сначала копия
+    bool IsShared() const {
+        return refs.load(std::memory_order_acquire) != 1;
     }
 
     T& operator[](int index) {
@@ -61,6 +86,11 @@ public:
         return capacity;
     }
 
+    // Элементы подряд, для алгоритмов над всем массивом
+    T* GetData() const {
+        return data;
+    }
+
     void Resize(int newSize) {
         int newCapacity = _getCapacity(newSize);
         if (capacity == newCapacity) { 
@@ -68,9 +98,9 @@ public:
             return;
         }
 
-        T* newData = new T[newCapacity];
+        T* newData = newTaggedArray<T>(tag, newCapacity);
         std::copy(data, data + std::min(size, newSize), newData);
-        delete[] data;
+        deleteTaggedArray(tag, data, capacity);
         data = newData;
         capacity = newCapacity;
         size = newSize;
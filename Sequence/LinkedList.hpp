@@ -2,6 +2,8 @@
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include "../Diagnostics/MemoryAccounting.hpp"
+#include "Sort.hpp"
 
 
 template <typename T>
@@ -18,6 +20,18 @@ private:
     Node* head;
     Node* tail;
     int size;
+    // Подсистема, за которую считается память (см. MemoryAccounting.hpp)
+    MemoryTag tag;
+
+    Node* _createNode(const T& value) {
+        MemoryAccounting::allocated(tag, sizeof(Node));
+        return new Node(value);
+    }
+
+    void _destroyNode(Node* node) {
+        MemoryAccounting::freed(tag, sizeof(Node));
+        delete node;
+    }
 
     void _checkException(int index) const {
         if (index >= size) {
@@ -25,14 +39,36 @@ private:
         }
     }
 
+    // Отрезать от node первые count узлов; возвращает остаток
+    static Node* _cut(Node* node, int count) {
+        for (int i = 1; node != nullptr && i < count; ++i) {
+            node = node->next;
+        }
+        if (node == nullptr) return nullptr;
+
+        Node* rest = node->next;
+        node->next = nullptr;
+        return rest;
+    }
+
+    // После перестановки по next восстановить prev и tail
+    void _relink() {
+        Node* previous = nullptr;
+        for (Node* current = head; current != nullptr; current = current->next) {
+            current->prev = previous;
+            previous = current;
+        }
+        tail = previous;
+    }
+
 public:
-    LinkedList(): head(nullptr), tail(nullptr), size(0) {}
-    LinkedList(const T* items, int count) : head(nullptr), tail(nullptr), size(0) {
+    LinkedList(): head(nullptr), tail(nullptr), size(0), tag(MemoryAccounting::currentTag()) {}
+    LinkedList(const T* items, int count) : head(nullptr), tail(nullptr), size(0), tag(MemoryAccounting::currentTag()) {
         for (int i = 0; i < count; ++i) {
             Append(items[i]);
         }
     }
-    LinkedList(const LinkedList<T>& other) : head(nullptr), tail(nullptr), size(0) {
+    LinkedList(const LinkedList<T>& other) : head(nullptr), tail(nullptr), size(0), tag(MemoryAccounting::currentTag()) {
         for (Node* current = other.head; current != nullptr; current = current->next) {
             Append(current->data);
         }
@@ -46,7 +82,7 @@ public:
         while (head != nullptr) {
             Node* temp = head;
             head = head->next;
-            delete temp;
+            _destroyNode(temp);
         }
 
         tail = nullptr;
@@ -58,7 +94,7 @@ public:
     }
 
     void Append(const T& value) {
-        Node* newNode = new Node(value);
+        Node* newNode = _createNode(value);
         if (tail == nullptr) {
             head = tail = newNode;
         } else {
@@ -70,7 +106,7 @@ public:
     }
 
     void Prepend(const T& value) {
-        Node* newNode = new Node(value);
+        Node* newNode = _createNode(value);
         if (head == nullptr) {
             head = tail = newNode;
         } else {
@@ -90,6 +126,18 @@ public:
         return current->data;
     }
 
+    // count элементов с позиции start подряд в out, за один проход
+    void CopyTo(T* out, int start, int count) const {
+        Node* current = head;
+        for (int i = 0; i < start; ++i) {
+            current = current->next;
+        }
+        for (int i = 0; i < count; ++i) {
+            out[i] = current->data;
+            current = current->next;
+        }
+    }
+
     T& GetFirst() const {
         if (size == 0)
             throw std::out_of_range("List is empty");
@@ -109,7 +157,7 @@ public:
         } else if (index == size) {
             Append(item);
         } else {
-            Node* newNode = new Node(item);
+            Node* newNode = _createNode(item);
             Node* current = head;
             for (int i = 0; i < index; ++i) {
                 current = current->next;
@@ -122,6 +170,92 @@ public:
         }
     }
 
+    // Устойчивая сортировка слиянием снизу вверх: узлы только
+    // перецепляются, данные не копируются и память не выделяется
+    template <typename Compare>
+    void Sort(Compare less) {
+        for (int width = 1; width < size; width *= 2) {
+            Node* rest = head;
+            Node* sortedTail = nullptr;
+            while (rest != nullptr) {
+                Node* left = rest;
+                Node* right = _cut(left, width);
+                rest = _cut(right, width);
+
+                Node* merged = nullptr;
+                Node** link = &merged;
+                Node* last = nullptr;
+                while (left != nullptr && right != nullptr) {
+                    Node*& smaller = less(right->data, left->data) ? right : left;
+                    *link = last = smaller;
+                    link = &smaller->next;
+                    smaller = smaller->next;
+                }
+                *link = left != nullptr ? left : right;
+                if (last == nullptr) {
+                    last = merged;
+                }
+                while (last->next != nullptr) {
+                    last = last->next;
+                }
+
+                if (sortedTail == nullptr) {
+                    head = merged;
+                } else {
+                    sortedTail->next = merged;
+                }
+                sortedTail = last;
+            }
+        }
+        _relink();
+    }
+
+    // Устойчивая поразрядная сортировка по целому ключу (LSD): за проход
+    // узлы перецепляются в 256 корзин по байту ключа
+    template <typename KeyOf>
+    void RadixSort(KeyOf key) {
+        using Key = SortKey<T, KeyOf>;
+        const int passes = sizeof(Key);
+        int counts[sizeof(Key)][256] = {};
+        for (Node* current = head; current != nullptr; current = current->next) {
+            auto bits = RadixBits(key(current->data));
+            for (int pass = 0; pass < passes; ++pass) {
+                ++counts[pass][(bits >> (8 * pass)) & 0xFF];
+            }
+        }
+
+        for (int pass = 0; pass < passes && size > 1; ++pass) {
+            if (counts[pass][(RadixBits(key(head->data)) >> (8 * pass)) & 0xFF] == size) {
+                continue;
+            }
+
+            Node* heads[256] = {};
+            Node* tails[256] = {};
+            for (Node* current = head; current != nullptr; current = current->next) {
+                int digit = (RadixBits(key(current->data)) >> (8 * pass)) & 0xFF;
+                if (tails[digit] == nullptr) {
+                    heads[digit] = current;
+                } else {
+                    tails[digit]->next = current;
+                }
+                tails[digit] = current;
+            }
+
+            Node* last = nullptr;
+            for (int digit = 0; digit < 256; ++digit) {
+                if (heads[digit] == nullptr) continue;
+                if (last == nullptr) {
+                    head = heads[digit];
+                } else {
+                    last->next = heads[digit];
+                }
+                last = tails[digit];
+            }
+            last->next = nullptr;
+        }
+        _relink();
+    }
+
     LinkedList<T>* Concat(const LinkedList<T>* list) {
         LinkedList<T>* result = new LinkedList<T>(*this);
 
@@ -0,0 +1,385 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Sequence.hpp"
+
+
+// Как последовательность будут читать: подсказка ядру (madvise), сколько
+// страниц файла подкачивать вперёд
+enum class MappedAccess { NORMAL, SEQUENTIAL, RANDOM };
+
+// Заголовок файла MappedArraySequence. Занимает первую страницу, элементы
+// идут сразу за ней.
+struct MappedHeader {
+    char magic[8];
+    uint32_t itemSize;
+    uint32_t reserved;
+    uint64_t length;
+    uint64_t capacity;
+};
+
+const char kMappedMagic[8] = {'S', 'E', 'Q', 'M', 'A', 'P', '0', '1'};
+const size_t kMappedHeaderSize = 4096;
+// Меньше стольких байт файл не растёт
+const size_t kMappedMinGrowth = 1 << 20;
+
+// Последовательность в файле, отображённом в память (POSIX mmap): файл -
+// заголовок и массив элементов как есть, так что открыть существующий
+// файл - проверить заголовок и отобразить, без чтения данных. Элементы
+// подкачиваются ядром по мере обращения и могут не помещаться в память.
+// Append пишет прямо в отображение; когда место кончается, файл
+// удлиняется вдвое и отображение расширяется (mremap), так что ссылки на
+// элементы после роста недействительны. Длина хранится в заголовке и
+// обновляется после записи элемента. Flush сбрасывает изменения на диск,
+// деструктор обрезает файл по длине.
+// Изменения идут на месте, как у MutableArraySequence; GetSubsequence и
+// CreateEmptySequence возвращают обычные последовательности в памяти.
+// Отображённые страницы - это файл, а не куча, и в MemoryAccounting не
+// считаются.
+template <typename T>
+class MappedArraySequence : public Sequence<T> {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "MappedArraySequence stores items as raw bytes");
+    static_assert(alignof(T) <= kMappedHeaderSize, "item alignment exceeds the header page");
+
+private:
+    std::string path;
+    int fd;
+    // Отображение всего файла: заголовок и capacity элементов
+    char* base;
+    size_t mappedSize;
+    MappedAccess access;
+
+    [[noreturn]] void _fail(const char* what) const {
+        throw std::runtime_error(path + ": " + what + ": " + std::strerror(errno));
+    }
+
+    MappedHeader* _header() const {
+        return reinterpret_cast<MappedHeader*>(base);
+    }
+
+    T* _items() const {
+        return reinterpret_cast<T*>(base + kMappedHeaderSize);
+    }
+
+    static size_t _fileSize(uint64_t capacity) {
+        return kMappedHeaderSize + capacity * sizeof(T);
+    }
+
+    void _map(size_t size) {
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            _fail("mmap");
+        }
+        base = static_cast<char*>(address);
+        mappedSize = size;
+    }
+
+    // Отображает открытый файл: пустой размечается заново, у
+    // существующего проверяется заголовок
+    void _attach() {
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            _fail("fstat");
+        }
+
+        if (info.st_size == 0) {
+            if (ftruncate(fd, static_cast<off_t>(kMappedHeaderSize)) != 0) {
+                _fail("ftruncate");
+            }
+            _map(kMappedHeaderSize);
+            std::memcpy(_header()->magic, kMappedMagic, sizeof(kMappedMagic));
+            _header()->itemSize = sizeof(T);
+            return;
+        }
+
+        MappedHeader header;
+        bool valid = static_cast<size_t>(info.st_size) >= kMappedHeaderSize &&
+                     pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+                     std::memcmp(header.magic, kMappedMagic, sizeof(kMappedMagic)) == 0 &&
+                     header.itemSize == sizeof(T) &&
+                     header.length <= header.capacity && header.capacity <= INT_MAX &&
+                     static_cast<uint64_t>(info.st_size) >= _fileSize(header.capacity);
+        if (!valid) {
+            throw std::runtime_error(path + ": not a MappedArraySequence file of this item type");
+        }
+        _map(_fileSize(header.capacity));
+    }
+
+    void _checkException(int index) const {
+        if (index < 0 || index >= GetLength()) {
+            throw std::out_of_range("MappedArraySequence index out of range");
+        }
+    }
+
+    // madvise на страницы, покрывающие элементы [start, start + count)
+    void _advise(int start, int count, int advice) const {
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t from = kMappedHeaderSize + static_cast<size_t>(start) * sizeof(T);
+        size_t to = from + static_cast<size_t>(count) * sizeof(T);
+        from -= from % page;
+        madvise(base + from, to - from, advice);
+    }
+
+    void _setLength(int length) {
+        _header()->length = static_cast<uint64_t>(length);
+    }
+
+    // Удлиняет файл не меньше чем до capacity элементов: вдвое, но хотя
+    // бы на kMappedMinGrowth байт
+    void _grow(int capacity) {
+        uint64_t current = _header()->capacity;
+        if (static_cast<uint64_t>(capacity) <= current) {
+            return;
+        }
+
+        uint64_t step = std::max<uint64_t>(current, kMappedMinGrowth / sizeof(T) + 1);
+        uint64_t target = std::min<uint64_t>(std::max<uint64_t>(capacity, current + step), INT_MAX);
+        size_t size = _fileSize(target);
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            _fail("ftruncate");
+        }
+
+#ifdef MREMAP_MAYMOVE
+        void* address = mremap(base, mappedSize, size, MREMAP_MAYMOVE);
+        if (address == MAP_FAILED) {
+            _fail("mremap");
+        }
+        base = static_cast<char*>(address);
+        mappedSize = size;
+#else
+        munmap(base, mappedSize);
+        _map(size);
+#endif
+        _header()->capacity = target;
+        Advise(access);
+    }
+
+    // Освобождает место под count элементов с позиции index
+    void _open(int index, int count) {
+        int length = GetLength();
+        if (count > INT_MAX - length) {
+            throw std::length_error("MappedArraySequence is too long");
+        }
+        _grow(length + count);
+        std::memmove(_items() + index + count, _items() + index, (length - index) * sizeof(T));
+    }
+
+    virtual Sequence<T>* AppendInternal(const T& item) override {
+        // item может лежать в самом отображении, а рост его переносит
+        T copy = item;
+        int length = GetLength();
+        _open(length, 1);
+        _items()[length] = copy;
+        _setLength(length + 1);
+        return this;
+    }
+
+    virtual Sequence<T>* PrependInternal(const T& item) override {
+        return InsertAtInternal(item, 0);
+    }
+
+    virtual Sequence<T>* InsertAtInternal(const T& item, int index) override {
+        T copy = item;
+        int length = GetLength();
+        _open(index, 1);
+        _items()[index] = copy;
+        _setLength(length + 1);
+        return this;
+    }
+
+    virtual Sequence<T>* ConcatInternal(const Sequence<T>* other) override {
+        TRACE_SCOPE("MappedArraySequence::Concat");
+        int length = GetLength();
+        int count = other->GetLength();
+        _open(length, count);
+        other->CopyTo(_items() + length, 0, count);
+        _setLength(length + count);
+        return this;
+    }
+
+public:
+    // Открывает файл path или создаёт пустой. Существующий файл
+    // проверяется по заголовку (метка, размер элемента, длина файла);
+    // truncate - начать заново, отбросив содержимое
+    explicit MappedArraySequence(const std::string& path, bool truncate = false)
+        : path(path), fd(-1), base(nullptr), mappedSize(0), access(MappedAccess::NORMAL) {
+        fd = open(path.c_str(), O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+        if (fd < 0) {
+            _fail("open");
+        }
+        try {
+            _attach();
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+    }
+
+    MappedArraySequence(const MappedArraySequence<T>&) = delete;
+    MappedArraySequence<T>& operator=(const MappedArraySequence<T>&) = delete;
+
+    ~MappedArraySequence() override {
+        uint64_t length = _header()->length;
+        _header()->capacity = length;
+        munmap(base, mappedSize);
+        // Запас в конце не нужен: при следующем росте файл удлинится
+        // снова. Если обрезать не удалось, файл просто длиннее заголовка.
+        int trimmed = ftruncate(fd, static_cast<off_t>(_fileSize(length)));
+        (void)trimmed;
+        close(fd);
+    }
+
+    virtual Sequence<T>* CreateEmptySequence() const override {
+        return new MutableArraySequence<T>();
+    }
+
+    virtual int GetLength() const override {
+        return static_cast<int>(_header()->length);
+    }
+
+    int GetCapacity() const {
+        return static_cast<int>(_header()->capacity);
+    }
+
+    const std::string& GetPath() const {
+        return path;
+    }
+
+    // Место под capacity элементов заранее, чтобы Append не удлинял файл
+    void Reserve(int capacity) {
+        _grow(capacity);
+    }
+
+    // Новые элементы - нулевые байты (дыра в файле)
+    void Resize(int newSize) {
+        if (newSize < 0) {
+            throw std::out_of_range("MappedArraySequence size must be non-negative");
+        }
+        int length = GetLength();
+        if (newSize > length) {
+            _grow(newSize);
+        } else {
+            std::memset(static_cast<void*>(_items() + newSize), 0, (length - newSize) * sizeof(T));
+        }
+        _setLength(newSize);
+    }
+
+    // Подсказка, как будут читать: SEQUENTIAL - большое чтение вперёд и
+    // быстрый уход прочитанных страниц, RANDOM - без чтения вперёд.
+    // Сохраняется и применяется снова после роста файла.
+    void Advise(MappedAccess pattern) {
+        access = pattern;
+        int advice = pattern == MappedAccess::SEQUENTIAL ? MADV_SEQUENTIAL
+                     : pattern == MappedAccess::RANDOM   ? MADV_RANDOM
+                                                         : MADV_NORMAL;
+        madvise(base, mappedSize, advice);
+    }
+
+    MappedAccess GetAccess() const {
+        return access;
+    }
+
+    // Начать подкачку count элементов с позиции start, не дожидаясь её
+    void Prefetch(int start, int count) const {
+        if (start < 0 || count <= 0 || start > GetLength() - count) {
+            throw std::out_of_range("MappedArraySequence prefetch out of range");
+        }
+        _advise(start, count, MADV_WILLNEED);
+    }
+
+    // Сбросить изменённые страницы и заголовок на диск; async - не ждать
+    void Flush(bool async = false) {
+        if (msync(base, mappedSize, async ? MS_ASYNC : MS_SYNC) != 0) {
+            _fail("msync");
+        }
+    }
+
+    const T& GetFirst() const override {
+        if (GetLength() == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get first element");
+        }
+        return _items()[0];
+    }
+
+    const T& GetLast() const override {
+        if (GetLength() == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get last element");
+        }
+        return _items()[GetLength() - 1];
+    }
+
+    const T& Get(int index) const override {
+        _checkException(index);
+        return _items()[index];
+    }
+
+    T& GetFirst() override {
+        if (GetLength() == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get first element");
+        }
+        return _items()[0];
+    }
+
+    T& GetLast() override {
+        if (GetLength() == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get last element");
+        }
+        return _items()[GetLength() - 1];
+    }
+
+    T& Get(int index) override {
+        _checkException(index);
+        return _items()[index];
+    }
+
+    T& operator[] (int index) override {
+        return Get(index);
+    }
+
+    virtual Sequence<T>* Append(const T& item) override {
+        return AppendInternal(item);
+    }
+
+    virtual Sequence<T>* Prepend(const T& item) override {
+        return PrependInternal(item);
+    }
+
+    virtual Sequence<T>* InsertAt(const T& item, int index) override {
+        _checkException(index);
+        return InsertAtInternal(item, index);
+    }
+
+    virtual Sequence<T>* Concat(const Sequence<T>* other) override {
+        return ConcatInternal(other);
+    }
+
+    // Копия отрезка в памяти
+    Sequence<T>* GetSubsequence(int startIndex, int endIndex) const override {
+        if (std::min(startIndex, endIndex) < 0 || std::max(startIndex, endIndex) >= GetLength()) {
+            throw std::out_of_range("MappedArraySequence index out of range");
+        }
+
+        MutableArraySequence<T>* ret = new MutableArraySequence<T>(std::abs(endIndex - startIndex) + 1);
+        if (startIndex <= endIndex) {
+            std::copy(_items() + startIndex, _items() + endIndex + 1, &ret->Get(0));
+        } else {
+            std::reverse_copy(_items() + endIndex, _items() + startIndex + 1, &ret->Get(0));
+        }
+        return ret;
+    }
+
+    void CopyTo(T* out, int start, int count) const override {
+        std::copy(_items() + start, _items() + start + count, out);
+    }
+};
@@ -1,9 +1,14 @@
 #pragma once
 #include <stdexcept>
+#include <atomic>
+#include <cstdlib>
 #include <memory>
 #include <functional>
+#include <vector>
 #include "DynamicArray.hpp"
 #include "LinkedList.hpp"
+#include "Sort.hpp"
+#include "../Diagnostics/Tracing.hpp"
 
 
 template <typename T>
@@ -36,6 +41,15 @@ public:
 
     virtual Sequence<T>* GetSubsequence(int startIndex, int endIndex) const = 0;
 
+    // count элементов с позиции start подряд в out. По умолчанию через
+    // Get; последовательности, у которых Get не O(1), переопределяют,
+    // чтобы Concat и копирование шли за один проход
+    virtual void CopyTo(T* out, int start, int count) const {
+        for (int i = 0; i < count; ++i) {
+            out[i] = this->Get(start + i);
+        }
+    }
+
     Sequence<T>* Map(std::function<T(T)> mapper) const {
         Sequence<T>* result = this->CreateEmptySequence();
         for (int i = 0; i < this->GetLength(); ++i) {
@@ -104,20 +118,36 @@ public:
 
 template <typename T> class MutableArraySequence;
 template <typename T> class ImmutableArraySequence;
+template <typename T> class ArraySlice;
+template <typename T> class RopeSequence;
 
 template <typename T>
 class ArraySequence : public Sequence<T> {
 private:
+    // Буфер может быть общим со срезами (ArraySlice) и кусками
+    // RopeSequence; перед записью общий буфер копируется (_own)
     DynamicArray<T>* data;
 
+    template <typename U> friend class ArraySlice;
+    template <typename U> friend class RopeSequence;
+
+    DynamicArray<T>* _own() {
+        if (data->IsShared()) {
+            DynamicArray<T>* copy = new DynamicArray<T>(*data);
+            data->Release();
+            data = copy;
+        }
+        return data;
+    }
+
     virtual Sequence<T>* AppendInternal(const T& item) override {
-        this->data->Resize(data->GetSize() + 1);
+        this->_own()->Resize(data->GetSize() + 1);
         this->data->Set(item, this->data->GetSize() - 1);
         return this;
     }
 
     virtual Sequence<T>* PrependInternal(const T& item) override {
-        this->data->Resize(data->GetSize() + 1);
+        this->_own()->Resize(data->GetSize() + 1);
 
         for (int i = this->data->GetSize() - 1; i > 0; --i) {
             this->data->Set(this->data->Get(i - 1), i);
@@ -128,7 +158,7 @@ private:
     }
 
     virtual Sequence<T>* InsertAtInternal(const T& item, int index) override {
-        this->data->Resize(data->GetSize() + 1);
+        this->_own()->Resize(data->GetSize() + 1);
         if (index == 0)
             return AppendInternal(item);
 
@@ -141,9 +171,11 @@ private:
     }
 
     virtual Sequence<T>* ConcatInternal(const Sequence<T>* other) override {
-        for (int i = 0; i < other->GetLength(); ++i) {
-            this->Append(other->Get(i));
-        }
+        TRACE_SCOPE("ArraySequence::Concat");
+        int length = this->GetLength();
+        int count = other->GetLength();
+        this->_own()->Resize(length + count);
+        other->CopyTo(this->data->GetData() + length, 0, count);
         return this;
     }
 
@@ -166,7 +198,9 @@ public:
     ArraySequence(const ArraySequence<T>& other) : data(new DynamicArray<T>(*other.data)) {}
 
     ~ArraySequence() override {
-        delete data;
+        if (data != nullptr) {
+            data->Release();
+        }
     }
 
     virtual int GetLength() const override {
@@ -178,7 +212,7 @@ public:
     }
 
     void Resize(int newSize) {
-        this->data->Resize(newSize);
+        this->_own()->Resize(newSize);
     }
 
     const T& GetFirst() const override {
@@ -210,7 +244,7 @@ public:
             throw std::out_of_range("Sequence is empty - cannot get first element");
         }
 
-        return this->data->Get(0);
+        return this->_own()->Get(0);
     }
 
     T& GetLast() override {
@@ -218,7 +252,7 @@ public:
             throw std::out_of_range("Sequence is empty - cannot get last element");
         }
 
-        return data->Get(data->GetSize() - 1);
+        return _own()->Get(data->GetSize() - 1);
     }
 
     T& Get(int index) override {
@@ -226,53 +260,72 @@ public:
             throw std::out_of_range("Sequence index out of range");
         }
 
-        return data->Get(index);
+        return _own()->Get(index);
     }
 
     T& operator[] (int index) override {
         if (index < 0 || index >= data->GetSize()) {
             throw std::out_of_range("Sequence index out of range");
         }
-        return (*data)[index];
+        return (*_own())[index];
     }
 
     ArraySequence<T>& operator=(const ArraySequence<T>& other) {
         if (this!= &other) {
-            delete data;
-            data = new DynamicArray<T>(*other.data);
+            DynamicArray<T>* copy = new DynamicArray<T>(*other.data);
+            if (data != nullptr) {
+                data->Release();
+            }
+            data = copy;
         }
         return *this;
     }
 
     ArraySequence<T>& operator=(ArraySequence<T>&& other) noexcept {
         if (this!= &other) {
-            delete data;
+            if (data != nullptr) {
+                data->Release();
+            }
             data = other.data;
             other.data = nullptr;
         }
         return *this;
     }
 
+    void CopyTo(T* out, int start, int count) const override {
+        std::copy(data->GetData() + start, data->GetData() + start + count, out);
+    }
+
     ArraySequence<T>* GetSubsequence(int startIndex, int endIndex) const override {
         if (std::min(startIndex, endIndex) < 0 || std::max(startIndex, endIndex) >= data->GetSize()) {
             throw std::out_of_range("ArraySequence index out of range");
         }
 
         ArraySequence<T>* ret = this->CreateEmptyArraySequence();
+        ret->Resize(std::abs(endIndex - startIndex) + 1);
 
+        T* items = data->GetData();
         if (startIndex <= endIndex) {
-            for (int i = startIndex; i <= endIndex; ++i) {
-                ret->Append(data->Get(i));
-            }
+            std::copy(items + startIndex, items + endIndex + 1, ret->data->GetData());
         } else {
-            for (int i = startIndex; i >= endIndex; --i) {
-                ret->Append(data->Get(i));
-            }
+            std::reverse_copy(items + endIndex, items + startIndex + 1, ret->data->GetData());
         }
 
         return ret;
     }
 
+    // Срез [startIndex, endIndex] за O(1): общий буфер, без копирования.
+    // Срез видит элементы на момент среза и переживает последовательность:
+    // её запись после среза сначала копирует буфер. Ссылки на элементы,
+    // взятые до среза, пишут в общий буфер.
+    ArraySlice<T>* Slice(int startIndex, int endIndex) const {
+        if (startIndex < 0 || endIndex >= data->GetSize() || startIndex > endIndex) {
+            throw std::out_of_range("ArraySequence slice out of range");
+        }
+
+        return new ArraySlice<T>(data, startIndex, endIndex - startIndex + 1);
+    }
+
     virtual Sequence<T>* Append(const T& item) override {
         return Instance()->AppendInternal(item);
     }
@@ -292,6 +345,34 @@ public:
     virtual Sequence<T>* Concat(const Sequence<T>* other) override {
         return this->Instance()->ConcatInternal(other);
     }
+
+    // Сортировка по less; как Append, меняет саму последовательность, а
+    // неизменяемая возвращает отсортированную копию. С пулом большой
+    // массив сортируется кусками во всех потоках и сливается. По
+    // умолчанию целые и строки сортируются поразрядно.
+    template <typename Compare = std::less<T>>
+    Sequence<T>* Sort(Compare less = Compare(), ThreadPool* pool = nullptr) {
+        ArraySequence<T>* target = static_cast<ArraySequence<T>*>(Instance());
+        SortRange(target->_own()->GetData(), target->GetLength(), less, false, pool);
+        return target;
+    }
+
+    // То же, но равные элементы сохраняют порядок
+    template <typename Compare = std::less<T>>
+    Sequence<T>* StableSort(Compare less = Compare(), ThreadPool* pool = nullptr) {
+        ArraySequence<T>* target = static_cast<ArraySequence<T>*>(Instance());
+        SortRange(target->_own()->GetData(), target->GetLength(), less, true, pool);
+        return target;
+    }
+
+    // Устойчивая поразрядная сортировка по ключу key(item): целому или
+    // std::string
+    template <typename KeyOf>
+    Sequence<T>* SortBy(KeyOf key) {
+        ArraySequence<T>* target = static_cast<ArraySequence<T>*>(Instance());
+        RadixSortRange(target->_own()->GetData(), target->GetLength(), key);
+        return target;
+    }
 };
 
 template <typename T> class MutableListSequence;
@@ -318,9 +399,15 @@ private:
     }
 
     virtual Sequence<T>* ConcatInternal(const Sequence<T>* other) override {
-        for (int i = 0; i < other->GetLength(); ++i) {
-            this->Append(other->Get(i));
+        TRACE_SCOPE("ListSequence::Concat");
+        int count = other->GetLength();
+        MemoryTag tag = MemoryAccounting::currentTag();
+        T* items = newTaggedArray<T>(tag, count);
+        other->CopyTo(items, 0, count);
+        for (int i = 0; i < count; ++i) {
+            this->data->Append(items[i]);
         }
+        deleteTaggedArray(tag, items, count);
         return this;
     }
 
@@ -401,6 +488,10 @@ public:
         return this->data->Get(index);
     }
 
+    void CopyTo(T* out, int start, int count) const override {
+        this->data->CopyTo(out, start, count);
+    }
+
     LinkedList<T>& operator=(const LinkedList<T>& other) {
         if (this!= &other) {
             delete this->data;
@@ -424,6 +515,7 @@ public:
         }
 
         ListSequence<T>* ret = this->CreateEmptyListSequence();
+        delete ret->data;
         ret->data = this->data->GetSubList(startIndex, endIndex);
 
         return ret;
@@ -447,6 +539,42 @@ public:
     virtual Sequence<T>* Concat(const Sequence<T>* other) override {
         return this->Instance()->ConcatInternal(other);
     }
+
+    // Сортировка слиянием перецеплением узлов, без копий и выделений;
+    // она устойчива, так что Sort и StableSort совпадают. По умолчанию
+    // целые сортируются поразрядно.
+    template <typename Compare = std::less<T>>
+    Sequence<T>* Sort(Compare less = Compare()) {
+        ListSequence<T>* target = static_cast<ListSequence<T>*>(this->Instance());
+        if constexpr (std::is_same<Compare, std::less<T>>::value && IsRadixKey<T> &&
+                      !std::is_same<T, std::string>::value) {
+            target->data->RadixSort([](const T& item) -> const T& { return item; });
+        } else {
+            target->data->Sort(less);
+        }
+        return target;
+    }
+
+    template <typename Compare = std::less<T>>
+    Sequence<T>* StableSort(Compare less = Compare()) {
+        return Sort(less);
+    }
+
+    // Устойчивая сортировка по ключу key(item): целый - поразрядно,
+    // строка - слиянием по ключам
+    template <typename KeyOf>
+    Sequence<T>* SortBy(KeyOf key) {
+        using Key = SortKey<T, KeyOf>;
+        static_assert(IsRadixKey<Key>, "SortBy needs an integer or std::string key");
+
+        ListSequence<T>* target = static_cast<ListSequence<T>*>(this->Instance());
+        if constexpr (std::is_same<Key, std::string>::value) {
+            target->data->Sort([&key](const T& a, const T& b) { return key(a) < key(b); });
+        } else {
+            target->data->RadixSort(key);
+        }
+        return target;
+    }
 };
 
 
@@ -556,6 +684,653 @@ public:
 };
 
 
+// Срез ArraySequence (см. ArraySequence::Slice): общий с ней буфер и
+// отрезок в нём. Буфер живёт, пока его держит хоть один владелец, и на
+// месте не меняется: ArraySequence перед записью копирует общий буфер, а
+// запись через срез (неконстантные Get, operator[]) сначала копирует его
+// отрезок. Append и другие изменения, как у неизменяемых
+// последовательностей, возвращают новую MutableArraySequence.
+template <typename T>
+class ArraySlice : public Sequence<T> {
+private:
+    DynamicArray<T>* data;
+    int offset;
+    int length;
+
+    template <typename U> friend class RopeSequence;
+
+    T* _items() const {
+        return data->GetData() + offset;
+    }
+
+    T* _own() {
+        if (data->IsShared()) {
+            DynamicArray<T>* copy = new DynamicArray<T>(_items(), length);
+            data->Release();
+            data = copy;
+            offset = 0;
+        }
+        return _items();
+    }
+
+    void _checkException(int index) const {
+        if (index < 0 || index >= length) {
+            throw std::out_of_range("ArraySlice index out of range");
+        }
+    }
+
+    MutableArraySequence<T>* _copy() const {
+        return new MutableArraySequence<T>(_items(), length);
+    }
+
+    virtual Sequence<T>* AppendInternal(const T& item) override {
+        return _copy()->Append(item);
+    }
+
+    virtual Sequence<T>* PrependInternal(const T& item) override {
+        return _copy()->Prepend(item);
+    }
+
+    virtual Sequence<T>* InsertAtInternal(const T& item, int index) override {
+        return _copy()->InsertAt(item, index);
+    }
+
+    virtual Sequence<T>* ConcatInternal(const Sequence<T>* other) override {
+        return _copy()->Concat(other);
+    }
+
+public:
+    ArraySlice(DynamicArray<T>* data, int offset, int length) : data(data), offset(offset), length(length) {
+        data->Retain();
+    }
+
+    // Срез на всю последовательность
+    explicit ArraySlice(const ArraySequence<T>& array) : ArraySlice(array.data, 0, array.GetLength()) {}
+
+    ArraySlice(const ArraySlice<T>& other) : ArraySlice(other.data, other.offset, other.length) {}
+
+    ArraySlice<T>& operator=(const ArraySlice<T>&) = delete;
+
+    ~ArraySlice() override {
+        data->Release();
+    }
+
+    virtual Sequence<T>* CreateEmptySequence() const override {
+        return new MutableArraySequence<T>();
+    }
+
+    virtual int GetLength() const override {
+        return length;
+    }
+
+    const T& GetFirst() const override {
+        if (length == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get first element");
+        }
+        return _items()[0];
+    }
+
+    const T& GetLast() const override {
+        if (length == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get last element");
+        }
+        return _items()[length - 1];
+    }
+
+    const T& Get(int index) const override {
+        _checkException(index);
+        return _items()[index];
+    }
+
+    T& GetFirst() override {
+        if (length == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get first element");
+        }
+        return _own()[0];
+    }
+
+    T& GetLast() override {
+        if (length == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get last element");
+        }
+        return _own()[length - 1];
+    }
+
+    T& Get(int index) override {
+        _checkException(index);
+        return _own()[index];
+    }
+
+    T& operator[] (int index) override {
+        return Get(index);
+    }
+
+    virtual Sequence<T>* Append(const T& item) override {
+        return AppendInternal(item);
+    }
+
+    virtual Sequence<T>* Prepend(const T& item) override {
+        return PrependInternal(item);
+    }
+
+    virtual Sequence<T>* InsertAt(const T& item, int index) override {
+        _checkException(index);
+        return InsertAtInternal(item, index);
+    }
+
+    virtual Sequence<T>* Concat(const Sequence<T>* other) override {
+        return ConcatInternal(other);
+    }
+
+    // Прямой отрезок - снова срез за O(1), обратный - копия
+    Sequence<T>* GetSubsequence(int startIndex, int endIndex) const override {
+        if (std::min(startIndex, endIndex) < 0 || std::max(startIndex, endIndex) >= length) {
+            throw std::out_of_range("ArraySlice index out of range");
+        }
+
+        if (startIndex <= endIndex) {
+            return new ArraySlice<T>(data, offset + startIndex, endIndex - startIndex + 1);
+        }
+
+        MutableArraySequence<T>* ret = new MutableArraySequence<T>(startIndex - endIndex + 1);
+        std::reverse_copy(_items() + endIndex, _items() + startIndex + 1, &ret->Get(0));
+        return ret;
+    }
+
+    void CopyTo(T* out, int start, int count) const override {
+        std::copy(_items() + start, _items() + start + count, out);
+    }
+};
+
+
+// Длиннее этого куски верёвки при склейке не сливаются
+const int kRopeLeafSize = 64;
+
+// Верёвка: сбалансированное дерево склеек над кусками, каждый кусок -
+// отрезок общего DynamicArray. Concat с верёвкой, срезом или
+// ArraySequence не копирует элементы, а подвешивает их буфер куском;
+// GetSubsequence строит O(log n) новых узлов над теми же кусками, Get -
+// спуск за O(log n). Маленькие куски при склейке сливаются, а слишком
+// глубокое дерево перестраивается. Узлы и куски общие между верёвками и
+// неизменяемы: запись через неконстантный Get сначала копирует общий
+// путь. Изменения идут на месте, как у Mutable-последовательностей.
+template <typename T>
+class RopeSequence : public Sequence<T> {
+private:
+    struct Node {
+        std::atomic<int> refs;
+        int length;
+        int depth;
+        // У склейки - части, у куска - nullptr
+        Node* left;
+        Node* right;
+        // У куска - буфер и начало отрезка в нём
+        DynamicArray<T>* buffer;
+        int offset;
+        MemoryTag tag;
+
+        Node(MemoryTag tag) : refs(1), length(0), depth(0), left(nullptr), right(nullptr), buffer(nullptr), offset(0), tag(tag) {}
+    };
+
+    // nullptr - пустая верёвка
+    Node* root;
+    // Подсистема, за которую считается память (см. MemoryAccounting.hpp)
+    MemoryTag tag;
+
+    explicit RopeSequence(Node* root) : root(root), tag(MemoryAccounting::currentTag()) {}
+
+    static Node* _retain(Node* node) {
+        if (node != nullptr) {
+            node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        return node;
+    }
+
+    static void _release(Node* node) {
+        if (node == nullptr || node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+
+        if (node->buffer != nullptr) {
+            node->buffer->Release();
+        }
+        _release(node->left);
+        _release(node->right);
+        MemoryAccounting::freed(node->tag, sizeof(Node));
+        delete node;
+    }
+
+    static bool _isShared(const Node* node) {
+        return node->refs.load(std::memory_order_acquire) != 1;
+    }
+
+    // Кусок над buffer; buffer получает ещё одного владельца
+    Node* _leaf(DynamicArray<T>* buffer, int offset, int length) const {
+        if (length == 0) {
+            return nullptr;
+        }
+
+        MemoryAccounting::allocated(tag, sizeof(Node));
+        Node* node = new Node(tag);
+        buffer->Retain();
+        node->buffer = buffer;
+        node->offset = offset;
+        node->length = length;
+        return node;
+    }
+
+    // Кусок над новым буфером из count элементов; fill(items) их заполняет
+    template <typename Fill>
+    Node* _freshLeaf(int count, Fill fill) const {
+        if (count == 0) {
+            return nullptr;
+        }
+
+        DynamicArray<T>* buffer = new DynamicArray<T>(count);
+        fill(buffer->GetData());
+        Node* node = _leaf(buffer, 0, count);
+        buffer->Release();
+        return node;
+    }
+
+    // Склейка без слияний и перестройки; забирает ссылки left и right
+    Node* _join(Node* left, Node* right) const {
+        MemoryAccounting::allocated(tag, sizeof(Node));
+        Node* node = new Node(tag);
+        node->left = left;
+        node->right = right;
+        node->length = left->length + right->length;
+        node->depth = std::max(left->depth, right->depth) + 1;
+        return node;
+    }
+
+    static void _copyTo(const Node* node, int start, int count, T* out) {
+        if (count == 0) {
+            return;
+        }
+        if (node->buffer != nullptr) {
+            T* items = node->buffer->GetData() + node->offset + start;
+            std::copy(items, items + count, out);
+            return;
+        }
+
+        int leftLength = node->left->length;
+        if (start < leftLength) {
+            int fromLeft = std::min(count, leftLength - start);
+            _copyTo(node->left, start, fromLeft, out);
+            out += fromLeft;
+            count -= fromLeft;
+            start = 0;
+        } else {
+            start -= leftLength;
+        }
+        _copyTo(node->right, start, count, out);
+    }
+
+    // Один кусок из двух маленьких деревьев
+    Node* _flatten(const Node* left, const Node* right) const {
+        return _freshLeaf(left->length + right->length, [&](T* items) {
+            _copyTo(left, 0, left->length, items);
+            _copyTo(right, 0, right->length, items + left->length);
+        });
+    }
+
+    // Глубже дерево не бывает: F(kRopeMaxDepth + 2) больше любой длины
+    static const int kRopeMaxDepth = 44;
+
+    // Числа Фибоначчи F(i + 2): сбалансированное дерево глубины d
+    // длиннее F(d + 2)
+    static long long _minLength(int depth) {
+        static const std::vector<long long> lengths = []() {
+            std::vector<long long> fib = {1, 2};
+            while (static_cast<int>(fib.size()) <= kRopeMaxDepth + 1) {
+                fib.push_back(fib[fib.size() - 1] + fib[fib.size() - 2]);
+            }
+            return fib;
+        }();
+        return lengths[std::min(depth, kRopeMaxDepth + 1)];
+    }
+
+    static bool _isBalanced(const Node* node) {
+        return node->depth < kRopeMaxDepth && node->length >= _minLength(node->depth);
+    }
+
+    // Перестройка по Боэму: сбалансированные поддеревья берутся целиком и
+    // раскладываются в лес, где forest[i] длиной от F(i + 2) до
+    // F(i + 3); соседние по порядку склеиваются, пока не уложатся в свою
+    // ячейку. Так склейка двух больших верёвок стоит O(log n), а не
+    // обхода всех кусков.
+    void _addToForest(Node* node, Node** forest) const {
+        if (!_isBalanced(node)) {
+            _addToForest(node->left, forest);
+            _addToForest(node->right, forest);
+            return;
+        }
+
+        Node* tooShort = nullptr;
+        int i = 0;
+        for (; node->length >= _minLength(i + 1); ++i) {
+            if (forest[i] != nullptr) {
+                tooShort = tooShort == nullptr ? forest[i] : _join(forest[i], tooShort);
+                forest[i] = nullptr;
+            }
+        }
+
+        Node* piece = tooShort == nullptr ? _retain(node) : _join(tooShort, _retain(node));
+        for (;; ++i) {
+            if (forest[i] != nullptr) {
+                piece = _join(forest[i], piece);
+                forest[i] = nullptr;
+            }
+            if (i == kRopeMaxDepth || piece->length < _minLength(i + 1)) {
+                forest[i] = piece;
+                return;
+            }
+        }
+    }
+
+    Node* _balance(Node* node) const {
+        if (_isBalanced(node)) {
+            return node;
+        }
+
+        Node* forest[kRopeMaxDepth + 1] = {};
+        _addToForest(node, forest);
+        _release(node);
+
+        Node* result = nullptr;
+        for (Node* piece : forest) {
+            if (piece != nullptr) {
+                result = result == nullptr ? piece : _join(piece, result);
+            }
+        }
+        return result;
+    }
+
+    // Склейка со слиянием маленьких кусков; забирает ссылки left и right
+    Node* _concat(Node* left, Node* right) const {
+        if (left == nullptr) {
+            return right;
+        }
+        if (right == nullptr) {
+            return left;
+        }
+
+        if (left->length + right->length <= kRopeLeafSize) {
+            Node* flat = _flatten(left, right);
+            _release(left);
+            _release(right);
+            return flat;
+        }
+        if (left->buffer == nullptr && left->right->length + right->length <= kRopeLeafSize) {
+            Node* joined = _join(_retain(left->left), _flatten(left->right, right));
+            _release(left);
+            _release(right);
+            return _balance(joined);
+        }
+        if (right->buffer == nullptr && left->length + right->left->length <= kRopeLeafSize) {
+            Node* joined = _join(_flatten(left, right->left), _retain(right->right));
+            _release(left);
+            _release(right);
+            return _balance(joined);
+        }
+        return _balance(_join(left, right));
+    }
+
+    // count элементов с позиции start: новые узлы только на границах
+    Node* _sub(Node* node, int start, int count) const {
+        if (count == 0) {
+            return nullptr;
+        }
+        if (start == 0 && count == node->length) {
+            return _retain(node);
+        }
+        if (node->buffer != nullptr) {
+            return _leaf(node->buffer, node->offset + start, count);
+        }
+
+        int leftLength = node->left->length;
+        if (start + count <= leftLength) {
+            return _sub(node->left, start, count);
+        }
+        if (start >= leftLength) {
+            return _sub(node->right, start - leftLength, count);
+        }
+        return _join(_sub(node->left, start, leftLength - start),
+                     _sub(node->right, 0, start + count - leftLength));
+    }
+
+    // Элемент для записи: общие узлы на пути и общий буфер куска
+    // копируются
+    T& _write(Node*& node, int index) {
+        if (_isShared(node)) {
+            Node* copy = node->buffer != nullptr ? _leaf(node->buffer, node->offset, node->length)
+                                                 : _join(_retain(node->left), _retain(node->right));
+            _release(node);
+            node = copy;
+        }
+
+        if (node->buffer == nullptr) {
+            int leftLength = node->left->length;
+            return index < leftLength ? _write(node->left, index) : _write(node->right, index - leftLength);
+        }
+
+        if (node->buffer->IsShared()) {
+            DynamicArray<T>* copy = new DynamicArray<T>(node->buffer->GetData() + node->offset, node->length);
+            node->buffer->Release();
+            node->buffer = copy;
+            node->offset = 0;
+        }
+        return node->buffer->GetData()[node->offset + index];
+    }
+
+    const T& _read(int index) const {
+        const Node* node = root;
+        while (node->buffer == nullptr) {
+            if (index < node->left->length) {
+                node = node->left;
+            } else {
+                index -= node->left->length;
+                node = node->right;
+            }
+        }
+        return node->buffer->GetData()[node->offset + index];
+    }
+
+    // Дерево над элементами other; буферы массивов и срезов - общие
+    Node* _nodeOf(const Sequence<T>* other) const {
+        if (auto* rope = dynamic_cast<const RopeSequence<T>*>(other)) {
+            return _retain(rope->root);
+        }
+        if (auto* array = dynamic_cast<const ArraySequence<T>*>(other)) {
+            return _leaf(array->data, 0, array->GetLength());
+        }
+        if (auto* slice = dynamic_cast<const ArraySlice<T>*>(other)) {
+            return _leaf(slice->data, slice->offset, slice->length);
+        }
+        return _freshLeaf(other->GetLength(), [&](T* items) {
+            other->CopyTo(items, 0, other->GetLength());
+        });
+    }
+
+    void _checkException(int index) const {
+        if (index < 0 || index >= GetLength()) {
+            throw std::out_of_range("RopeSequence index out of range");
+        }
+    }
+
+    // Последний кусок, если его можно дописать на месте: весь путь к нему
+    // и его буфер только наши, а сам он короче kRopeLeafSize
+    Node* _appendableTail() const {
+        Node* node = root;
+        while (node != nullptr && !_isShared(node) && node->buffer == nullptr) {
+            node = node->right;
+        }
+        if (node == nullptr || _isShared(node) || node->buffer->IsShared() ||
+            node->length >= kRopeLeafSize || node->offset + node->length != node->buffer->GetSize()) {
+            return nullptr;
+        }
+        return node;
+    }
+
+    virtual Sequence<T>* AppendInternal(const T& item) override {
+        Node* tail = _appendableTail();
+        if (tail == nullptr) {
+            root = _concat(root, _freshLeaf(1, [&](T* items) { items[0] = item; }));
+            return this;
+        }
+
+        tail->buffer->Resize(tail->buffer->GetSize() + 1);
+        tail->buffer->Set(item, tail->buffer->GetSize() - 1);
+        for (Node* node = root; node != tail; node = node->right) {
+            ++node->length;
+        }
+        ++tail->length;
+        return this;
+    }
+
+    virtual Sequence<T>* PrependInternal(const T& item) override {
+        root = _concat(_freshLeaf(1, [&](T* items) { items[0] = item; }), root);
+        return this;
+    }
+
+    virtual Sequence<T>* InsertAtInternal(const T& item, int index) override {
+        int length = GetLength();
+        Node* left = _sub(root, 0, index);
+        Node* right = _sub(root, index, length - index);
+        Node* middle = _freshLeaf(1, [&](T* items) { items[0] = item; });
+        _release(root);
+        root = _concat(_concat(left, middle), right);
+        return this;
+    }
+
+    virtual Sequence<T>* ConcatInternal(const Sequence<T>* other) override {
+        TRACE_SCOPE("RopeSequence::Concat");
+        root = _concat(root, _nodeOf(other));
+        return this;
+    }
+
+public:
+    RopeSequence() : root(nullptr), tag(MemoryAccounting::currentTag()) {}
+
+    RopeSequence(const T* items, int count) : root(nullptr), tag(MemoryAccounting::currentTag()) {
+        root = _freshLeaf(count, [&](T* out) { std::copy(items, items + count, out); });
+    }
+
+    // Верёвка над элементами other; массив, срез или верёвка не копируются
+    explicit RopeSequence(const Sequence<T>& other) : root(nullptr), tag(MemoryAccounting::currentTag()) {
+        root = _nodeOf(&other);
+    }
+
+    // Копия делит дерево с оригиналом, O(1)
+    RopeSequence(const RopeSequence<T>& other) : root(_retain(other.root)), tag(MemoryAccounting::currentTag()) {}
+
+    RopeSequence<T>& operator=(const RopeSequence<T>& other) {
+        Node* shared = _retain(other.root);
+        _release(root);
+        root = shared;
+        return *this;
+    }
+
+    ~RopeSequence() override {
+        _release(root);
+    }
+
+    virtual Sequence<T>* CreateEmptySequence() const override {
+        return new RopeSequence<T>();
+    }
+
+    virtual int GetLength() const override {
+        return root != nullptr ? root->length : 0;
+    }
+
+    // Глубина дерева; у пустой и из одного куска - 0
+    int GetDepth() const {
+        return root != nullptr ? root->depth : 0;
+    }
+
+    const T& GetFirst() const override {
+        if (GetLength() == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get first element");
+        }
+        return _read(0);
+    }
+
+    const T& GetLast() const override {
+        if (GetLength() == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get last element");
+        }
+        return _read(GetLength() - 1);
+    }
+
+    const T& Get(int index) const override {
+        _checkException(index);
+        return _read(index);
+    }
+
+    T& GetFirst() override {
+        if (GetLength() == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get first element");
+        }
+        return _write(root, 0);
+    }
+
+    T& GetLast() override {
+        if (GetLength() == 0) {
+            throw std::out_of_range("Sequence is empty - cannot get last element");
+        }
+        return _write(root, GetLength() - 1);
+    }
+
+    T& Get(int index) override {
+        _checkException(index);
+        return _write(root, index);
+    }
+
+    T& operator[] (int index) override {
+        return Get(index);
+    }
+
+    virtual Sequence<T>* Append(const T& item) override {
+        return AppendInternal(item);
+    }
+
+    virtual Sequence<T>* Prepend(const T& item) override {
+        return PrependInternal(item);
+    }
+
+    virtual Sequence<T>* InsertAt(const T& item, int index) override {
+        _checkException(index);
+        return InsertAtInternal(item, index);
+    }
+
+    virtual Sequence<T>* Concat(const Sequence<T>* other) override {
+        return ConcatInternal(other);
+    }
+
+    // Прямой отрезок - за O(log n) над теми же кусками, обратный - копия
+    Sequence<T>* GetSubsequence(int startIndex, int endIndex) const override {
+        if (std::min(startIndex, endIndex) < 0 || std::max(startIndex, endIndex) >= GetLength()) {
+            throw std::out_of_range("RopeSequence index out of range");
+        }
+
+        if (startIndex <= endIndex) {
+            return new RopeSequence<T>(_sub(root, startIndex, endIndex - startIndex + 1));
+        }
+
+        int count = startIndex - endIndex + 1;
+        return new RopeSequence<T>(_freshLeaf(count, [&](T* items) {
+            _copyTo(root, endIndex, count, items);
+            std::reverse(items, items + count);
+        }));
+    }
+
+    void CopyTo(T* out, int start, int count) const override {
+        _copyTo(root, start, count, out);
+    }
+};
+
+
 template <typename T1, typename T2>
 Sequence<std::pair<T1, T2>>* zip(const Sequence<T1>* seq1, const Sequence<T2>* seq2) {
     int min_length = std::min(seq1->GetLength(), seq2->GetLength());
@@ -0,0 +1,291 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "../Concurrency/ThreadPool.hpp"
+#include "../Diagnostics/MemoryAccounting.hpp"
+
+
+// Сортировки массивов для последовательностей. Компаратор less и ключ key
+// - параметры шаблона, так что сравнения встраиваются без std::function.
+
+// Куски не длиннее этого сортируются вставками
+const int kInsertionSortRun = 32;
+// Меньше стольких элементов на поток параллелить не стоит
+const int kParallelSortGrain = 1 << 14;
+
+// Ключи, которые сортируются поразрядно: целые (кроме bool) и строки
+template <typename Key>
+constexpr bool IsRadixKey =
+    (std::is_integral<Key>::value && !std::is_same<Key, bool>::value) ||
+    std::is_same<Key, std::string>::value;
+
+// Тип ключа, который key возвращает для T
+template <typename T, typename KeyOf>
+using SortKey = typename std::decay<
+    decltype(std::declval<KeyOf&>()(std::declval<const T&>()))>::type;
+
+// Биты целого ключа так, что их порядок как у беззнаковых совпадает с
+// порядком ключей
+template <typename Key>
+typename std::make_unsigned<Key>::type RadixBits(Key key) {
+    using Bits = typename std::make_unsigned<Key>::type;
+    Bits bits = static_cast<Bits>(key);
+    if (std::is_signed<Key>::value) {
+        bits ^= Bits(1) << (sizeof(Bits) * 8 - 1);
+    }
+    return bits;
+}
+
+template <typename T, typename Compare>
+void InsertionSortRange(T* items, int count, Compare& less) {
+    for (int i = 1; i < count; ++i) {
+        T item = std::move(items[i]);
+        int j = i;
+        for (; j > 0 && less(item, items[j - 1]); --j) {
+            items[j] = std::move(items[j - 1]);
+        }
+        items[j] = std::move(item);
+    }
+}
+
+// Устойчивое слияние: при равенстве первым идёт элемент из left
+template <typename T, typename Compare>
+void MergeRuns(T* left, int leftCount, T* right, int rightCount, T* out, Compare& less) {
+    T* leftEnd = left + leftCount;
+    T* rightEnd = right + rightCount;
+    while (left != leftEnd && right != rightEnd) {
+        if (less(*right, *left)) {
+            *out++ = std::move(*right++);
+        } else {
+            *out++ = std::move(*left++);
+        }
+    }
+    out = std::move(left, leftEnd, out);
+    std::move(right, rightEnd, out);
+}
+
+// Устойчивая сортировка слиянием снизу вверх: куски по kInsertionSortRun
+// вставками, дальше слияния попеременно в buffer и обратно
+template <typename T, typename Compare>
+void MergeSortRange(T* items, T* buffer, int count, Compare& less) {
+    for (int i = 0; i < count; i += kInsertionSortRun) {
+        InsertionSortRange(items + i, std::min(kInsertionSortRun, count - i), less);
+    }
+
+    T* source = items;
+    T* target = buffer;
+    for (int width = kInsertionSortRun; width < count; width *= 2) {
+        for (int i = 0; i < count; i += 2 * width) {
+            int middle = std::min(i + width, count);
+            int end = std::min(i + 2 * width, count);
+            MergeRuns(source + i, middle - i, source + middle, end - middle, target + i, less);
+        }
+        std::swap(source, target);
+    }
+    if (source != items) {
+        std::move(source, source + count, items);
+    }
+}
+
+// Сколько из первых outCount элементов слияния left и right придут из left
+template <typename T, typename Compare>
+int MergeSplit(int outCount, const T* left, int leftCount, const T* right, int rightCount, Compare& less) {
+    int low = std::max(0, outCount - rightCount);
+    int high = std::min(outCount, leftCount);
+    while (low < high) {
+        int fromLeft = (low + high) / 2;
+        int fromRight = outCount - fromLeft;
+        if (fromRight > 0 && !less(right[fromRight - 1], left[fromLeft])) {
+            low = fromLeft + 1;
+        } else {
+            high = fromLeft;
+        }
+    }
+    return low;
+}
+
+// Сортировка массива на пуле: куски по потокам сортируются независимо,
+// потом сливаются попарно. Каждое слияние делится по выходу на части
+// (MergeSplit), чтобы последние слияния тоже шли во все потоки.
+// Без пула или на маленьком массиве - в вызывающем потоке.
+template <typename T, typename Compare>
+void ParallelSortRange(T* items, int count, Compare less, bool stable, ThreadPool* pool) {
+    int chunks = 1;
+    if (pool != nullptr) {
+        while (chunks * 2 <= static_cast<int>(pool->size()) &&
+               count / (chunks * 2) >= kParallelSortGrain) {
+            chunks *= 2;
+        }
+    }
+    if (chunks == 1 && !stable) {
+        std::sort(items, items + count, less);
+        return;
+    }
+
+    MemoryTag tag = MemoryAccounting::currentTag();
+    T* buffer = newTaggedArray<T>(tag, count);
+    if (chunks == 1) {
+        MergeSortRange(items, buffer, count, less);
+        deleteTaggedArray(tag, buffer, count);
+        return;
+    }
+
+    int chunk = (count + chunks - 1) / chunks;
+    pool->parallelFor(chunks, [&](size_t c) {
+        int begin = static_cast<int>(c) * chunk;
+        int length = std::min(chunk, count - begin);
+        if (length <= 0) return;
+        if (stable) {
+            MergeSortRange(items + begin, buffer + begin, length, less);
+        } else {
+            std::sort(items + begin, items + begin + length, less);
+        }
+    });
+
+    T* source = items;
+    T* target = buffer;
+    for (int width = chunk; width < count; width *= 2) {
+        int pairs = (count + 2 * width - 1) / (2 * width);
+        int pieces = std::max(1, chunks / pairs);
+        pool->parallelFor(pairs * pieces, [&](size_t task) {
+            int begin = static_cast<int>(task) / pieces * 2 * width;
+            int piece = static_cast<int>(task) % pieces;
+            int middle = std::min(begin + width, count);
+            int end = std::min(begin + 2 * width, count);
+            int leftCount = middle - begin;
+            int rightCount = end - middle;
+
+            long long total = leftCount + rightCount;
+            int from = static_cast<int>(total * piece / pieces);
+            int to = static_cast<int>(total * (piece + 1) / pieces);
+            int leftFrom = MergeSplit(from, source + begin, leftCount, source + middle, rightCount, less);
+            int leftTo = MergeSplit(to, source + begin, leftCount, source + middle, rightCount, less);
+            MergeRuns(source + begin + leftFrom, leftTo - leftFrom,
+                      source + middle + (from - leftFrom), (to - leftTo) - (from - leftFrom),
+                      target + begin + from, less);
+        });
+        std::swap(source, target);
+    }
+    if (source != items) {
+        pool->parallelFor(chunks, [&](size_t c) {
+            int begin = static_cast<int>(c) * chunk;
+            int length = std::min(chunk, count - begin);
+            if (length > 0) {
+                std::move(source + begin, source + begin + length, items + begin);
+            }
+        });
+    }
+    deleteTaggedArray(tag, buffer, count);
+}
+
+// LSD: по байту ключа за проход, от младшего. Гистограммы всех байтов
+// считаются за один проход; байт, одинаковый у всех ключей, пропускается.
+template <typename T, typename KeyOf>
+void LsdRadixSortRange(T* items, T* buffer, int count, KeyOf& key) {
+    using Key = SortKey<T, KeyOf>;
+    const int passes = sizeof(Key);
+    int counts[sizeof(Key)][256] = {};
+    for (int i = 0; i < count; ++i) {
+        auto bits = RadixBits(key(items[i]));
+        for (int pass = 0; pass < passes; ++pass) {
+            ++counts[pass][(bits >> (8 * pass)) & 0xFF];
+        }
+    }
+
+    T* source = items;
+    T* target = buffer;
+    for (int pass = 0; pass < passes; ++pass) {
+        int* histogram = counts[pass];
+        if (histogram[(RadixBits(key(source[0])) >> (8 * pass)) & 0xFF] == count) {
+            continue;
+        }
+
+        int offset = 0;
+        for (int digit = 0; digit < 256; ++digit) {
+            int size = histogram[digit];
+            histogram[digit] = offset;
+            offset += size;
+        }
+        for (int i = 0; i < count; ++i) {
+            int digit = (RadixBits(key(source[i])) >> (8 * pass)) & 0xFF;
+            target[histogram[digit]++] = std::move(source[i]);
+        }
+        std::swap(source, target);
+    }
+    if (source != items) {
+        std::move(source, source + count, items);
+    }
+}
+
+// MSD: раскладка по байту depth (конец строки - раньше всех байтов) и
+// рекурсия в каждую корзину; маленькие корзины - вставками по хвостам
+// строк. Раскладка устойчива, так что и вся сортировка.
+template <typename T, typename KeyOf>
+void MsdRadixSortRange(T* items, T* buffer, int count, size_t depth, KeyOf& key) {
+    if (count <= kInsertionSortRun) {
+        auto less = [&](const T& a, const T& b) {
+            return key(a).compare(depth, std::string::npos, key(b), depth, std::string::npos) < 0;
+        };
+        InsertionSortRange(items, count, less);
+        return;
+    }
+
+    auto digit = [&](const T& item) {
+        const std::string& text = key(item);
+        return depth < text.size() ? 1 + static_cast<unsigned char>(text[depth]) : 0;
+    };
+    int starts[258] = {};
+    for (int i = 0; i < count; ++i) {
+        ++starts[digit(items[i]) + 1];
+    }
+    for (int d = 0; d < 257; ++d) {
+        starts[d + 1] += starts[d];
+    }
+
+    int next[257];
+    std::copy(starts, starts + 257, next);
+    for (int i = 0; i < count; ++i) {
+        buffer[next[digit(items[i])]++] = std::move(items[i]);
+    }
+    std::move(buffer, buffer + count, items);
+
+    for (int d = 1; d < 257; ++d) {
+        int size = starts[d + 1] - starts[d];
+        if (size > 1) {
+            MsdRadixSortRange(items + starts[d], buffer + starts[d], size, depth + 1, key);
+        }
+    }
+}
+
+// Устойчивая поразрядная сортировка по key: целый ключ - LSD, строка - MSD
+template <typename T, typename KeyOf>
+void RadixSortRange(T* items, int count, KeyOf key) {
+    using Key = SortKey<T, KeyOf>;
+    static_assert(IsRadixKey<Key>, "radix sort needs an integer or std::string key");
+    if (count < 2) return;
+
+    MemoryTag tag = MemoryAccounting::currentTag();
+    T* buffer = newTaggedArray<T>(tag, count);
+    if constexpr (std::is_same<Key, std::string>::value) {
+        MsdRadixSortRange(items, buffer, count, 0, key);
+    } else {
+        LsdRadixSortRange(items, buffer, count, key);
+    }
+    deleteTaggedArray(tag, buffer, count);
+}
+
+// Сортировка массива с компаратором less. По умолчанию (std::less) целые
+// и строки сортируются поразрядно, в вызывающем потоке.
+template <typename T, typename Compare>
+void SortRange(T* items, int count, Compare less, bool stable, ThreadPool* pool) {
+    if (count < 2) return;
+    if constexpr (std::is_same<Compare, std::less<T>>::value && IsRadixKey<T>) {
+        RadixSortRange(items, count, [](const T& item) -> const T& { return item; });
+    } else {
+        ParallelSortRange(items, count, less, stable, pool);
+    }
+}
@@ -0,0 +1,434 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Concurrency/ThreadPool.hpp"
+#include "Library.hpp"
+
+// Номер шарда для ключа (ISBN или userId) из shardCount
+using ShardRouter =
+    std::function<uint32_t(const std::string& key, uint32_t shardCount)>;
+
+inline uint32_t hashShard(const std::string& key, uint32_t shardCount) {
+  return static_cast<uint32_t>(std::hash<std::string>()(key) % shardCount);
+}
+
+// Каталог и читатели, разложенные по нескольким Library (например, по
+// филиалам) в одном процессе. Книга живёт в шарде bookRouter(ISBN),
+// читатель - в шарде userRouter(userId). Операции с одной книгой или
+// одним читателем идут в его шард под мьютексом шарда; поиск и список
+// просрочек выполняются во всех шардах параллельно на пуле потоков,
+// результаты сливаются.
+//
+// Книгу из чужого шарда читатель берёт через свою копию в шарде книги:
+// там ведутся история, штрафы и очереди этой выдачи. Лимит книг
+// проверяется в домашнем шарде читателя: его выдачи там плюс выдачи в
+// других шардах (remoteLoans).
+//
+// Номера читателей и книг в записях, которые отдаёт ShardedLibrary,
+// глобальные: local * shardCount + shard. Строки по ним дают
+// getRecordUserId/getRecordBookId этого класса.
+//
+// Книги и читатели наружу отдаются только копиями, снятыми под мьютексом
+// шарда: после него шард меняют другие потоки.
+class ShardedLibrary : public LibraryOperations {
+ private:
+  struct Shard {
+    Library* library;
+    std::mutex mutex;
+    // Выдачи своих читателей в других шардах: userId -> число
+    std::unordered_map<std::string, int> remoteLoans;
+    // Копии чужих читателей, заведённые ради выдач из этого шарда
+    std::unordered_set<std::string> replicas;
+
+    explicit Shard(Clock* clock) : library(new Library(clock)) {}
+    ~Shard() { delete library; }
+  };
+
+  // Захват одного или двух шардов без риска взаимной блокировки
+  class PairLock {
+   private:
+    std::unique_lock<std::mutex> first;
+    std::unique_lock<std::mutex> second;
+
+   public:
+    PairLock(Shard& a, Shard& b)
+        : first(a.mutex, std::defer_lock), second(b.mutex, std::defer_lock) {
+      if (&a == &b) {
+        first.lock();
+      } else {
+        std::lock(first, second);
+      }
+    }
+  };
+
+  std::vector<Shard*> shards;
+  ThreadPool* pool;
+  ShardRouter bookRouter;
+  ShardRouter userRouter;
+
+  uint32_t shardCount() const { return static_cast<uint32_t>(shards.size()); }
+
+  uint32_t bookShard(const std::string& isbn) const {
+    return bookRouter(isbn, shardCount()) % shardCount();
+  }
+
+  uint32_t userShard(const std::string& userId) const {
+    return userRouter(userId, shardCount()) % shardCount();
+  }
+
+  BorrowingRecord toGlobal(const BorrowingRecord& record,
+                           uint32_t shard) const {
+    BorrowingRecord global(record.getUserHandle() * shardCount() + shard,
+                           record.getBookKey() * shardCount() + shard,
+                           record.getBorrowDay(), record.getLoanDays());
+    if (record.isReturned()) global.markReturned();
+    return global;
+  }
+
+  BorrowingRecord toLocal(const BorrowingRecord& record) const {
+    return BorrowingRecord(record.getUserHandle() / shardCount(),
+                           record.getBookKey() / shardCount(),
+                           record.getBorrowDay(), record.getLoanDays());
+  }
+
+  // Копия читателя user в шарде shard; вызывается под мьютексом шарда
+  static bool ensureReplica(Shard& shard, LibraryUser& user) {
+    if (shard.library->findUser(user.getUserId()) == nullptr &&
+        !shard.library->registerUser(&user)) {
+      return false;
+    }
+    shard.replicas.insert(user.getUserId());
+    return true;
+  }
+
+  // Запрос во все шарды параллельно: part(i, library) под мьютексом шарда
+  template <typename T, typename Fn>
+  std::vector<T> scatter(Fn part) {
+    std::vector<T> parts(shards.size());
+    pool->parallelFor(shards.size(), [&](size_t i) {
+      std::lock_guard<std::mutex> lock(shards[i]->mutex);
+      parts[i] = part(static_cast<uint32_t>(i), *shards[i]->library);
+    });
+    return parts;
+  }
+
+  // Поиск в шарде; книги копируются, пока мьютекс шарда ещё захвачен
+  static SearchResults* ownedResults(SearchResults* results) {
+    results->ownBooks();
+    return results;
+  }
+
+  static SearchResults* mergeResults(std::vector<SearchResults*>& parts) {
+    unsigned long generation = 0;
+    for (SearchResults* part : parts) generation += part->generation;
+
+    SearchResults* merged = new SearchResults(generation);
+    for (SearchResults* part : parts) {
+      for (const SearchMatch& match : *part->matches) {
+        merged->matches->Append(match);
+      }
+      merged->ownedBooks.splice(merged->ownedBooks.end(), part->ownedBooks);
+      delete part;
+    }
+    return merged;
+  }
+
+ public:
+  // threads == 0 - по числу ядер; clock == nullptr - системные часы
+  explicit ShardedLibrary(uint32_t shardCount, size_t threads = 0,
+                          Clock* clock = nullptr,
+                          ShardRouter bookRouter = hashShard,
+                          ShardRouter userRouter = hashShard)
+      : pool(new ThreadPool(threads)),
+        bookRouter(bookRouter),
+        userRouter(userRouter) {
+    for (uint32_t i = 0; i < std::max(shardCount, 1u); ++i) {
+      shards.push_back(new Shard(clock));
+    }
+  }
+
+  ~ShardedLibrary() {
+    delete pool;
+    for (Shard* shard : shards) delete shard;
+  }
+
+  ShardedLibrary(const ShardedLibrary&) = delete;
+  ShardedLibrary& operator=(const ShardedLibrary&) = delete;
+
+  uint32_t getShardCount() const { return shardCount(); }
+
+  // Шард целиком, для задач вне LibraryOperations (штрафы, очереди).
+  // Потокобезопасность - на вызывающем.
+  Library& getShard(uint32_t shard) { return *shards[shard]->library; }
+
+  virtual bool addBook(const std::string& title, const std::string& author,
+                       const std::string& isbn,
+                       const std::string& genre) override {
+    Shard& shard = *shards[bookShard(isbn)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.library->addBook(title, author, isbn, genre);
+  }
+
+  virtual bool removeBook(const std::string& isbn) override {
+    Shard& shard = *shards[bookShard(isbn)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.library->removeBook(isbn);
+  }
+
+  virtual std::optional<Book> getBook(const std::string& isbn) override {
+    Shard& shard = *shards[bookShard(isbn)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.library->getBook(isbn);
+  }
+
+  // Совпадения шардов подряд, в порядке шардов; книги в результате -
+  // копии (см. SearchResults::ownedBooks)
+  virtual SearchResults* searchBooks(const std::string& query) override {
+    std::vector<SearchResults*> parts =
+        scatter<SearchResults*>([&](uint32_t, Library& library) {
+          return ownedResults(library.searchBooks(query));
+        });
+    return mergeResults(parts);
+  }
+
+  // Каждый шард отдаёт свои k лучших, из них выбираются k лучших всего
+  virtual SearchResults* searchBooks(const std::string& query,
+                                     int k) override {
+    std::vector<SearchResults*> parts =
+        scatter<SearchResults*>([&](uint32_t, Library& library) {
+          return ownedResults(library.searchBooks(query, k));
+        });
+    SearchResults* merged = mergeResults(parts);
+
+    std::vector<SearchMatch> matches;
+    for (const SearchMatch& match : *merged->matches) matches.push_back(match);
+    size_t keep = std::min(matches.size(), static_cast<size_t>(std::max(k, 0)));
+    std::partial_sort(matches.begin(), matches.begin() + keep, matches.end(),
+                      betterMatch);
+
+    SearchResults* top = new SearchResults(merged->generation);
+    for (size_t i = 0; i < keep; ++i) top->matches->Append(matches[i]);
+    top->ownedBooks.splice(top->ownedBooks.end(), merged->ownedBooks);
+    delete merged;
+    return top;
+  }
+
+  // Копии всех книг; ссылок в шарды ShardedLibrary не отдаёт
+  Sequence<Book>* getAllBooks() {
+    std::vector<Sequence<Book>*> parts =
+        scatter<Sequence<Book>*>([](uint32_t, Library& library) {
+          Sequence<const Book*>* books = library.getAllBooks();
+          Sequence<Book>* copies = new MutableArraySequence<Book>();
+          for (const Book* book : *books) copies->Append(*book);
+          delete books;
+          return copies;
+        });
+    Sequence<Book>* all = new MutableArraySequence<Book>();
+    for (Sequence<Book>* part : parts) {
+      for (const Book& book : *part) all->Append(book);
+      delete part;
+    }
+    return all;
+  }
+
+  // Сумма поколений шардов: меняется, когда меняется любой из них
+  unsigned long getCatalogGeneration() {
+    unsigned long generation = 0;
+    for (Shard* shard : shards) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      generation += shard->library->getCatalogGeneration();
+    }
+    return generation;
+  }
+
+  bool isCurrent(const SearchResults* results) {
+    return results->generation == getCatalogGeneration();
+  }
+
+  virtual bool registerUser(const std::string& name, const std::string& userId,
+                            const std::string& email, UserType type) override {
+    Shard& shard = *shards[userShard(userId)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.library->registerUser(name, userId, email, type);
+  }
+
+  virtual bool registerUser(LibraryUser* user) override {
+    return registerUser(user->getName(), user->getUserId(), user->getEmail(),
+                        user->getType());
+  }
+
+  // Копии читателя в других шардах тоже удаляются. Читателя с книгами
+  // на руках в любом шарде удалить нельзя; домашний мьютекс держит и
+  // borrowBook, так что новые выдачи в это время не появятся.
+  virtual bool removeUser(const std::string& userId) override {
+    uint32_t home = userShard(userId);
+    {
+      Shard& homeShard = *shards[home];
+      std::lock_guard<std::mutex> lock(homeShard.mutex);
+      if (homeShard.remoteLoans.count(userId) != 0 ||
+          !homeShard.library->removeUser(userId)) {
+        return false;
+      }
+    }
+    for (uint32_t i = 0; i < shardCount(); ++i) {
+      if (i == home) continue;
+      std::lock_guard<std::mutex> lock(shards[i]->mutex);
+      if (shards[i]->replicas.erase(userId) != 0) {
+        shards[i]->library->removeUser(userId);
+      }
+    }
+    return true;
+  }
+
+  virtual std::optional<LibraryUser> getUser(
+      const std::string& userId) override {
+    Shard& shard = *shards[userShard(userId)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.library->getUser(userId);
+  }
+
+  // Копии читателей по домашним шардам, без их копий в других шардах
+  Sequence<LibraryUser>* getAllUsers() {
+    std::vector<Sequence<LibraryUser>*> parts =
+        scatter<Sequence<LibraryUser>*>([this](uint32_t i, Library& library) {
+          Sequence<LibraryUser*>* users = library.getAllUsers();
+          Sequence<LibraryUser>* copies =
+              new MutableArraySequence<LibraryUser>();
+          for (LibraryUser* user : *users) {
+            if (userShard(user->getUserId()) == i) copies->Append(*user);
+          }
+          delete users;
+          return copies;
+        });
+    Sequence<LibraryUser>* all = new MutableArraySequence<LibraryUser>();
+    for (Sequence<LibraryUser>* part : parts) {
+      for (const LibraryUser& user : *part) all->Append(user);
+      delete part;
+    }
+    return all;
+  }
+
+  virtual bool borrowBook(const std::string& userId,
+                          const std::string& isbn) override {
+    uint32_t home = userShard(userId);
+    uint32_t owner = bookShard(isbn);
+    Shard& homeShard = *shards[home];
+    Shard& ownerShard = *shards[owner];
+    PairLock lock(homeShard, ownerShard);
+
+    LibraryUser* user = homeShard.library->findUser(userId);
+    if (user == nullptr) return false;
+    auto remote = homeShard.remoteLoans.find(userId);
+    int loans = user->getBorrowedCount() +
+                (remote == homeShard.remoteLoans.end() ? 0 : remote->second);
+    if (loans >= user->getMaxBooks()) return false;
+
+    if (home == owner) return ownerShard.library->borrowBook(userId, isbn);
+    if (!ensureReplica(ownerShard, *user) ||
+        !ownerShard.library->borrowBook(userId, isbn)) {
+      return false;
+    }
+    ++homeShard.remoteLoans[userId];
+    return true;
+  }
+
+  virtual bool returnBook(const std::string& userId,
+                          const std::string& isbn) override {
+    uint32_t home = userShard(userId);
+    uint32_t owner = bookShard(isbn);
+    Shard& homeShard = *shards[home];
+    Shard& ownerShard = *shards[owner];
+    PairLock lock(homeShard, ownerShard);
+
+    if (!ownerShard.library->returnBook(userId, isbn)) return false;
+    if (home != owner) {
+      auto remote = homeShard.remoteLoans.find(userId);
+      if (remote != homeShard.remoteLoans.end() && --remote->second == 0) {
+        homeShard.remoteLoans.erase(remote);
+      }
+    }
+    return true;
+  }
+
+  virtual Sequence<BorrowingRecord>* getOverdueBooks() override {
+    std::vector<Sequence<BorrowingRecord>*> parts =
+        scatter<Sequence<BorrowingRecord>*>([](uint32_t, Library& library) {
+          return library.getOverdueBooks();
+        });
+    Sequence<BorrowingRecord>* overdue =
+        new MutableArraySequence<BorrowingRecord>();
+    for (uint32_t i = 0; i < shardCount(); ++i) {
+      for (const BorrowingRecord& record : *parts[i]) {
+        overdue->Append(toGlobal(record, i));
+      }
+      delete parts[i];
+    }
+    return overdue;
+  }
+
+  // История всех шардов на момент вызова, по дню выдачи (в один день -
+  // по шарду и порядку выдачи в нём). Курсор сам держит этот снимок:
+  // другие вызовы и изменения шардов его не трогают. Номера записей в
+  // снимке - их места в нём.
+  virtual HistoryCursor getBorrowHistory() override {
+    std::vector<HistoryTiers> versions;
+    {
+      std::vector<std::unique_lock<std::mutex>> locks;
+      for (Shard* shard : shards) locks.emplace_back(shard->mutex);
+      for (Shard* shard : shards) {
+        versions.push_back(shard->library->getHistoryStorage().version());
+      }
+    }
+
+    struct Entry {
+      BorrowingRecord record;
+      uint32_t shard;
+      uint32_t id;
+    };
+    std::vector<Entry> entries;
+    for (uint32_t i = 0; i < shardCount(); ++i) {
+      HistoryCursor cursor(&versions[i]);
+      BorrowingRecord record;
+      uint32_t id;
+      while (cursor.next(record, &id)) {
+        entries.push_back({toGlobal(record, i), i, id});
+      }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) {
+                if (a.record.getBorrowDay() != b.record.getBorrowDay()) {
+                  return a.record.getBorrowDay() < b.record.getBorrowDay();
+                }
+                if (a.shard != b.shard) return a.shard < b.shard;
+                return a.id < b.id;
+              });
+
+    auto merged = std::make_shared<HistoryTiers>();
+    for (size_t i = 0; i < entries.size(); ++i) {
+      merged->hotRecords.push_back(entries[i].record);
+      merged->hotIds.push_back(static_cast<uint32_t>(i));
+    }
+    return HistoryCursor(std::shared_ptr<const HistoryTiers>(merged));
+  }
+
+  virtual std::string getRecordUserId(const BorrowingRecord& record) override {
+    Shard& shard = *shards[record.getUserHandle() % shardCount()];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.library->getRecordUserId(toLocal(record));
+  }
+
+  virtual std::string getRecordBookId(const BorrowingRecord& record) override {
+    Shard& shard = *shards[record.getBookKey() % shardCount()];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.library->getRecordBookId(toLocal(record));
+  }
+};
@@ -0,0 +1,165 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "Books.hpp"
+#include "BorrowHistory.hpp"
+#include "Concurrency/Versioned.hpp"
+#include "Diagnostics/MemoryAccounting.hpp"
+#include "Sequence/Sequence.hpp"
+#include "Users.hpp"
+
+// Версия книги с номером ordinal. Удалённая книга остаётся со своим ISBN
+// и present == false: по её номеру ещё находятся выдачи в истории.
+struct CatalogSlot {
+  Book book;
+  bool present;
+
+  CatalogSlot() : present(false) {}
+  CatalogSlot(const Book& book, bool present) : book(book), present(present) {}
+};
+
+// Версия пользователя с номером handle; удалённый - с active == false
+struct UserSlot {
+  LibraryUser user;
+  bool active;
+
+  UserSlot() : active(false) {}
+  UserSlot(const LibraryUser& user, bool active) : user(user), active(active) {}
+};
+
+using CatalogVersions = VersionedVector<CatalogSlot, MemoryTag::CATALOG>;
+using UserVersions = VersionedVector<UserSlot, MemoryTag::USERS>;
+
+// Каталог и пользователи по номерам, страницами с копированием при
+// записи. Библиотека заводит их при снимке и обновляет при каждом
+// изменении книги или пользователя, пока жив хоть один снимок.
+struct LibraryVersions {
+  CatalogVersions catalog;
+  UserVersions users;
+};
+
+// Снимки держат общую метку; библиотека видит через weak_ptr, что живых
+// снимков не осталось, и освобождает версии
+struct SnapshotLease {};
+
+// Неизменяемый вид на библиотеку в момент снятия (см. Library::snapshot):
+// каталог, пользователи и история выдач. Длинные отчёты и выгрузки идут
+// по снимку в любом потоке, а библиотека тем временем работает дальше;
+// её изменения в снимок не попадают. Страницы, изменённые после снятия,
+// снимок держит у себя и освобождает вместе с последним, кто их видит.
+class LibrarySnapshot {
+ private:
+  using BookIndex = TaggedMap<std::string, uint32_t, MemoryTag::CATALOG>;
+  using UserIndex = TaggedMap<std::string, uint32_t, MemoryTag::USERS>;
+
+  // Отпускается последней, после страниц версий
+  std::shared_ptr<SnapshotLease> lease;
+  CatalogVersions catalog;
+  UserVersions users;
+  HistoryTiers history;
+  int32_t day;
+  unsigned long generation;
+
+  // ISBN / userId -> номер; строятся при первом поиске
+  mutable std::once_flag indexed;
+  mutable BookIndex* bookIndex;
+  mutable UserIndex* userIndex;
+
+  void buildIndex() const {
+    bookIndex = new BookIndex();
+    userIndex = new UserIndex();
+    for (uint32_t ordinal = 0; ordinal < catalog.size(); ++ordinal) {
+      const CatalogSlot& slot = catalog[ordinal];
+      if (slot.present) bookIndex->insert({slot.book.getISBN(), ordinal});
+    }
+    for (uint32_t handle = 0; handle < users.size(); ++handle) {
+      const UserSlot& slot = users[handle];
+      if (slot.active) userIndex->insert({slot.user.getUserId(), handle});
+    }
+  }
+
+ public:
+  LibrarySnapshot(std::shared_ptr<SnapshotLease> lease,
+                  const LibraryVersions& versions, HistoryTiers history,
+                  int32_t day, unsigned long generation)
+      : lease(std::move(lease)),
+        catalog(versions.catalog),
+        users(versions.users),
+        history(std::move(history)),
+        day(day),
+        generation(generation),
+        bookIndex(nullptr),
+        userIndex(nullptr) {}
+
+  ~LibrarySnapshot() {
+    delete bookIndex;
+    delete userIndex;
+  }
+
+  LibrarySnapshot(const LibrarySnapshot&) = delete;
+  LibrarySnapshot& operator=(const LibrarySnapshot&) = delete;
+
+  // День снятия по часам библиотеки
+  int32_t getDay() const { return day; }
+  unsigned long getCatalogGeneration() const { return generation; }
+
+  // Ссылки на книги и пользователей снимка живут, пока жив снимок
+
+  const Book* findBook(const std::string& isbn) const {
+    std::call_once(indexed, [this]() { buildIndex(); });
+    auto it = bookIndex->find(isbn);
+    return it == bookIndex->end() ? nullptr : &catalog[it->second].book;
+  }
+
+  const LibraryUser* findUser(const std::string& userId) const {
+    std::call_once(indexed, [this]() { buildIndex(); });
+    auto it = userIndex->find(userId);
+    return it == userIndex->end() ? nullptr : &users[it->second].user;
+  }
+
+  Sequence<const Book*>* getAllBooks() const {
+    Sequence<const Book*>* allBooks = new MutableArraySequence<const Book*>();
+    for (const CatalogSlot& slot : catalog) {
+      if (slot.present) allBooks->Append(&slot.book);
+    }
+    return allBooks;
+  }
+
+  Sequence<const LibraryUser*>* getAllUsers() const {
+    Sequence<const LibraryUser*>* allUsers =
+        new MutableArraySequence<const LibraryUser*>();
+    for (const UserSlot& slot : users) {
+      if (slot.active) allUsers->Append(&slot.user);
+    }
+    return allUsers;
+  }
+
+  // Выдачи, просроченные на день снятия
+  Sequence<BorrowingRecord>* getOverdueBooks() const {
+    Sequence<BorrowingRecord>* overdue =
+        new MutableArraySequence<BorrowingRecord>();
+    for (const BorrowingRecord& record : history.hotRecords) {
+      if (record.isOverdue(day)) overdue->Append(record);
+    }
+    return overdue;
+  }
+
+  HistoryCursor getBorrowHistory() const { return HistoryCursor(&history); }
+
+  size_t getHistorySize() const {
+    size_t count = history.hotRecords.size();
+    for (const auto& segment : history.segments) count += segment->size();
+    return count;
+  }
+
+  const std::string& getRecordUserId(const BorrowingRecord& record) const {
+    return users[record.getUserHandle()].user.getUserId();
+  }
+
+  const std::string& getRecordBookId(const BorrowingRecord& record) const {
+    return catalog[record.getBookKey()].book.getISBN();
+  }
+};
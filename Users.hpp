@@ -1,41 +1,98 @@
 #pragma once
+#include <cstdint>
 #include <string>
-#include <unordered_set>
+#include <vector>
 
 #include "Books.hpp"
+#include "Diagnostics/MemoryAccounting.hpp"
+
+enum class UserType { STUDENT, FACULTY, GUEST };
+
+// Правила выдачи для типа пользователя. Штрафы в центах: finePerDay за
+// каждый день просрочки сверх graceDays, всего не больше fineCap за выдачу.
+struct UserPolicy {
+  int maxBooks;
+  int borrowDays;
+  int finePerDay;
+  int graceDays;
+  int fineCap;
+};
+
+// Таблица правил, индекс - UserType
+inline const UserPolicy& userPolicy(UserType type) {
+  static const UserPolicy policies[] = {
+      {3, 14, 50, 2, 1000},   // STUDENT
+      {10, 30, 25, 5, 2000},  // FACULTY
+      {1, 7, 100, 0, 1500},   // GUEST
+  };
+  return policies[static_cast<int>(type)];
+}
+
+// Больше книг на руках не бывает ни у одного типа
+constexpr int kMaxBorrowedBooks = 10;
 
 class LibraryUser {
  protected:
   std::string name;
   std::string userId;
   std::string email;
-  std::unordered_set<std::string>* borrowedBooks;
+  UserType type;
+  uint8_t borrowedCount;
+  // Номера книг в библиотеке; заняты первые borrowedCount
+  uint32_t borrowedBooks[kMaxBorrowedBooks];
 
  public:
   LibraryUser()
       : name(""),
         userId(""),
         email(""),
-        borrowedBooks(new std::unordered_set<std::string>()) {};
-
-  ~LibraryUser() { delete borrowedBooks; }
+        type(UserType::GUEST),
+        borrowedCount(0) {};
 
-  LibraryUser(std::string name, std::string userId, std::string email)
+  LibraryUser(UserType type, std::string name, std::string userId,
+              std::string email)
       : name(name),
         userId(userId),
         email(email),
-        borrowedBooks(new std::unordered_set<std::string>()) {};
+        type(type),
+        borrowedCount(0) {};
 
-  virtual int getMaxBooks() const = 0;
-  virtual int getBorrowDays() const = 0;
+  UserType getType() const { return type; }
+  int getMaxBooks() const { return userPolicy(type).maxBooks; }
+  int getBorrowDays() const { return userPolicy(type).borrowDays; }
+  int getFinePerDay() const { return userPolicy(type).finePerDay; }
 
  public:
-  bool canBorrow() { return borrowedBooks->size() < getMaxBooks(); }
+  bool canBorrow() const { return borrowedCount < getMaxBooks(); }
+
+  const std::string& getName() const { return name; }
+  const std::string& getUserId() const { return userId; }
+  const std::string& getEmail() const { return email; }
 
-  std::string getName() const { return name; }
-  std::string getUserId() const { return userId; }
-  std::string getEmail() const { return email; }
-  std::unordered_set<std::string>* getBorrowedBooks() { return borrowedBooks; }
+  int getBorrowedCount() const { return borrowedCount; }
+  uint32_t getBorrowedBook(int index) const { return borrowedBooks[index]; }
+
+  bool hasBorrowed(uint32_t book) const {
+    bool found = false;
+    for (int i = 0; i < borrowedCount; ++i) found |= borrowedBooks[i] == book;
+    return found;
+  }
+
+  bool addBorrowed(uint32_t book) {
+    if (borrowedCount == kMaxBorrowedBooks) return false;
+    borrowedBooks[borrowedCount++] = book;
+    return true;
+  }
+
+  bool removeBorrowed(uint32_t book) {
+    for (int i = 0; i < borrowedCount; ++i) {
+      if (borrowedBooks[i] == book) {
+        borrowedBooks[i] = borrowedBooks[--borrowedCount];
+        return true;
+      }
+    }
+    return false;
+  }
 
   void setName(std::string name) { this->name = name; }
   void setUserId(std::string userId) { this->userId = userId; }
@@ -44,27 +101,74 @@ class LibraryUser {
 
 class Student : public LibraryUser {
  public:
-  virtual int getMaxBooks() const override { return 3; }
-  virtual int getBorrowDays() const override { return 14; }
-
   Student(std::string name, std::string userId, std::string email)
-      : LibraryUser(name, userId, email) {}
+      : LibraryUser(UserType::STUDENT, name, userId, email) {}
 };
 
 class Faculty : public LibraryUser {
  public:
-  virtual int getMaxBooks() const override { return 10; }
-  virtual int getBorrowDays() const override { return 30; }
-
   Faculty(std::string name, std::string userId, std::string email)
-      : LibraryUser(name, userId, email) {}
+      : LibraryUser(UserType::FACULTY, name, userId, email) {}
 };
 
 class Guest : public LibraryUser {
  public:
-  virtual int getMaxBooks() const override { return 1; }
-  virtual int getBorrowDays() const override { return 7; }
-
   Guest(std::string name, std::string userId, std::string email)
-      : LibraryUser(name, userId, email) {}
-};
\ No newline at end of file
+      : LibraryUser(UserType::GUEST, name, userId, email) {}
+};
+
+// Пользователи лежат блоками по kBlockSize: без отдельного new на каждого,
+// и адреса не меняются, когда хранилище растёт. Номер (handle) закреплён
+// за слотом навсегда; удалённый пользователь только помечается неактивным.
+class UserSlab {
+ private:
+  static const uint32_t kBlockSize = 1024;
+
+  std::vector<LibraryUser*, TaggedAllocator<LibraryUser*, MemoryTag::USERS>>
+      blocks;
+  std::vector<bool, TaggedAllocator<bool, MemoryTag::USERS>> active;
+  uint32_t count;
+
+ public:
+  UserSlab() : count(0) {}
+
+  ~UserSlab() {
+    for (LibraryUser* block : blocks) {
+      deleteTaggedArray(MemoryTag::USERS, block, kBlockSize);
+    }
+  }
+
+  UserSlab(const UserSlab&) = delete;
+  UserSlab& operator=(const UserSlab&) = delete;
+
+  uint32_t allocate(const LibraryUser& user) {
+    if (count == blocks.size() * kBlockSize) {
+      blocks.push_back(
+          newTaggedArray<LibraryUser>(MemoryTag::USERS, kBlockSize));
+    }
+    uint32_t handle = count++;
+    get(handle) = user;
+    active.push_back(true);
+    return handle;
+  }
+
+  LibraryUser& get(uint32_t handle) {
+    return blocks[handle / kBlockSize][handle % kBlockSize];
+  }
+
+  const LibraryUser& get(uint32_t handle) const {
+    return blocks[handle / kBlockSize][handle % kBlockSize];
+  }
+
+  bool isActive(uint32_t handle) const { return active[handle]; }
+
+  void deactivate(uint32_t handle) { active[handle] = false; }
+
+  // Повторная регистрация на месте удалённого пользователя
+  void reactivate(uint32_t handle, const LibraryUser& user) {
+    get(handle) = user;
+    active[handle] = true;
+  }
+
+  uint32_t size() const { return count; }
+};